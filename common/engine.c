@@ -0,0 +1,1994 @@
+/*
+ * engine.c - the rules of the nuggets game, independent of any network
+ * handles each message a client sends to a game, and sends the game's replies with message_send
+ * specific function descriptions are located in engine.h
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdatomic.h>
+
+#include "../libs/file.h"
+#include "../libs/mem.h"
+#include "../support/log.h"
+#include "../support/message.h"
+
+#include "structs.h"
+#include "game.h"
+#include "grid.h"
+#include "events.h"
+#include "engine.h"
+
+
+/**************** game variables  ****************/
+const int MaxPlayers = 26;             // maximum number of players
+static const int MaxNameLength = 50;   // max number of chars in playerName
+static const int GoldTotal = 250;      // amount of gold in the game
+static const int GoldMinNumPiles = 10; // minimum number of gold piles
+static const int GoldMaxNumPiles = 30; // maximum number of gold piles
+static const int DefaultViewRows = 24;   // window given to players on maps too big for one DISPLAY
+static const int DefaultViewColumns = 80;
+static const int DisplayHeaderLength = 8;  // strlen("DISPLAY\n")
+static const int MinChunkBytes = 256;      // smallest datagram a client may ask for DISPLAY chunks in
+static const int BundleHeaderLength = 7;   // strlen("BUNDLE\n")
+static const int MoveToMaxSteps = 100;     // most steps one MOVETO takes
+static const int StatsBytes = 4096;        // room for the reply to STATS
+
+// The step each movement key takes
+static const struct {
+    char key;
+    int dr, dc;
+} Steps[] = {
+    { 'h', 0, -1 }, { 'l', 0, 1 }, { 'j', 1, 0 }, { 'k', -1, 0 },
+    { 'y', -1, -1 }, { 'u', -1, 1 }, { 'b', 1, -1 }, { 'n', 1, 1 },
+};
+
+/**************** deferred displays ****************/
+/* While a batch of keys is handled, each client's display is marked pending rather than sent, and sent once at the end. */
+static _Thread_local bool displaysDeferred = false;
+
+/**************** metrics ****************/
+/* The metrics of the game whose message (or tick) this thread is handling, for what it sends to be counted;
+ * NULL between messages. */
+static _Thread_local metrics_t* sendMetrics = NULL;
+/* Where each game's metrics are written when it ends; set once, before the games start (see engine_reportMetrics). */
+static FILE* metricsReport = NULL;
+
+/* The operator's host, which may ask any game for STATS besides loopback, or 0.0.0.0 (no host) for none;
+ * set once, before the games start (see engine_allowStats). */
+static struct in_addr statsOperator = { INADDR_ANY };
+
+/**************** allocation guard ****************/
+/* Set once, before the games start (see engine_guardAllocations). */
+static engine_guard_t allocationGuard = Guard_Off;
+static _Atomic long allocatingKeys = 0;  // KEY and KEYS messages that allocated while guarded
+
+/**************** bundle ****************/
+/* While a client joins with BUNDLE, the replies to it are gathered here, and sent as one datagram.
+ * Each thread handles its own games, so each has its own bundle, reused for every join. */
+static _Thread_local struct {
+    bool open;              // are replies to the client being gathered
+    addr_t to;              // the client joining
+    int length;             // bytes gathered so far
+    char buffer[65507 + 1]; // message_MaxBytes, and a terminating null
+} bundle;
+
+
+/**************** local functions ****************/
+static void update_previous_spot(client_t* player, game_t* game, char grid_val);
+static void set_view(game_t* game, client_t* player, int rows, int columns);
+static void send_gridMsg(game_t* game, client_t* client);
+static void send_rowChunks(game_t* game, client_t* client, const char* tag, const char* map, int rows, int columns, int maxBytes);
+static void send_mapMsg(game_t* game, client_t* client);
+static void send_frameMsg(game_t* game, client_t* client);
+static int clamp(int value, int low, int high);
+static void send_message(const addr_t to, const char* message);
+static void bundle_begin(const addr_t to);
+static void bundle_flush(void);
+static int apply_key(client_t* player, char key, game_t* game);
+static int move_toward(client_t* player, int r, int c, game_t* game);
+static const int* search_moveField(game_t* game, int target, int from);
+static void delete_moveField(game_t* game);
+static int bot_step(game_t* game, client_t* bot);
+static void build_goldField(game_t* game);
+static void take_goldSource(game_t* game, int spot);
+static void delete_goldField(game_t* game);
+static void sort_seeds(long long* seeds, int nseeds);
+static void sift_seed(long long* seeds, int i, int n);
+static bool has_openSpot(game_t* game);
+static void refresh_display(game_t* game, client_t* client);
+static void send_pendingDisplays(game_t* game);
+static void log_malformed(game_t* game, const char* message);
+static void note_allocation(const char* message, int allocs);
+static int format_metrics(game_t* game, char* text, size_t size);
+
+
+/**************** requests ****************/
+// The requests a client may send, and Request_Unknown for anything else
+typedef enum request {
+    Request_Play, Request_Spectate, Request_Key, Request_Keys, Request_MoveTo,
+    Request_Bundle, Request_View, Request_Chunk, Request_Layers, Request_Stats, Request_Unknown
+} request_t;
+
+// A part of a message, read in place rather than copied
+typedef struct slice {
+    const char* start;
+    size_t length;
+} slice_t;
+
+// Handles one request; returns true when it ends the game
+typedef bool (*request_handler_t)(game_t* game, const addr_t from, const char* message, slice_t argument);
+
+static request_t parse_request(const char* message, slice_t* argument);
+static bool handle_play(game_t* game, const addr_t from, const char* message, slice_t argument);
+static bool handle_spectate(game_t* game, const addr_t from, const char* message, slice_t argument);
+static bool handle_key(game_t* game, const addr_t from, const char* message, slice_t argument);
+static bool handle_keys(game_t* game, const addr_t from, const char* message, slice_t argument);
+static bool handle_moveto(game_t* game, const addr_t from, const char* message, slice_t argument);
+static bool handle_bundle(game_t* game, const addr_t from, const char* message, slice_t argument);
+static bool handle_view(game_t* game, const addr_t from, const char* message, slice_t argument);
+static bool handle_chunk(game_t* game, const addr_t from, const char* message, slice_t argument);
+static bool handle_layers(game_t* game, const addr_t from, const char* message, slice_t argument);
+static bool handle_stats(game_t* game, const addr_t from, const char* message, slice_t argument);
+
+// The word of each request, and its handler
+static const struct {
+    const char* word;
+    size_t length;
+    request_handler_t handler;
+} Requests[] = {
+    [Request_Play]     = { "PLAY", 4, handle_play },
+    [Request_Spectate] = { "SPECTATE", 8, handle_spectate },
+    [Request_Key]      = { "KEY", 3, handle_key },
+    [Request_Keys]     = { "KEYS", 4, handle_keys },
+    [Request_MoveTo]   = { "MOVETO", 6, handle_moveto },
+    [Request_Bundle]   = { "BUNDLE", 6, handle_bundle },
+    [Request_View]     = { "VIEW", 4, handle_view },
+    [Request_Chunk]    = { "CHUNK", 5, handle_chunk },
+    [Request_Layers]   = { "LAYERS", 6, handle_layers },
+    [Request_Stats]    = { "STATS", 5, handle_stats },
+};
+
+
+/**************** engine_startGame ****************/
+game_t*
+engine_startGame(const char* mapFilename, const unsigned int seed)
+{
+    FILE* map_file = fopen(mapFilename, "r");
+    if (map_file == NULL){
+        return NULL;
+    }
+
+    game_t* game = new_game(map_file, MaxPlayers, seed);
+    load_gold(game, GoldTotal, GoldMinNumPiles, GoldMaxNumPiles);
+    fclose(map_file);
+
+    game->number = events_newGame();
+    events_log(Event_GameStart, game->number, -1, game->rows, game->columns, 0, game->goldRemaining);
+    events_flush(); // the game may go on to be played on another thread, whose events must come after this one
+    return game;
+}
+
+/**************** engine_finishGame ****************/
+void
+engine_finishGame(game_t* game)
+{
+    events_log(Event_GameOver, game->number, -1, -1, -1, 0, game->playersJoined);
+    events_flush();
+
+    // the report goes out in one piece, so that games ending at once on other threads do not interleave theirs
+    if (metricsReport != NULL){
+        char report[StatsBytes];
+        int length = snprintf(report, sizeof(report), "metrics of game %d:\n", game->number);
+        format_metrics(game, report + length, sizeof(report) - length);
+        fputs(report, metricsReport);
+        fflush(metricsReport);
+    }
+    delete_goldField(game);
+    delete_moveField(game);
+    end_game(game, GoldMaxNumPiles);
+}
+
+/**************** engine_reportMetrics ****************/
+void
+engine_reportMetrics(FILE* fp)
+{
+    metricsReport = fp;
+}
+
+/**************** engine_allowStats ****************/
+void
+engine_allowStats(const addr_t operator)
+{
+    statsOperator = operator.sin_addr;
+}
+
+/**************** engine_mayAskStats ****************/
+bool
+engine_mayAskStats(const addr_t from)
+{
+    // all of 127.0.0.0/8 is this host
+    return from.sin_family == AF_INET
+        && ((ntohl(from.sin_addr.s_addr) >> 24) == 127 || from.sin_addr.s_addr == statsOperator.s_addr);
+}
+
+/**************** engine_guardAllocations ****************/
+void
+engine_guardAllocations(const engine_guard_t guard)
+{
+    allocationGuard = guard;
+    allocatingKeys = 0;
+}
+
+/**************** engine_allocatingKeys ****************/
+long
+engine_allocatingKeys(void)
+{
+    return allocatingKeys;
+}
+
+/**************** engine_addBots ****************/
+int
+engine_addBots(game_t* game, const int nbots)
+{
+    int added = 0;
+    char name[16];
+    mem_mark_t mark = mem_arena_mark(game->scratch);
+    sendMetrics = &game->metrics;
+
+    while (added < nbots && game->playersJoined < MaxPlayers && has_openSpot(game)){
+        // bots have no address: what the game sends them goes nowhere (see send_message)
+        addr_t address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_UNSPEC;
+        address.sin_port = game->playersJoined + 1;
+
+        snprintf(name, sizeof(name), "bot%d", game->playersJoined + 1);
+        client_t* bot = new_player(game, address, name);
+        bot->isBot = true;
+        update_displays(game, bot->r, bot->c, -1, -1);
+        added++;
+    }
+
+    if (added > 0 && game->goldField == NULL){
+        build_goldField(game);
+    }
+    sendMetrics = NULL;
+    mem_arena_reset(game->scratch, mark);
+    return added;
+}
+
+/**************** engine_tickBots ****************/
+bool
+engine_tickBots(void* arg)
+{
+    game_t* game = arg;
+    mem_mark_t mark = mem_arena_mark(game->scratch);
+    bool gameOver = false;
+    sendMetrics = &game->metrics;
+
+    // like a batch of keys, each client is sent one DISPLAY at most, after every bot has moved
+    displaysDeferred = true;
+    for (int i = 1; i < game->playersJoined + 1 && !gameOver; i++){
+        client_t* bot = game->clients[i];
+        gameOver = bot != NULL && bot->isBot && !bot->quit && bot_step(game, bot) == 2;
+    }
+    displaysDeferred = false;
+
+    // once the game is over, every client has been sent QUIT
+    if (!gameOver){
+        send_pendingDisplays(game);
+    }
+    sendMetrics = NULL;
+    mem_arena_reset(game->scratch, mark);
+    return gameOver;
+}
+
+/**
+ * @brief Formats the score of every player who joined, one line each: letter, gold, name.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param scores - where to write the scores
+ * @param size - the size of `scores`
+ */
+void
+format_scores(game_t* game, char* scores, size_t size)
+{
+    size_t length = 0;
+    scores[0] = '\0';
+    for (int i = 1; i < game->playersJoined + 1 && length < size; i++){
+        client_t* player = game->clients[i];
+        if (player != NULL){
+            length += snprintf(scores + length, size - length, "%c %d %s\n", player->id, player->gold, player->real_name);
+        }
+    }
+}
+
+/**
+ * @brief Handles one message sent by a client: parses its request in place, then calls the request's handler.
+ * A message whose request is unknown (or empty) is logged as malformed and otherwise ignored.
+ * The buffers the handler allocates from the game's scratch arena are all freed when it returns.
+ * Each request is counted, and its handler timed, in the game's metrics.
+ * 
+ * @param arg - the game_t struct holding game information
+ * @param from - the address of the client who sent the message
+ * @param message - the message string sent from the client
+ * @return true when the message ends the game (all gold is found)
+ * @return false otherwise
+ */
+bool
+handleMessage(void* arg, const addr_t from, const char* message)
+{
+    game_t* game = arg;
+    slice_t argument;
+    request_t request = parse_request(message, &argument);
+
+    if (request == Request_Unknown){
+        log_malformed(game, message);
+        return false;
+    }
+
+    // the hot path of a game under way, which must not allocate
+    const bool guarded = allocationGuard != Guard_Off && (request == Request_Key || request == Request_Keys);
+    const int allocs = guarded ? mem_allocs() : 0;
+
+    // whatever the handler renders lives only until it returns
+    mem_mark_t mark = mem_arena_mark(game->scratch);
+    const uint64_t start = metrics_nanos();
+    sendMetrics = &game->metrics;
+    bool gameOver = Requests[request].handler(game, from, message, argument);
+    sendMetrics = NULL;
+    game->metrics.requests[request]++;
+    hist_record(game->metrics.handlerNanos, metrics_nanos() - start);
+    mem_arena_reset(game->scratch, mark);
+
+    if (guarded && mem_allocs() != allocs){
+        note_allocation(message, mem_allocs() - allocs);
+    }
+    return gameOver;
+}
+
+/**
+ * @brief Splits a message, in place, into its request (the first word) and the argument that follows the first space.
+ * 
+ * @param message - the message string sent from the client
+ * @param argument - set to the rest of the message after the request and one space; empty if there is none.
+ * The argument runs to the end of the message, so it is null-terminated.
+ * @return request_t - the request, or Request_Unknown if the first word is none of them
+ */
+static request_t
+parse_request(const char* message, slice_t* argument)
+{
+    size_t length = strlen(message);
+    const char* space = memchr(message, ' ', length);
+    size_t wordLength = space == NULL ? length : (size_t)(space - message);
+
+    argument->start = space == NULL ? message + length : space + 1;
+    argument->length = length - (argument->start - message);
+
+    for (request_t request = 0; request < Request_Unknown; request++){
+        if (Requests[request].length == wordLength && memcmp(Requests[request].word, message, wordLength) == 0){
+            return request;
+        }
+    }
+    return Request_Unknown;
+}
+
+/**
+ * @brief Counts a KEY or KEYS message that allocated, under the allocation guard; with Guard_Abort, reports it and aborts.
+ * 
+ * @param message - the message
+ * @param allocs - how many blocks it allocated
+ */
+static void
+note_allocation(const char* message, int allocs)
+{
+    allocatingKeys++;
+    if (allocationGuard == Guard_Abort){
+        fprintf(stderr, "'%s' allocated %d blocks on the heap, where it should allocate none\n", message, allocs);
+        abort();
+    }
+}
+
+/**
+ * @brief Logs that a message was malformed, in the event log, and counts it.
+ */
+static void
+log_malformed(game_t* game, const char* message)
+{
+    game->metrics.malformed++;
+    events_log(Event_Malformed, game->number, -1, -1, -1, strlen(message), 0);
+}
+
+/**
+ * @brief Handles `PLAY name`: a new player joins if the game has a seat and an empty spot of floor for it,
+ * and is sent `OK`, then its grid, gold, and display. Otherwise it is sent `QUIT`.
+ */
+static bool
+handle_play(game_t* game, const addr_t from, const char* message, slice_t argument)
+{
+    // a new player needs a seat, and an empty spot of floor to start on
+    if (game->playersJoined < MaxPlayers && has_openSpot(game)){
+
+        char name[MaxNameLength + 1];
+        if (!extract_playerName(message, from, name, sizeof(name))){
+            events_log(Event_BadName, game->number, -1, -1, -1, strlen(message), 0);
+            return false;
+        }
+
+        client_t* player = new_player(game, from, name);
+        events_log(Event_Play, game->number, player->clientsArr_Idx, player->r, player->c, strlen(message), 0);
+
+        char response[5];
+        sprintf(response, "OK %c", player->id);
+        send_message(from, response);
+
+        // send new client messages: grid, gold, display
+        inform_newClient(player, game);
+
+        update_displays(game, player->r, player->c, -1, -1);
+
+    }
+    else {
+        send_quitMsg(from, 2, false);
+    }
+    return false;
+}
+
+/**
+ * @brief Handles `SPECTATE`: the new spectator replaces any other, who is sent `QUIT`.
+ */
+static bool
+handle_spectate(game_t* game, const addr_t from, const char* message, slice_t argument)
+{
+    if (game->spectatorActive && game->clients[0] != NULL){
+        send_quitMsg(game->clients[0]->clientAddr, 0, true);
+        events_log(Event_Quit, game->number, 0, -1, -1, 0, 0);
+        delete_client((game->clients)[0], game);
+        game->spectatorActive = false;
+    }
+
+    client_t* spectator = new_spectator(game, from);
+    events_log(Event_Spectate, game->number, 0, -1, -1, strlen(message), 0);
+
+    // send new client messages: grid, gold, display
+    inform_newClient(spectator, game);
+    return false;
+}
+
+/**
+ * @brief Handles `KEY k`: moves the player, or quits the player or spectator on `Q`.
+ * This is the busiest request, and allocates nothing until a display is rendered.
+ */
+static bool
+handle_key(game_t* game, const addr_t from, const char* message, slice_t argument)
+{
+    if (argument.length != 1 || !isalpha(argument.start[0])){
+        log_malformed(game, message);
+        return false;
+    }
+
+    char key = argument.start[0];
+    client_t* player = find_client(from, game);
+
+    // ignore keys from strangers, from clients who quit, and spectator keys other than quitting
+    if (player == NULL || player->quit || (player->isSpectator && tolower(key) != 'q')){
+        return false;
+    }
+
+    // returns true when all gold is found
+    if (tolower(key) == 'q'){
+        handle_quit(player, game);
+    }
+    else if (apply_key(player, key, game) == 2){
+        return true; // causes message loop to end
+    }
+    return false;
+}
+
+/**
+ * @brief Handles `KEYS keys`: applies a player's keys in order, sending each client one display at most, after the last.
+ */
+static bool
+handle_keys(game_t* game, const addr_t from, const char* message, slice_t argument)
+{
+    bool wellFormed = argument.length > 0;
+    for (size_t i = 0; wellFormed && i < argument.length; i++){
+        wellFormed = isalpha(argument.start[i]);
+    }
+    if (!wellFormed){
+        log_malformed(game, message);
+        return false;
+    }
+
+    client_t* player = find_client(from, game);
+
+    // ignore keys from strangers, from clients who quit, and from spectators (who quit with KEY)
+    if (player == NULL || player->quit || player->isSpectator){
+        return false;
+    }
+
+    // the keys are applied in order, just as if each came in its own KEY, but every client is sent one DISPLAY at most, after the last
+    displaysDeferred = true;
+    for (size_t i = 0; i < argument.length; i++){
+        if (tolower(argument.start[i]) == 'q'){
+            handle_quit(player, game);
+            break;
+        }
+        if (apply_key(player, argument.start[i], game) == 2){
+            displaysDeferred = false;
+            return true; // the game is over; every client has been sent QUIT
+        }
+    }
+    displaysDeferred = false;
+    send_pendingDisplays(game);
+    return false;
+}
+
+/**
+ * @brief Handles `MOVETO row column`: moves a player along a shortest path toward a spot,
+ * sending each client one display at most, after the last step.
+ */
+static bool
+handle_moveto(game_t* game, const addr_t from, const char* message, slice_t argument)
+{
+    int r, c;
+    int consumed = 0;
+
+    // the whole argument, and nothing after it
+    if (sscanf(argument.start, "%d %d%n", &r, &c, &consumed) != 2 || consumed != (int)argument.length || r < 0 || r >= game->rows || c < 0 || c >= game->columns){
+        log_malformed(game, message);
+        return false;
+    }
+
+    client_t* player = find_client(from, game);
+
+    // ignore strangers, clients who quit, and spectators
+    if (player == NULL || player->quit || player->isSpectator){
+        return false;
+    }
+
+    // like a batch of keys, each client is sent one DISPLAY at most, after the last step
+    displaysDeferred = true;
+    int movementCode = move_toward(player, r, c, game);
+    displaysDeferred = false;
+    if (movementCode == 2){
+        return true; // the game is over; every client has been sent QUIT
+    }
+    send_pendingDisplays(game);
+    return false;
+}
+
+/**
+ * @brief Handles `BUNDLE PLAY name` and `BUNDLE SPECTATE`: joins as usual, gathering the replies to the client into one datagram.
+ */
+static bool
+handle_bundle(game_t* game, const addr_t from, const char* message, slice_t argument)
+{
+    // only a join may be bundled, and not inside another bundle;
+    // a PLAY without a name is still a PLAY, turned away by handle_play with the same QUIT as when unbundled
+    slice_t joinArgument;
+    request_t request = parse_request(argument.start, &joinArgument);
+    if (bundle.open || (request != Request_Play && strcmp(argument.start, "SPECTATE") != 0)){
+        log_malformed(game, message);
+        return false;
+    }
+
+    // join as usual, gathering the replies to the client into one datagram;
+    // the join is counted and timed as this BUNDLE, not again as itself
+    bundle_begin(from);
+    bool gameOver = Requests[request].handler(game, from, argument.start, joinArgument);
+    bundle_flush();
+    bundle.open = false;
+    return gameOver;
+}
+
+/**
+ * @brief Handles `VIEW rows columns`: sets the size of a player's window, then replies with `GRID` and a fresh display.
+ */
+static bool
+handle_view(game_t* game, const addr_t from, const char* message, slice_t argument)
+{
+    client_t* player = find_client(from, game);
+    int rows, columns;
+
+    // only players have windows; spectators, and clients drawing the map themselves, always see the whole map
+    if (player == NULL || player->quit || player->isSpectator || player->layered
+        || sscanf(argument.start, "%d %d", &rows, &columns) != 2 || rows < 1 || columns < 1){
+        log_malformed(game, message);
+        return false;
+    }
+
+    // confirm the window's size, then fill it
+    set_view(game, player, rows, columns);
+    send_gridMsg(game, player);
+    send_displayMsg(game, player);
+    return false;
+}
+
+/**
+ * @brief Handles `CHUNK bytes`: sets the largest datagram a client's displays are sent in, then replies with a fresh display.
+ */
+static bool
+handle_chunk(game_t* game, const addr_t from, const char* message, slice_t argument)
+{
+    client_t* client = find_client(from, game);
+    int bytes;
+
+    if (client == NULL || client->quit || sscanf(argument.start, "%d", &bytes) != 1 || bytes < 0){
+        log_malformed(game, message);
+        return false;
+    }
+
+    // 0 turns chunking back off; otherwise the limit must hold a chunk, and fit in one datagram
+    client->chunkBytes = bytes == 0 ? 0 : clamp(bytes, MinChunkBytes, message_MaxBytes);
+    send_displayMsg(game, client);
+    return false;
+}
+
+/**
+ * @brief Handles `LAYERS`: from now on the client is sent the static map once, then only frames of what changes on it.
+ */
+static bool
+handle_layers(game_t* game, const addr_t from, const char* message, slice_t argument)
+{
+    client_t* client = find_client(from, game);
+
+    if (client == NULL || client->quit){
+        log_malformed(game, message);
+        return false;
+    }
+
+    // from now on the client gets the whole static map once, then only frames of what changes on it
+    client->layered = true;
+    client->viewRows = 0;
+    client->viewColumns = 0;
+    send_gridMsg(game, client);
+    send_mapMsg(game, client);
+    send_displayMsg(game, client);
+    return false;
+}
+
+/**
+ * @brief Handles `STATS`: replies with the game's metrics (see format_metrics), to a client in the game,
+ * or to one that may ask from outside it (see engine_mayAskStats).
+ */
+static bool
+handle_stats(game_t* game, const addr_t from, const char* message, slice_t argument)
+{
+    client_t* client = find_client(from, game);
+    if ((client == NULL || client->quit) && !engine_mayAskStats(from)){
+        return false;
+    }
+    char* stats = mem_arena_alloc(game->scratch, StatsBytes, "Error allocating memory in handle_stats.\n");
+    int length = snprintf(stats, StatsBytes, "STATS game %d\n", game->number);
+    format_metrics(game, stats + length, StatsBytes - length);
+    send_message(from, stats);
+    return false;
+}
+
+/**
+ * @brief Formats the game's metrics as lines of text (see metrics_format), naming each request.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param text - where to write the text
+ * @param size - the size of `text`
+ * @return int - the length of the text
+ */
+static int
+format_metrics(game_t* game, char* text, size_t size)
+{
+    const char* names[Request_Unknown];
+    for (int i = 0; i < Request_Unknown; i++){
+        names[i] = Requests[i].word;
+    }
+    return metrics_format(&game->metrics, names, Request_Unknown, text, size);
+}
+
+/**
+ * @brief Sends a message to all players and the spectator to update their local displays by calling `send_displayMsg`.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param takes in two positions to check if they changed for the player, second point is optional and will be ignored if -1 is passed for r2 and c2
+ */
+void
+update_displays(game_t* game, int r1, int c1, int r2, int c2)
+{
+    const uint64_t start = metrics_nanos();
+
+    // update spectator if there is one no matter what
+    if (game->spectatorActive){
+        refresh_display(game, game->clients[0]);
+    }
+
+    // used to check whether or not the points that changed are visible for the player
+    bool point1_vis = false;
+    bool point2_vis = false; // this second point is options
+
+    for (int i = 1; i < game->playersJoined + 1; i++){
+        client_t* player = game->clients[i];
+
+        // bots play from the gold field, so they need no view of the map
+        if (player != NULL && !player->quit && !player->isBot){
+            point1_vis = !isspace(player->grid[r1][c1]); // checks if the player can see that point
+            if (r2 != -1){ //point2_vis is set to true if -1 is passed otherwise we check if it is visible
+                point2_vis = !isspace(player->grid[r2][c2]);
+            }
+            else {
+                point2_vis = true;
+            }
+            // only update visibility if points changed are currently in sight
+            if (point1_vis && point2_vis){
+                game->metrics.viewsComputed++;
+                if (get_player_visible(game, player)){
+                    refresh_display(game, player); // only send a new message if their display changes
+                }
+                else {
+                    game->metrics.displaysSkipped++;
+                }
+            }
+
+        }
+    }
+    hist_record(game->metrics.updateNanos, metrics_nanos() - start);
+}
+
+/**
+ * @brief - Sends new clients a gold message by calling `send_goldMsg` and a display message by calling `send_displayMsg`.
+ * 
+ * @param client - the client_t struct holding information about the new client
+ * @param game -the game_t struct holding game information
+ */
+void
+inform_newClient(client_t* client, game_t* game)
+{
+    // a player on a map too big for one DISPLAY sees a window of it, until it asks for another size
+    if (!client->isSpectator && client->viewRows == 0
+        && DisplayHeaderLength + game->rows * (game->columns + 1) - 1 > message_MaxBytes){
+        set_view(game, client, DefaultViewRows, DefaultViewColumns);
+    }
+
+    // send grid message
+    send_gridMsg(game, client);
+
+    // send gold message
+    send_goldMsg(game, client, 0);
+
+    // send display message
+    send_displayMsg(game, client);
+
+}
+
+/**
+ * @brief Informs players of the amount of gold they pick up, the amount in their purses, and both players and spectators of the amount left in the game.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param client - the client_t struct holding information about the new client
+ * @param goldPickedUp - the amount of gold the client just picked up
+ */
+void
+send_goldMsg(game_t* game, client_t* client, int goldPickedUp)
+{
+    // send gold message
+    char goldMsg[40]; // room for three numbers of any size
+    snprintf(goldMsg, sizeof(goldMsg), "GOLD %d %d %d", goldPickedUp, client->gold, game->goldRemaining); //initial gold message always 0 just picked up
+    send_message(client->clientAddr, goldMsg);
+
+}
+
+/**
+ * @brief Moves a player one step for a lowercase key, or for an uppercase key as far as it can go in that direction.
+ * 
+ * @param player - the client_t struct of the player
+ * @param key - the key entered by the client
+ * @param game - the game_t struct holding game information
+ * @return int - the code of the last step (see handle_movement): 0 moved, 1 could not move, 2 game over
+ */
+static int
+apply_key(client_t* player, char key, game_t* game)
+{
+    int movementCode = handle_movement(player, key, game);
+
+    // if we were able to move and the the key was uppercase, keep moving while possible
+    if (movementCode == 0 && isupper(key)){
+        while (movementCode == 0){
+            movementCode = handle_movement(player, key, game);
+        }
+    }
+    return movementCode;
+}
+
+/**
+ * @brief Moves a player along a shortest path toward a spot, one step at a time as its keys would,
+ * for at most MoveToMaxSteps steps; it stops early on reaching the spot, picking up gold, or swapping places with another player.
+ * The distances to the spot are kept with the game (see search_moveField), so that moving toward the same spot again,
+ * by any player, costs no search, or only the part of it not yet done.
+ * 
+ * @param player - the client_t struct of the player
+ * @param r - the row of the spot
+ * @param c - the column of the spot
+ * @param game - the game_t struct holding game information
+ * @return int - the code of the last step (see handle_movement): 0 moved or no need to, 1 could not move, 2 game over
+ */
+static int
+move_toward(client_t* player, int r, int c, game_t* game)
+{
+    const int* distances = search_moveField(game, r * game->columns + c, player->r * game->columns + player->c);
+
+    int movementCode = 0;
+    for (int step = 0; step < MoveToMaxSteps; step++){
+        const int here = distances[player->r * game->columns + player->c];
+        if (here <= 0){
+            break; // at the spot, or it cannot be reached from here
+        }
+
+        // the first direction that leads one step closer
+        int s;
+        int nr = 0;
+        int nc = 0;
+        for (s = 0; s < (int)(sizeof(Steps) / sizeof(Steps[0])); s++){
+            nr = player->r + Steps[s].dr;
+            nc = player->c + Steps[s].dc;
+            if (nr >= 0 && nr < game->rows && nc >= 0 && nc < game->columns && distances[nr * game->columns + nc] == here - 1){
+                break;
+            }
+        }
+        if (s == (int)(sizeof(Steps) / sizeof(Steps[0]))){
+            break; // no way closer; cannot happen, as every spot nearer the target than the player has its distance
+        }
+
+        const bool collision = isalpha(get_grid_value(game, nr, nc));
+        const int gold = player->gold;
+        movementCode = handle_movement(player, Steps[s].key, game);
+        if (movementCode != 0 || collision || player->gold != gold){
+            break;
+        }
+    }
+    return movementCode;
+}
+
+/**
+ * @brief Finds the distances to a target spot, searching out from it (see grid_distancesUntil) only until
+ * it reaches the spot a player moves from: every spot nearer the target has its distance then, which is all
+ * the walk toward it needs. Walls never move, so the distances stay right for as long as the target does;
+ * a search toward another target first clears only the spots the last one reached.
+ *
+ * @param game - the game_t struct holding game information
+ * @param target - the spot of the target, row * columns + column
+ * @param from - the spot of the player, likewise
+ * @return const int* - the distances of the spots to the target, -1 for those not searched or that cannot reach it
+ */
+static const int*
+search_moveField(game_t* game, int target, int from)
+{
+    move_field_t* field = game->moveField;
+    if (field == NULL){
+        const int spots = game->rows * game->columns;
+        field = mem_malloc_assert(sizeof(move_field_t), "Error allocating memory in search_moveField.\n");
+        field->distances = mem_malloc_assert(spots * sizeof(int), "Error allocating memory in search_moveField.\n");
+        field->queue = mem_malloc_assert(spots * sizeof(int), "Error allocating memory in search_moveField.\n");
+        for (int i = 0; i < spots; i++){
+            field->distances[i] = -1;
+        }
+        field->target = -1;
+        field->tail = 0;
+        game->moveField = field;
+    }
+
+    if (field->target != target){
+        for (int i = 0; i < field->tail; i++){
+            field->distances[field->queue[i]] = -1;
+        }
+        field->head = 0;
+        field->tail = 0;
+        if (grid_isPassable(game->grid[target / game->columns][target % game->columns])){
+            field->distances[target] = 0;
+            field->queue[field->tail++] = target;
+        }
+        field->target = target;
+    }
+    grid_distancesUntil(game->grid, game->rows, game->columns, field->distances, field->queue, &field->head, &field->tail, from);
+    return field->distances;
+}
+
+/**
+ * @brief Frees the distances to the last MOVETO target, if there are any.
+ *
+ * @param game - the game_t struct holding game information
+ */
+static void
+delete_moveField(game_t* game)
+{
+    move_field_t* field = game->moveField;
+    if (field != NULL){
+        mem_free(field->distances);
+        mem_free(field->queue);
+        mem_free(field);
+        game->moveField = NULL;
+    }
+}
+
+/**
+ * @brief Sends a client a DISPLAY of its changed view, or during a batch of keys marks it to be sent at the end.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param client - the client_t struct of the client
+ */
+static void
+refresh_display(game_t* game, client_t* client)
+{
+    if (displaysDeferred){
+        client->displayPending = true;
+    }
+    else {
+        send_displayMsg(game, client);
+    }
+}
+
+/**
+ * @brief Sends every client still in the game whose display changed during a batch of keys its DISPLAY.
+ * 
+ * @param game - the game_t struct holding game information
+ */
+static void
+send_pendingDisplays(game_t* game)
+{
+    for (int i = 0; i < game->playersJoined + 1; i++){
+        client_t* client = game->clients[i];
+        if (client != NULL && client->displayPending){
+            client->displayPending = false;
+            if (!client->quit){
+                send_displayMsg(game, client);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Sends message to update a client's local display.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param client - the client_t struct holding information about the new client
+ */
+void
+send_displayMsg(game_t* game, client_t* client)
+{
+    int top = 0;
+    int left = 0;
+    int rows = game->rows;
+    int columns = game->columns;
+
+    // a client drawing the map itself needs only the spots it has seen, and the players and gold it sees
+    if (client->layered){
+        send_frameMsg(game, client);
+        return;
+    }
+
+    // a player with a window sees the part of the map centered on them, as far as the edges allow
+    if (!client->isSpectator && client->viewRows > 0){
+        rows = client->viewRows;
+        columns = client->viewColumns;
+        top = clamp(client->r - rows / 2, 0, game->rows - rows);
+        left = clamp(client->c - columns / 2, 0, game->columns - columns);
+    }
+
+    // the frame is drawn straight after the header, so a DISPLAY needs no copy of it; and it is freed once sent,
+    // so that one message updating many clients needs room for only one frame at a time
+    mem_mark_t mark = mem_arena_mark(game->scratch);
+    const int mapLength = rows * (columns + 1) - 1;
+    char* display = mem_arena_alloc(game->scratch, DisplayHeaderLength + mapLength + 1, "Error allocating memory in sendDisplayMsg.\n");
+    char* map = display + DisplayHeaderLength;
+    memcpy(display, "DISPLAY\n", DisplayHeaderLength);
+
+    // the spectator sees the whole map; a player, what it has seen (assumes that its grid is already up to date)
+    grid_writeWindow(game->grid, client->isSpectator ? NULL : client->grid, top, left, rows, columns, map);
+
+    // a frame too big for one datagram (the spectator's, on a big map), or for the client's chunks, goes in chunks of rows
+    const int maxBytes = client->chunkBytes > 0 ? client->chunkBytes : message_MaxBytes;
+    if (DisplayHeaderLength + mapLength > maxBytes){
+        send_rowChunks(game, client, "DISPLAYROWS", map, rows, columns, maxBytes);
+    }
+    else {
+        send_message(client->clientAddr, display);
+    }
+    mem_arena_reset(game->scratch, mark);
+}
+
+/**
+ * @brief Extracts each player's name when they first join the game, storing the string up to a maximum of 50 characters.
+ * 
+ * @param message - the message string received from a client
+ * @param clientAddr - the client's address
+ * @param name - where to write the name, null-terminated
+ * @param size - the size of name; the name is truncated to MaxNameLength characters, and to fit
+ * @return true if the name was extracted; false (after sending QUIT) if it is empty
+ */
+bool
+extract_playerName(const char* message, addr_t clientAddr, char* name, size_t size)
+{
+    size_t maxLength = size - 1 < (size_t)MaxNameLength ? size - 1 : (size_t)MaxNameLength;
+    size_t curr_nameLength = 0;
+    bool emptyName = true;
+
+    // the name starts after the first whitespace
+    const char* next = message;
+    while (*next != '\0' && !isspace(*next)){
+        next++;
+    }
+    if (*next != '\0'){
+        next++;
+    }
+
+    for (; *next != '\0' && curr_nameLength < maxLength; next++){
+        if (!isspace(*next)){
+            emptyName = false;
+        }
+        if(!isgraph(*next) && !isblank(*next)){
+            name[curr_nameLength] = '_';
+        }
+        else{
+            name[curr_nameLength] = *next;
+        }
+        curr_nameLength++;
+    }
+    name[curr_nameLength] = '\0';
+    
+    if(emptyName){
+        send_quitMsg(clientAddr, 3, false);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Sends quitting message and removes a client from the game, updating the displays of remaining clients to reflect changes.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param player - the client_t struct holding information about the new client
+ */
+void 
+handle_quit(client_t* player, game_t* game)
+{
+    send_quitMsg(player->clientAddr, 1, player->isSpectator);
+    events_log(Event_Quit, game->number, player->clientsArr_Idx, player->isSpectator ? -1 : player->r,
+               player->isSpectator ? -1 : player->c, 0, player->gold);
+    
+    if (!player->isSpectator){
+        // reset spot
+        if (player->onTunnel){
+            change_spot(game, player->r, player->c, '#');
+        }
+        else{
+            change_spot(game, player->r, player->c, '.');
+        }
+    }
+
+    player->quit = true;
+
+    update_displays(game, player->r, player->c, -1, -1);
+}
+
+/**
+ * @brief Handles the action a player whenever they press `Q` for quitting or a key for moving within the grid. 
+ * When moving, the function updates a player's position, visibility, and handles the cases when a player steps on gold or another player.
+ * 
+ * @param player- the client_t struct holding information about the new client
+ * @param key - the key entered by the client
+ * @param game - the game_t struct holding game information
+ * @return int - a code representing the result of the move: 0 means success, 1 means unable to move, 2 means game over
+ */
+int
+handle_movement(client_t* player, char key, game_t* game)
+{
+
+    int newPos_r = player->r;
+    int newPos_c = player->c;
+
+    switch (tolower(key)) {
+        // update new Pos based on the key inputted
+        case 'h': newPos_c--; break;
+        case 'l': newPos_c++; break;
+        case 'j': newPos_r++; break;
+        case 'k': newPos_r--; break;
+        case 'y': newPos_c--; newPos_r--; break;
+        case 'u': newPos_c++; newPos_r--; break;
+        case 'b': newPos_c--; newPos_r++; break;
+        case 'n': newPos_c++; newPos_r++; break;
+        default: return 1;
+    }
+
+    // a tunnel may run off the edge of the map
+    if (newPos_r < 0 || newPos_r >= game->rows || newPos_c < 0 || newPos_c >= game->columns){
+        return 1; // code meaning unable to move
+    }
+
+    char grid_val = get_grid_value(game, newPos_r, newPos_c);
+
+    if (grid_val == '+' || grid_val == '-' || grid_val == '|' || grid_val == ' '){
+        return 1; // code meaning unable to move
+    }
+    else if (grid_val == '.' || grid_val == '#'){
+        // change the spot the player came from back
+        update_previous_spot(player, game, grid_val);
+        
+        // change the global grid on the spot they are now on to be their letter
+        change_spot(game, newPos_r, newPos_c, player->id);
+
+        int pr = player->r;
+        int pc = player->c;
+
+        // update the player's position in the player struct
+        update_position(player, newPos_r, newPos_c);
+
+        // call update function
+        update_displays(game, pr, pc, newPos_r, newPos_c);
+        
+    }
+    else if (isalpha(grid_val)){
+        // find the player there using a game function
+        client_t* other_player = find_player(grid_val, game);
+
+        // switch the positions of the two players
+        update_position(other_player, player->r, player->c);
+        update_position(player, newPos_r, newPos_c);
+
+        // update the player's records on the spot they stand on 
+        bool player_OnTunnel = player->onTunnel;
+        player->onTunnel = other_player->onTunnel;
+        other_player->onTunnel = player_OnTunnel;
+
+        // update the global grid to reflect change
+        change_spot(game, player->r, player->c, player->id);
+        change_spot(game, other_player->r, other_player->c, other_player->id);
+
+        // call update function
+        update_displays(game, other_player->r, other_player->c, player->r, player->c);
+
+
+    }
+    else if (grid_val == '*'){
+        int nuggetsFound = update_gold(game, player, newPos_r, newPos_c, GoldMaxNumPiles);
+
+        if (nuggetsFound < 0){
+            // attempted to access a spot that wasn't a gold location
+            events_log(Event_BadGold, game->number, player->clientsArr_Idx, newPos_r, newPos_c, 0, 0);
+            return 0;
+        }
+        events_log(Event_Gold, game->number, player->clientsArr_Idx, newPos_r, newPos_c, 0, nuggetsFound);
+        
+        // the bots now head for the other piles
+        if (game->goldField != NULL){
+            take_goldSource(game, newPos_r * game->columns + newPos_c);
+        }
+
+        // update the client that just picked up gold
+        send_goldMsg(game, player, nuggetsFound);
+
+        // update the other clients about the gold counts
+        for (int i = 0; i < game->playersJoined + 1; i++){
+            if (game->clients[i] != NULL && ((game->clients)[i])->id != player->id && !((game->clients[i])->quit)){
+                send_goldMsg(game, (game->clients)[i], 0);
+            }
+        }
+                
+        // change the spot the player came from back
+        update_previous_spot(player, game, grid_val);
+        
+        // change the global grid on the spot they are now on to be their letter
+        change_spot(game, newPos_r, newPos_c, player->id);
+
+        int pr = player->r;
+        int pc = player->c;
+
+        // update the player's position in the player struct
+        update_position(player, newPos_r, newPos_c);
+
+        // call update function
+        update_displays(game, pr, pc, newPos_r, newPos_c);
+
+
+        if (game->goldRemaining == 0){
+            events_log(Event_Move, game->number, player->clientsArr_Idx, player->r, player->c, 0, key);
+            send_gameOverMsg(game, MaxNameLength);
+            return 2; // code meaning game over
+        }
+
+    }
+    
+    events_log(Event_Move, game->number, player->clientsArr_Idx, player->r, player->c, 0, key);
+    return 0; // code meaning sucessful move 
+}
+
+/**
+ * @brief Sends quit messages to all the clients when the game is over.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param maxPlayers - the maximum players that can join
+ */
+void quit_all(game_t* game, int maxPlayers)
+{
+    for (int i = 0; i < maxPlayers + 1; i++){
+        client_t* client = game->clients[i];
+        if (client != NULL && !client->quit){
+            send_quitMsg(client->clientAddr, 1, client->isSpectator);
+        }
+    }
+
+}
+
+
+/**
+ * @brief Updates the previous spot occupies by a player when they move to the next spot.
+ * 
+ * @param player- the client_t struct holding information about the new client
+ * @param game - the game_t struct holding game information
+ * @param grid_val - the char representing the current spot the player is on
+ */
+static void
+update_previous_spot(client_t* player, game_t* game, char grid_val)
+{
+    //change the global grid on the spot they came from back to what it was
+    if (player->onTunnel){
+        change_spot(game, player->r, player->c, '#');
+    }
+    else{
+        change_spot(game, player->r, player->c, '.');
+    }
+    player->onTunnel = (grid_val == '#');
+}
+
+/**
+ * @brief Sends message to client about to quit the game, according to their role (player or spectator) and the reason for quitting.
+ * 
+ * @param clientAddr - the address the reach the client
+ * @param quitCode - a code representing why the client quit: 0 means spectator was replaced, 1 mean player quit, 2 means full game, 3 means invalid player name
+ * @param isSpectator - boolean, is the client a spectator
+ */
+void
+send_quitMsg(addr_t clientAddr, int quitCode, bool isSpectator)
+{
+    char quitMsg[55];
+    char quitReason[45];
+
+    if (isSpectator){
+        if (quitCode == 0){
+            strcpy(quitReason, "You have been replaced by a new spectator.");
+        }
+        else{
+            strcpy(quitReason, "Thanks for watching!");
+        }
+    }
+    else {
+        if (quitCode == 1){
+            strcpy(quitReason, "Thanks for playing!");
+        }
+        if (quitCode == 2){
+            strcpy(quitReason, "Game is full: no more players can join.");
+        }
+        if (quitCode == 3){
+            strcpy(quitReason, "Sorry - you must provide player's name.");
+        }
+
+    }
+
+    sprintf(quitMsg, "QUIT %s", quitReason);
+    send_message(clientAddr, quitMsg);
+
+}
+
+/**
+ * @brief Sends a message to all clients reflecting the leaderboard when the game ends.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param maxNameLength - the longest a name can be
+ */
+void
+send_gameOverMsg(game_t* game, int maxNameLength)
+{
+    char* message = mem_arena_alloc(game->scratch, 16+ ((maxNameLength + 14) * game->playersJoined), "Error allocating memory in send_gameOverMsg.\n");
+    int messageLength = sprintf(message, "QUIT GAME OVER:");
+
+    // one line per player, each appended where the last ended
+    for (int i = 1; i < game->playersJoined + 1; i++){
+        client_t* player = game->clients[i];
+        if (player != NULL){
+            messageLength += sprintf(message + messageLength, "\n%c       %3d %s", player->id, player->gold, player->real_name);
+        }
+    }    
+
+    for (int i = 0; i < game->playersJoined + 1; i++){
+        client_t* client = game->clients[i];
+        if (client != NULL && !client->quit){
+            send_message(client->clientAddr, message);
+        }
+    }
+
+}
+
+/**
+ * @brief Sets the size of a player's window on the map, no larger than the map, nor than fits in one DISPLAY.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param player - the client_t struct of the player
+ * @param rows - rows the player asked for
+ * @param columns - columns the player asked for
+ */
+static void
+set_view(game_t* game, client_t* player, int rows, int columns)
+{
+    rows = clamp(rows, 1, game->rows);
+    columns = clamp(columns, 1, game->columns);
+    if (DisplayHeaderLength + columns > message_MaxBytes){
+        columns = message_MaxBytes - DisplayHeaderLength;
+    }
+    while (DisplayHeaderLength + rows * (columns + 1) - 1 > message_MaxBytes){
+        rows--;
+    }
+    player->viewRows = rows;
+    player->viewColumns = columns;
+}
+
+/**
+ * @brief Sends a client a GRID message: the size of its window on the map, or of the whole map.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param client - the client_t struct of the client
+ */
+static void
+send_gridMsg(game_t* game, client_t* client)
+{
+    char gridMsg[32];  // room for two numbers of any size
+    if (client->viewRows > 0){
+        snprintf(gridMsg, sizeof(gridMsg), "GRID %d %d", client->viewRows, client->viewColumns);
+    }
+    else {
+        snprintf(gridMsg, sizeof(gridMsg), "GRID %d %d", game->rows, game->columns);
+    }
+    send_message(client->clientAddr, gridMsg);
+}
+
+/**
+ * @brief Sends one frame in chunks of whole rows, each of at most maxBytes (or one row, if a row is longer):
+ * "tag frame first count total" on the first line, then rows first to first+count-1 of the total.
+ * Each chunk stands alone, so a client can draw the rows it receives even if another chunk is lost.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param client - the client_t struct of the client
+ * @param tag - the first word of each chunk: DISPLAYROWS, or MAPROWS for the static map
+ * @param map - the frame, one line per row
+ * @param rows - how many rows the frame has
+ * @param columns - how many columns the frame has
+ * @param maxBytes - the largest datagram to send
+ */
+static void
+send_rowChunks(game_t* game, client_t* client, const char* tag, const char* map, int rows, int columns, int maxBytes)
+{
+    const unsigned int frame = client->frame++;
+    const int rowLength = columns + 1;
+
+    // the longest header any chunk of this frame can have
+    const int headerLength = snprintf(NULL, 0, "%s %u %d %d %d\n", tag, frame, rows, rows, rows);
+    int chunkRows = (maxBytes - headerLength) / rowLength;
+    if (chunkRows < 1){
+        chunkRows = 1;
+    }
+    if (headerLength + rowLength - 1 > message_MaxBytes){
+        events_log(Event_TooBig, game->number, client->clientsArr_Idx, -1, -1, headerLength + rowLength - 1, 0);
+        return;
+    }
+
+    char* chunk = mem_arena_alloc(game->scratch, headerLength + chunkRows * rowLength, "Error allocating memory in send_rowChunks.\n");
+    for (int first = 0; first < rows; first += chunkRows){
+        int count = rows - first < chunkRows ? rows - first : chunkRows;
+        int length = sprintf(chunk, "%s %u %d %d %d\n", tag, frame, first, count, rows);
+
+        // the rows, without the newline after the last
+        memcpy(chunk + length, map + first * rowLength, count * rowLength - 1);
+        chunk[length + count * rowLength - 1] = '\0';
+        send_message(client->clientAddr, chunk);
+    }
+}
+
+/**
+ * @brief Sends a client the static map, "MAP" and then the map without players or gold; in MAPROWS chunks if it is too big.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param client - the client_t struct of the client
+ */
+static void
+send_mapMsg(game_t* game, client_t* client)
+{
+    mem_mark_t mark = mem_arena_mark(game->scratch);
+    char* map = grid_toStaticStr(game);
+    const int maxBytes = client->chunkBytes > 0 ? client->chunkBytes : message_MaxBytes;
+
+    if (4 + (int)strlen(map) > maxBytes){
+        send_rowChunks(game, client, "MAPROWS", map, game->rows, game->columns, maxBytes);
+    }
+    else {
+        char* mapMsg = mem_arena_alloc(game->scratch, 5 + strlen(map), "Error allocating memory in send_mapMsg.\n");
+        sprintf(mapMsg, "MAP\n%s", map);
+        send_message(client->clientAddr, mapMsg);
+    }
+    mem_arena_reset(game->scratch, mark);
+}
+
+/**
+ * @brief Sends a client drawing the map itself a FRAME message (see grid_toFrame) in place of a DISPLAY.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param client - the client_t struct of the client
+ */
+static void
+send_frameMsg(game_t* game, client_t* client)
+{
+    mem_mark_t mark = mem_arena_mark(game->scratch);
+    char* frame = grid_toFrame(game->grid, client->isSpectator ? NULL : client->grid, game->rows, game->columns, client->frame++, game->scratch);
+
+    if ((int)strlen(frame) > message_MaxBytes){
+        events_log(Event_TooBig, game->number, client->clientsArr_Idx, -1, -1, strlen(frame), 0);
+    }
+    else {
+        send_message(client->clientAddr, frame);
+    }
+    mem_arena_reset(game->scratch, mark);
+}
+
+/**
+ * @brief Returns value, or the nearer of low and high if it lies outside them.
+ */
+static int
+clamp(int value, int low, int high)
+{
+    return value < low ? low : value > high ? high : value;
+}
+
+/**
+ * @brief Sends a message to a client; or, while the client is joining with BUNDLE, adds it to the bundle.
+ * A bundle is "BUNDLE", then each message as its length in bytes on a line of its own and the message itself.
+ * 
+ * @param to - the address of the client
+ * @param message - the message
+ */
+static void
+send_message(const addr_t to, const char* message)
+{
+    if (to.sin_family == AF_UNSPEC){
+        return; // a bot
+    }
+    if (sendMetrics != NULL){
+        metrics_countSent(sendMetrics, message);
+    }
+    if (!bundle.open || !message_eqAddr(to, bundle.to)){
+        message_send(to, message);
+        return;
+    }
+
+    // a message that would overflow the bundle goes in the next one, or alone if it fits in no bundle
+    int length = strlen(message);
+    int partLength = snprintf(NULL, 0, "%d\n", length) + length;
+    if (BundleHeaderLength + partLength > message_MaxBytes){
+        bundle_flush();
+        message_send(to, message);
+        return;
+    }
+    if (bundle.length + partLength > message_MaxBytes){
+        bundle_flush();
+    }
+    bundle.length += sprintf(bundle.buffer + bundle.length, "%d\n%s", length, message);
+}
+
+/**
+ * @brief Starts gathering the replies to a joining client into a bundle.
+ * 
+ * @param to - the address of the client
+ */
+static void
+bundle_begin(const addr_t to)
+{
+    bundle.open = true;
+    bundle.to = to;
+    bundle.length = sprintf(bundle.buffer, "BUNDLE\n");
+}
+
+/**
+ * @brief Sends the bundle, if anything was added to it, and empties it.
+ */
+static void
+bundle_flush(void)
+{
+    if (bundle.length > BundleHeaderLength){
+        if (sendMetrics != NULL){
+            metrics_countSent(sendMetrics, bundle.buffer);
+        }
+        message_send(bundle.to, bundle.buffer);
+    }
+    bundle.length = BundleHeaderLength;
+}
+
+/**
+ * @brief Moves a bot one step closer to the nearest gold pile left, if it can reach one.
+ * Every bot follows the same field, so a bot in the way is heading the same way: rather than swap places with it,
+ * which would set it back, a bot with no other way closer waits for it to move on. Other players it swaps with.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param bot - the client_t struct of the bot
+ * @return int - the code of the step (see handle_movement): 0 moved, 1 could not move, 2 game over
+ */
+static int
+bot_step(game_t* game, client_t* bot)
+{
+    const int* distances = game->goldField->distances;
+    const int here = distances[bot->r * game->columns + bot->c];
+    if (here <= 0){
+        return 1; // no gold it can reach
+    }
+
+    // the first direction that leads one step closer: to an empty spot if there is one, else past a player who is not a bot
+    char key = '\0';
+    for (int s = 0; s < (int)(sizeof(Steps) / sizeof(Steps[0])); s++){
+        int nr = bot->r + Steps[s].dr;
+        int nc = bot->c + Steps[s].dc;
+        if (nr >= 0 && nr < game->rows && nc >= 0 && nc < game->columns && distances[nr * game->columns + nc] == here - 1){
+            char spot = get_grid_value(game, nr, nc);
+            if (!isalpha(spot)){
+                return handle_movement(bot, Steps[s].key, game);
+            }
+            if (key == '\0' && !find_player(spot, game)->isBot){
+                key = Steps[s].key;
+            }
+        }
+    }
+    return key != '\0' ? handle_movement(bot, key, game) : 1;
+}
+
+/**
+ * @brief Finds the distance of every spot to the nearest gold pile left, for the bots to follow.
+ * 
+ * @param game - the game_t struct holding game information
+ */
+static void
+build_goldField(game_t* game)
+{
+    const int spots = game->rows * game->columns;
+    gold_field_t* field = mem_malloc_assert(sizeof(gold_field_t), "Error allocating memory in build_goldField.\n");
+    field->distances = mem_malloc_assert(spots * sizeof(int), "Error allocating memory in build_goldField.\n");
+    field->nearest = mem_malloc_assert(spots * sizeof(int), "Error allocating memory in build_goldField.\n");
+    field->queue = mem_malloc_assert(spots * sizeof(int), "Error allocating memory in build_goldField.\n");
+    field->seeds = mem_malloc_assert(spots * sizeof(long long), "Error allocating memory in build_goldField.\n");
+    field->isSeed = mem_calloc_assert(spots, sizeof(bool), "Error allocating memory in build_goldField.\n");
+
+    // the piles not yet taken still show on the map
+    int nsources = 0;
+    for (int i = 0; i < game->totalGoldPiles; i++){
+        gold_location_t* pile = game->locations[i];
+        if (get_grid_value(game, pile->r, pile->c) == '*'){
+            field->queue[nsources++] = pile->r * game->columns + pile->c;
+        }
+    }
+    grid_distances(game->grid, game->rows, game->columns, field->queue, nsources, field->distances, field->nearest, field->queue);
+    game->goldField = field;
+}
+
+/**
+ * @brief Updates the gold field when a pile is taken. Only the spots to which that pile was nearest change:
+ * they are searched again, from the spots around them, which keep their distances to the other piles.
+ * 
+ * @param game - the game_t struct holding game information
+ * @param spot - the spot of the pile taken, row * columns + column
+ */
+static void
+take_goldSource(game_t* game, int spot)
+{
+    gold_field_t* field = game->goldField;
+    const int spots = game->rows * game->columns;
+    const int columns = game->columns;
+    int* queue = field->queue;
+
+    if (field->nearest[spot] != spot){
+        return; // not a pile that any spot was measured from
+    }
+
+    // the pile's region: every spot it was nearest to, all linked to it through each other
+    int nregion = 0;
+    field->nearest[spot] = -1;
+    field->distances[spot] = -1;
+    queue[nregion++] = spot;
+    for (int i = 0; i < nregion; i++){
+        int r = queue[i] / columns;
+        int c = queue[i] % columns;
+        for (int s = 0; s < (int)(sizeof(Steps) / sizeof(Steps[0])); s++){
+            int nr = r + Steps[s].dr;
+            int nc = c + Steps[s].dc;
+            if (nr >= 0 && nr < game->rows && nc >= 0 && nc < columns && field->nearest[nr * columns + nc] == spot){
+                field->nearest[nr * columns + nc] = -1;
+                field->distances[nr * columns + nc] = -1;
+                queue[nregion++] = nr * columns + nc;
+            }
+        }
+    }
+
+    // the seeds: the spots bordering the region that are still measured from some pile, nearest first
+    int nseeds = 0;
+    for (int i = 0; i < nregion; i++){
+        int r = queue[i] / columns;
+        int c = queue[i] % columns;
+        for (int s = 0; s < (int)(sizeof(Steps) / sizeof(Steps[0])); s++){
+            int nr = r + Steps[s].dr;
+            int nc = c + Steps[s].dc;
+            int neighbour = nr * columns + nc;
+            if (nr >= 0 && nr < game->rows && nc >= 0 && nc < columns && field->distances[neighbour] >= 0 && !field->isSeed[neighbour]){
+                field->isSeed[neighbour] = true;
+                field->seeds[nseeds++] = (long long)field->distances[neighbour] * spots + neighbour;
+            }
+        }
+    }
+    for (int i = 0; i < nseeds; i++){
+        field->isSeed[field->seeds[i] % spots] = false;
+    }
+    sort_seeds(field->seeds, nseeds);
+
+    // search the region from the seeds: taking the nearer of the next seed and the head of the queue
+    // reaches each spot first along a shortest path, just as a search from every pile would
+    int head = 0;
+    int tail = 0;
+    int next = 0;
+    while (next < nseeds || head < tail){
+        int from;
+        if (head == tail || (next < nseeds && field->seeds[next] / spots <= field->distances[queue[head]])){
+            from = field->seeds[next++] % spots;
+        }
+        else {
+            from = queue[head++];
+        }
+
+        int r = from / columns;
+        int c = from % columns;
+        for (int s = 0; s < (int)(sizeof(Steps) / sizeof(Steps[0])); s++){
+            int nr = r + Steps[s].dr;
+            int nc = c + Steps[s].dc;
+            int neighbour = nr * columns + nc;
+            if (nr >= 0 && nr < game->rows && nc >= 0 && nc < columns && field->distances[neighbour] < 0
+                && grid_isPassable(get_grid_value(game, nr, nc))){
+                field->distances[neighbour] = field->distances[from] + 1;
+                field->nearest[neighbour] = field->nearest[from];
+                queue[tail++] = neighbour;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Frees the gold field, if the game has one.
+ * 
+ * @param game - the game_t struct holding game information
+ */
+static void
+delete_goldField(game_t* game)
+{
+    gold_field_t* field = game->goldField;
+    if (field != NULL){
+        mem_free(field->distances);
+        mem_free(field->nearest);
+        mem_free(field->queue);
+        mem_free(field->seeds);
+        mem_free(field->isSeed);
+        mem_free(field);
+        game->goldField = NULL;
+    }
+}
+
+/**
+ * @brief Sorts seeds of the gold field by distance (see take_goldSource), nearest first.
+ * A heap sort, in place: it allocates nothing, as qsort may.
+ *
+ * @param seeds - the seeds, each distance * spots + spot
+ * @param nseeds - how many there are
+ */
+static void
+sort_seeds(long long* seeds, int nseeds)
+{
+    // make a heap of the largest first, then move the largest left to the end, one by one
+    for (int i = nseeds / 2 - 1; i >= 0; i--){
+        sift_seed(seeds, i, nseeds);
+    }
+    for (int end = nseeds - 1; end > 0; end--){
+        long long largest = seeds[0];
+        seeds[0] = seeds[end];
+        seeds[end] = largest;
+        sift_seed(seeds, 0, end);
+    }
+}
+
+/**
+ * @brief Moves a seed down a heap of seeds until neither seed below it is larger.
+ *
+ * @param seeds - the heap
+ * @param i - the index of the seed
+ * @param n - the size of the heap
+ */
+static void
+sift_seed(long long* seeds, int i, int n)
+{
+    long long seed = seeds[i];
+    for (int child = 2 * i + 1; child < n; child = 2 * i + 1){
+        if (child + 1 < n && seeds[child + 1] > seeds[child]){
+            child++;
+        }
+        if (seeds[child] <= seed){
+            break;
+        }
+        seeds[i] = seeds[child];
+        i = child;
+    }
+    seeds[i] = seed;
+}
+
+/**
+ * @brief Is there an empty spot of room floor, where a new player could start?
+ * 
+ * @param game - the game_t struct holding game information
+ * @return true if so
+ */
+static bool
+has_openSpot(game_t* game)
+{
+    for (int r = 0; r < game->rows; r++){
+        if (memchr(game->grid[r], '.', game->columns) != NULL){
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* ****************************************************************** */
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * This unit test joins one player to a game with PLAY, and one to another
+ * game, on the same map and seed, with BUNDLE PLAY; nothing is sent, each
+ * message is only counted (see message_setSendHook). A bundled join must
+ * be counted once, as a BUNDLE, and send just what the plain join sends,
+ * in one more datagram: the BUNDLE.
+ *
+ *   ./enginetest map.txt
+ *
+ * Exits 0 if every check passes, 1 if any fails.
+ */
+
+#ifdef UNIT_TEST
+
+static int sends = 0;
+
+enum { ScriptPlayers = 3, ScriptRounds = 40, ScriptBatch = 8, DisplayBytes = 65536 };
+
+static void
+count_send(void* arg, const addr_t to, const char* message)
+{
+    sends++;
+}
+
+/* Counts the message, and keeps the last DISPLAY each client was sent: client i has port i + 1 */
+static void
+keep_display(void* arg, const addr_t to, const char* message)
+{
+    char (*displays)[DisplayBytes] = arg;
+    int i = ntohs(to.sin_port) - 1;
+    sends++;
+    if (strncmp(message, "DISPLAY\n", 8) == 0 && i >= 0 && i <= ScriptPlayers){
+        snprintf(displays[i], DisplayBytes, "%s", message);
+    }
+}
+
+static int
+check(bool ok, const char* what)
+{
+    if (!ok){
+        fprintf(stderr, "enginetest: FAILED: %s\n", what);
+    }
+    return ok ? 0 : 1;
+}
+
+/* A PLAY in a BUNDLE sends what a plain PLAY does, in one datagram */
+static int
+test_bundle(const char* mapFilename)
+{
+    addr_t client = {0};
+    client.sin_family = AF_INET;
+
+    char play[] = "PLAY alice";
+    sends = 0;
+    game_t* plain = engine_startGame(mapFilename, 1);
+    handleMessage(plain, client, play);
+    int plainSends = sends;
+
+    char bundled[] = "BUNDLE PLAY alice";
+    sends = 0;
+    game_t* game = engine_startGame(mapFilename, 1);
+    handleMessage(game, client, bundled);
+    int bundledSends = sends;
+
+    const metrics_t* p = &plain->metrics;
+    const metrics_t* b = &game->metrics;
+    int failed = 0;
+    failed += check(b->requests[Request_Bundle] == 1 && b->requests[Request_Play] == 0, "the join is counted once, as BUNDLE");
+    failed += check(hist_count(b->handlerNanos) == 1, "the join is timed once");
+    failed += check(b->sent[Sent_Bundle] == 1 && bundledSends == 1, "the replies go in one counted BUNDLE");
+    for (int i = 0; i < Sent_NumTypes; i++){
+        if (i != Sent_Bundle){
+            failed += check(b->sent[i] == p->sent[i] && b->sentBytes[i] == p->sentBytes[i], "the bundle holds what PLAY sends");
+        }
+    }
+    failed += check(plainSends > 1 && p->sent[Sent_Bundle] == 0, "a plain PLAY sends its replies one by one");
+
+    // a PLAY with no name is turned away with a QUIT, bundled or not
+    char nameless[] = "BUNDLE PLAY";
+    addr_t other = client;
+    other.sin_port = htons(2);
+    const int joined = game->playersJoined;
+    sends = 0;
+    handleMessage(game, other, nameless);
+    failed += check(b->malformed == 0 && game->playersJoined == joined, "a nameless BUNDLE PLAY is a PLAY, not malformed");
+    failed += check(sends == 1 && b->sent[Sent_Bundle] == 2 && b->sent[Sent_Quit] == 1, "a nameless BUNDLE PLAY is sent a bundled QUIT");
+
+    engine_finishGame(plain);
+    engine_finishGame(game);
+    return failed;
+}
+
+/* As bots take the piles one by one, the gold field they follow, updated in place (see take_goldSource),
+ * stays what a search from the piles left finds afresh */
+static int
+test_goldField(const char* mapFilename)
+{
+    game_t* game = engine_startGame(mapFilename, 1);
+    engine_addBots(game, 4);
+    const int spots = game->rows * game->columns;
+    int* distances = mem_malloc_assert(spots * sizeof(int), "Error allocating memory in test_goldField.\n");
+    int* queue = mem_malloc_assert(spots * sizeof(int), "Error allocating memory in test_goldField.\n");
+
+    int failed = 0;
+    int piles = game->totalGoldPiles;
+    int taken = 0;
+    bool gameOver = false;
+    for (int tick = 0; tick < 100000 && !gameOver && failed == 0; tick++){
+        gameOver = engine_tickBots(game);
+
+        int nsources = 0;
+        for (int i = 0; i < game->totalGoldPiles; i++){
+            gold_location_t* pile = game->locations[i];
+            if (get_grid_value(game, pile->r, pile->c) == '*'){
+                queue[nsources++] = pile->r * game->columns + pile->c;
+            }
+        }
+        if (nsources == piles){
+            continue;
+        }
+        taken += piles - nsources;
+        piles = nsources;
+        grid_distances(game->grid, game->rows, game->columns, queue, nsources, distances, NULL, queue);
+        failed += check(memcmp(distances, game->goldField->distances, spots * sizeof(int)) == 0,
+                        "the gold field matches a fresh search after a pile is taken");
+    }
+    failed += check(taken > 0, "the bots take gold");
+
+    mem_free(distances);
+    mem_free(queue);
+    engine_finishGame(game);
+    return failed;
+}
+
+/* Plays a script of keys on a seeded game, joined by ScriptPlayers players and then a spectator:
+ * in each round, each player sends its keys as ScriptBatch KEY messages, or as one KEYS.
+ * Returns the game, which the caller finishes, with each client's last DISPLAY in displays. */
+static game_t*
+play_script(const char* mapFilename, char script[ScriptRounds][ScriptPlayers][ScriptBatch + 1], bool batched,
+            char displays[ScriptPlayers + 1][DisplayBytes])
+{
+    addr_t clients[ScriptPlayers + 1];
+    memset(clients, 0, sizeof(clients));
+    message_setSendHook(keep_display, displays);
+
+    game_t* game = engine_startGame(mapFilename, 2);
+    char request[32];
+    for (int i = 0; i < ScriptPlayers + 1; i++){
+        clients[i].sin_family = AF_INET;
+        clients[i].sin_port = htons(i + 1);
+        displays[i][0] = '\0';
+        if (i < ScriptPlayers){
+            snprintf(request, sizeof(request), "PLAY player%d", i + 1);
+        }
+        else {
+            snprintf(request, sizeof(request), "SPECTATE");
+        }
+        handleMessage(game, clients[i], request);
+    }
+
+    bool gameOver = false;
+    for (int round = 0; round < ScriptRounds && !gameOver; round++){
+        for (int i = 0; i < ScriptPlayers && !gameOver; i++){
+            if (batched){
+                snprintf(request, sizeof(request), "KEYS %s", script[round][i]);
+                gameOver = handleMessage(game, clients[i], request);
+            }
+            for (int k = 0; k < ScriptBatch && !batched && !gameOver; k++){
+                snprintf(request, sizeof(request), "KEY %c", script[round][i][k]);
+                gameOver = handleMessage(game, clients[i], request);
+            }
+        }
+    }
+    message_setSendHook(count_send, NULL);
+    return game;
+}
+
+/* A seeded script of keys played as KEYS ends up as it does played as KEY after KEY:
+ * the same players in the same spots with the same gold, and each client's last DISPLAY the same */
+static int
+test_keyScript(const char* mapFilename)
+{
+    static char script[ScriptRounds][ScriptPlayers][ScriptBatch + 1];
+    static char keyDisplays[ScriptPlayers + 1][DisplayBytes];
+    static char keysDisplays[ScriptPlayers + 1][DisplayBytes];
+    const char* keys = "hjklyubnHJKLYUBN";
+    unsigned int seed = 7;
+    for (int round = 0; round < ScriptRounds; round++){
+        for (int i = 0; i < ScriptPlayers; i++){
+            for (int k = 0; k < ScriptBatch; k++){
+                script[round][i][k] = keys[rand_r(&seed) % strlen(keys)];
+            }
+            script[round][i][ScriptBatch] = '\0';
+        }
+    }
+
+    game_t* one = play_script(mapFilename, script, false, keyDisplays);
+    game_t* batch = play_script(mapFilename, script, true, keysDisplays);
+
+    int failed = 0;
+    int moved = 0;
+    for (int i = 1; i < ScriptPlayers + 1; i++){
+        client_t* a = one->clients[i];
+        client_t* b = batch->clients[i];
+        failed += check(a != NULL && b != NULL && a->r == b->r && a->c == b->c && a->gold == b->gold,
+                        "each player ends in the same spot with the same gold, by KEY and by KEYS");
+        moved += a != NULL && a->gold > 0;
+    }
+    failed += check(one->goldRemaining == batch->goldRemaining, "the same gold is left, by KEY and by KEYS");
+    failed += check(moved > 0, "the script finds gold");
+    for (int i = 0; i < ScriptPlayers + 1; i++){
+        failed += check(keyDisplays[i][0] != '\0' && strcmp(keyDisplays[i], keysDisplays[i]) == 0,
+                        "each client's last DISPLAY is the same, by KEY and by KEYS");
+    }
+
+    engine_finishGame(one);
+    engine_finishGame(batch);
+    return failed;
+}
+
+int
+main(const int argc, char* argv[])
+{
+    if (argc != 2){
+        fprintf(stderr, "usage: %s map.txt\n", argv[0]);
+        return 1;
+    }
+    message_setSendHook(count_send, NULL);
+
+    int failed = 0;
+    failed += test_bundle(argv[1]);
+    failed += test_goldField(argv[1]);
+    failed += test_keyScript(argv[1]);
+
+    message_setSendHook(NULL, NULL);
+    if (failed == 0){
+        printf("enginetest: all checks passed\n");
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+#endif // UNIT_TEST
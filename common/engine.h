@@ -0,0 +1,200 @@
+/*
+ * engine.h - header for the rules of the nuggets game, independent of any network
+ * The engine handles each message a client sends to a game and replies with message_send,
+ * so the same game logic runs behind a socket (the server) or entirely in memory,
+ * with message_setSendHook diverting every reply (replays and simulations).
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#ifndef __ENGINE_H_
+#define __ENGINE_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "../support/message.h"
+#include "structs.h"
+
+
+/**************** constants ****************/
+extern const int MaxPlayers;   // maximum number of players in one game
+
+/**************** types ****************/
+// What to do about heap allocations while a KEY or KEYS is handled (see engine_guardAllocations)
+typedef enum engine_guard {
+    Guard_Off,     // nothing: the default
+    Guard_Count,   // count the messages that allocated
+    Guard_Abort    // print the first such message, and abort
+} engine_guard_t;
+
+
+/**************** Functions ****************/
+
+/* engine_startGame
+ * Starts a game on the given map, with its gold placed.
+ * Inputs:
+ *     - mapFilename: pathname of the map file
+ *     - seed: seed of the game's random-number generator
+ * Outputs:
+ *     - Returns the new game, or NULL if the map could not be opened.
+ * Notes: the game must be freed with engine_finishGame.
+ */
+game_t* engine_startGame(const char* mapFilename, const unsigned int seed);
+
+/* engine_finishGame
+ * Frees a game started by engine_startGame, and all its clients.
+ */
+void engine_finishGame(game_t* game);
+
+/* engine_addBots
+ * Adds bots to a game: players that the server plays itself, each heading for the nearest gold pile left.
+ * Inputs:
+ *     - game: the game
+ *     - nbots: how many bots to add; no more are added once the game is full
+ * Outputs:
+ *     - Returns how many bots were added.
+ * Notes: bots move only when engine_tickBots is called; what the game sends them is dropped.
+ */
+int engine_addBots(game_t* game, const int nbots);
+
+/* engine_tickBots
+ * Moves every bot of a game one step.
+ * Inputs:
+ *     - arg: the game_t
+ * Outputs:
+ *     - Returns true when a bot's step ends the game (all gold is found), false otherwise.
+ * Notes: has the signature of a message_loop timeout handler.
+ */
+bool engine_tickBots(void* arg);
+
+/* engine_reportMetrics
+ * Writes the metrics of each game (see metrics.h) to fp when it ends, in engine_finishGame.
+ * Inputs:
+ *     - fp: a file open for writing, or NULL (the default) for no reports
+ * Notes: set it before the games start. A client can also ask a game for its metrics, with STATS (see engine_mayAskStats).
+ */
+void engine_reportMetrics(FILE* fp);
+
+/* engine_allowStats
+ * Lets an operator's host ask any game for its metrics with STATS, as the server's own host (loopback) may.
+ * Inputs:
+ *     - operator: the host's address; its port is ignored
+ * Notes: set it before the games start.
+ */
+void engine_allowStats(const addr_t operator);
+
+/* engine_mayAskStats
+ * Returns true if a client may ask a game it is not in for its metrics: it is on loopback, or on the operator's host.
+ * A STATS reply is many times the size of the request, so answering strangers would let forged requests
+ * aim floods of replies at anyone; clients in the game may always ask it.
+ */
+bool engine_mayAskStats(const addr_t from);
+
+/* engine_guardAllocations
+ * Watches for heap allocations (through libs/mem, see mem_allocs) while KEY and KEYS messages are handled.
+ * Moving, updating what each player sees, and rendering their displays allocate nothing once the game is under way:
+ * the guard keeps it that way.
+ * Inputs:
+ *     - guard: Guard_Off, Guard_Count, or Guard_Abort
+ * Notes: a debugging and benchmarking aid. The counts of libs/mem are shared by every thread,
+ *     so the guard is exact only while one thread is playing, as in a replay or a simulation on one thread.
+ */
+void engine_guardAllocations(const engine_guard_t guard);
+
+/* engine_allocatingKeys
+ * Returns how many KEY and KEYS messages have allocated since the guard was set to Guard_Count or Guard_Abort.
+ */
+long engine_allocatingKeys(void);
+
+/* handleMessage
+ * Handles one message (PLAY, SPECTATE, KEY, KEYS, MOVETO, VIEW, CHUNK, LAYERS, BUNDLE, or STATS) from a client, sending any replies with message_send.
+ * Inputs:
+ *     - arg: the game_t
+ *     - from: address of the client
+ *     - message: the message
+ * Outputs:
+ *     - Returns true when the message ends the game (all gold is found), false otherwise.
+ * Notes: has the signature of a message_loop handler.
+ *     The short-lived buffers of the replies (each DISPLAY, for one) come from the game's scratch arena,
+ *     which is reset when the message has been handled, so the steady state calls malloc for none of them.
+ */
+bool handleMessage(void* arg, const addr_t from, const char* message);
+
+/* format_scores
+ * Formats the score of every player who joined, one line each: letter, gold, name.
+ * Inputs:
+ *     - game: the game
+ *     - scores: where to write the scores
+ *     - size: the size of scores
+ */
+void format_scores(game_t* game, char* scores, size_t size);
+
+/* update_displays
+ * Sends a DISPLAY to the spectator, and to every player who can see either of the two changed spots.
+ * Inputs:
+ *     - game: the game
+ *     - r1, c1: the first spot that changed
+ *     - r2, c2: the second spot that changed, or -1, -1 if only one did
+ */
+void update_displays(game_t* game, int r1, int c1, int r2, int c2);
+
+/* inform_newClient
+ * Sends a new client its GRID, GOLD, and DISPLAY messages.
+ * A player on a map too big for one DISPLAY is first given a window of the default size.
+ */
+void inform_newClient(client_t* client, game_t* game);
+
+/* send_goldMsg
+ * Sends a client a GOLD message: what it just picked up, its purse, and the gold remaining.
+ */
+void send_goldMsg(game_t* game, client_t* client, int goldPickedUp);
+
+/* send_displayMsg
+ * Sends a client a DISPLAY message of the map as it sees it: for a player with a window,
+ * only the window, centered on the player as far as the map's edges allow.
+ * A frame too big for one datagram, or for the chunks the client asked for, is sent as DISPLAYROWS chunks instead.
+ */
+void send_displayMsg(game_t* game, client_t* client);
+
+/* extract_playerName
+ * Extracts the player's name from a PLAY message, truncated and with unprintable characters replaced.
+ * Inputs:
+ *     - message: the PLAY message
+ *     - clientAddr: the client, sent QUIT if the name is empty
+ *     - name: where to write the name (MaxNameLength characters at most, 50)
+ *     - size: the size of name
+ * Outputs:
+ *     - Returns true if the name was extracted, false (after sending QUIT) if it is empty.
+ */
+bool extract_playerName(const char* message, addr_t clientAddr, char* name, size_t size);
+
+/* handle_movement
+ * Moves a player one step in the direction of key, picking up gold and swapping places with other players.
+ * Outputs:
+ *     - Returns 0 if the player moved, 1 if it could not, 2 if the move ended the game.
+ */
+int handle_movement(client_t* player, char key, game_t* game);
+
+/* send_quitMsg
+ * Sends a QUIT message, for the given reason: 0 spectator replaced, 1 quit, 2 game full, 3 no name.
+ */
+void send_quitMsg(addr_t clientAddr, int quitCode, bool isSpectator);
+
+/* quit_all
+ * Sends a QUIT message to every client still in the game.
+ */
+void quit_all(game_t* game, int maxPlayers);
+
+/* handle_quit
+ * Sends a QUIT message to a client, removes it from the map, and updates the other displays.
+ */
+void handle_quit(client_t* player, game_t* game);
+
+/* send_gameOverMsg
+ * Sends every client still in the game the QUIT GAME OVER message, with the scores.
+ */
+void send_gameOverMsg(game_t* game, int maxNameLength);
+
+#endif // __ENGINE_H_
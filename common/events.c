@@ -0,0 +1,188 @@
+/*
+ * events.c - the event log: a compact binary record of what happens in every game
+ * see events.h for the interface and the layout of the file
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#define _POSIX_C_SOURCE 200809L // for clock_gettime
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "events.h"
+
+
+/**************** constants ****************/
+static const char Magic[8] = "NUGEVT1";      // first bytes of every event log
+enum { BufferEvents = 1024 };                 // events each thread buffers between writes
+
+// Names of the event types, as eventdump prints them
+static const char* TypeNames[Event_NumTypes] = {
+    [Event_GameStart] = "START",
+    [Event_GameOver]  = "OVER",
+    [Event_Play]      = "PLAY",
+    [Event_Spectate]  = "SPECTATE",
+    [Event_Move]      = "MOVE",
+    [Event_Gold]      = "GOLD",
+    [Event_Quit]      = "QUIT",
+    [Event_Malformed] = "MALFORMED",
+    [Event_BadName]   = "BADNAME",
+    [Event_BadGold]   = "BADGOLD",
+    [Event_TooBig]    = "TOOBIG",
+};
+
+
+/**************** global variables ****************/
+/* Set once, before the games start (see events_open); stdio locks the file only for each buffer written. */
+static FILE* eventsFile = NULL;
+static uint64_t startMicros = 0;     // CLOCK_MONOTONIC at events_open
+static atomic_int gamesNumbered = 0;
+static pthread_key_t exitKey;        // writes out a thread's buffer when the thread exits
+
+/* Each thread buffers its own events, so logging one takes no lock; a game's events are all
+ * logged by the thread that runs it, so they reach the file in order. */
+static _Thread_local struct {
+    event_t events[BufferEvents];
+    int count;
+} buffer;
+
+
+/**************** local functions ****************/
+static uint64_t clock_micros(clockid_t clock);
+static void write_buffer(void* unused);
+
+
+/**************** events_open ****************/
+bool
+events_open(const char* filename)
+{
+    FILE* fp = fopen(filename, "wb");
+    if (fp == NULL){
+        return false;
+    }
+    if (pthread_key_create(&exitKey, write_buffer) != 0){
+        fclose(fp);
+        return false;
+    }
+
+    // the events come in whole buffers already, which stdio need not copy
+    setvbuf(fp, NULL, _IONBF, 0);
+
+    uint32_t recordBytes = sizeof(event_t);
+    uint32_t reserved = 0;
+    uint64_t epochMicros = clock_micros(CLOCK_REALTIME);
+    fwrite(Magic, sizeof(Magic), 1, fp);
+    fwrite(&recordBytes, sizeof(recordBytes), 1, fp);
+    fwrite(&reserved, sizeof(reserved), 1, fp);
+    fwrite(&epochMicros, sizeof(epochMicros), 1, fp);
+    fflush(fp);
+
+    startMicros = clock_micros(CLOCK_MONOTONIC);
+    eventsFile = fp;
+    return true;
+}
+
+/**************** events_newGame ****************/
+int
+events_newGame(void)
+{
+    return atomic_fetch_add(&gamesNumbered, 1) + 1;
+}
+
+/**************** events_log ****************/
+void
+events_log(event_type_t type, int game, int slot, int row, int column, unsigned int bytes, int value)
+{
+    if (eventsFile == NULL){
+        return;
+    }
+
+    if (buffer.count == 0){
+        pthread_setspecific(exitKey, &buffer); // (any value but NULL, for the key to call write_buffer)
+    }
+    buffer.events[buffer.count++] = (event_t){
+        .micros = clock_micros(CLOCK_MONOTONIC) - startMicros,
+        .type = type,
+        .game = game,
+        .slot = slot,
+        .unused = 0,
+        .row = row,
+        .column = column,
+        .bytes = bytes,
+        .value = value,
+    };
+    if (buffer.count == BufferEvents){
+        write_buffer(NULL);
+    }
+}
+
+/**************** events_flush ****************/
+void
+events_flush(void)
+{
+    if (eventsFile != NULL){
+        write_buffer(NULL);
+    }
+}
+
+/**************** events_close ****************/
+void
+events_close(void)
+{
+    if (eventsFile == NULL){
+        return;
+    }
+    write_buffer(NULL);
+    fclose(eventsFile);
+    eventsFile = NULL;
+    pthread_key_delete(exitKey);
+}
+
+/**************** events_readHeader ****************/
+bool
+events_readHeader(FILE* fp, uint64_t* epochMicros)
+{
+    char magic[sizeof(Magic)];
+    uint32_t recordBytes;
+    uint32_t reserved;
+    return fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, Magic, sizeof(Magic)) == 0
+        && fread(&recordBytes, sizeof(recordBytes), 1, fp) == 1 && recordBytes == sizeof(event_t)
+        && fread(&reserved, sizeof(reserved), 1, fp) == 1
+        && fread(epochMicros, sizeof(*epochMicros), 1, fp) == 1;
+}
+
+/**************** events_typeName ****************/
+const char*
+events_typeName(int type)
+{
+    return type >= 0 && type < Event_NumTypes ? TypeNames[type] : "?";
+}
+
+/**
+ * @brief Writes out the events the calling thread has buffered, in one write; also called as the thread exits.
+ */
+static void
+write_buffer(void* unused)
+{
+    if (buffer.count > 0 && eventsFile != NULL){
+        fwrite(buffer.events, sizeof(event_t), buffer.count, eventsFile);
+        buffer.count = 0;
+    }
+}
+
+/**
+ * @brief Returns the time of a clock, in microseconds.
+ */
+static uint64_t
+clock_micros(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
@@ -0,0 +1,106 @@
+/*
+ * events.h - header for the event log: a compact binary record of what happens in every game
+ *
+ * The event log is cheap enough to leave on: each event is one fixed-size record, appended
+ * to a buffer of the thread that logs it, and written out a whole buffer at a time to one file
+ * that stays open for the life of the process, shared by every game and every thread.
+ * So each game's records are in order, but those of games on different threads come in
+ * runs, not in order of time. Nothing is formatted as text; eventdump decodes the file.
+ *
+ * Layout (integers in host byte order):
+ *   header: "NUGEVT1\0", u32 size of a record, u32 0, u64 microseconds since the Unix epoch at events_open
+ *   record: u64 microseconds since events_open, u16 event type, u16 game,
+ *           i16 client slot, i16 0, i32 row, i32 column, u32 bytes, i32 value
+ * Fields that do not apply to an event are -1 (slot, row, column) or 0 (bytes, value).
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#ifndef __EVENTS_H_
+#define __EVENTS_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/**************** types ****************/
+// What happened; see events_typeName for the name eventdump prints
+typedef enum event_type {
+    Event_GameStart,   // a game starts: row, column = its size; value = its gold
+    Event_GameOver,    // a game ends: value = the players who joined it
+    Event_Play,        // a player joins: slot; row, column = where it starts; bytes = its request
+    Event_Spectate,    // a spectator joins: bytes = its request
+    Event_Move,        // a player takes a step: slot; row, column = where it lands; value = its key
+    Event_Gold,        // a player picks up gold: slot; row, column = where; value = the nuggets
+    Event_Quit,        // a client leaves: slot; value = its gold
+    Event_Malformed,   // a message is not understood: bytes = its length
+    Event_BadName,     // a PLAY has no name: bytes = its length
+    Event_BadGold,     // a player stepped on gold that is in no pile: slot; row, column = where
+    Event_TooBig,      // a row or frame does not fit in a datagram: slot; bytes = its size
+    Event_NumTypes
+} event_type_t;
+
+// One record of the event log, as laid out in the file
+typedef struct event {
+    uint64_t micros;   // since events_open
+    uint16_t type;     // an event_type_t
+    uint16_t game;     // the game's number (see events_newGame)
+    int16_t slot;      // the client's index among the game's clients, or -1
+    int16_t unused;
+    int32_t row;       // a spot of the map, or -1
+    int32_t column;
+    uint32_t bytes;    // the size of a message, or 0
+    int32_t value;     // depends on the type
+} event_t;
+
+
+/**************** Functions ****************/
+
+/* events_open
+ * Opens the event log, for every game in the process.
+ * Inputs:
+ *     - filename: the log to (re)write
+ * Outputs:
+ *     - Returns true if the log could be written; until it is, events are ignored.
+ * Notes: call before the games start; close the log with events_close.
+ */
+bool events_open(const char* filename);
+
+/* events_newGame
+ * Numbers a new game, counting from 1, for its events to be told apart from other games'.
+ */
+int events_newGame(void);
+
+/* events_log
+ * Appends one event, stamped with the time, to the calling thread's buffer, if the log is open.
+ * Safe to call from any thread; it neither allocates, locks, nor (until the buffer fills) calls the kernel.
+ * A thread's buffer is written out when it fills, at events_flush, and when the thread exits.
+ */
+void events_log(event_type_t type, int game, int slot, int row, int column, unsigned int bytes, int value);
+
+/* events_flush
+ * Writes out the events still in the calling thread's buffer, such as at the end of a game.
+ */
+void events_flush(void);
+
+/* events_close
+ * Flushes the calling thread's buffer and closes the event log; call it once every other thread
+ * that logged events has exited.
+ */
+void events_close(void);
+
+/* events_readHeader
+ * Reads the header of an event log, for decoding.
+ * Outputs:
+ *     - Returns true, with the time the log was opened in *epochMicros (since the Unix epoch),
+ *       if fp holds an event log whose records this program can read; false otherwise.
+ */
+bool events_readHeader(FILE* fp, uint64_t* epochMicros);
+
+/* events_typeName
+ * Returns the name of an event type, such as "MOVE", or "?" for none.
+ */
+const char* events_typeName(int type);
+
+#endif // __EVENTS_H_
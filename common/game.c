@@ -6,6 +6,7 @@
  * Team 9: Plankton, May 2023
  */
 
+#define _POSIX_C_SOURCE 200809L // for rand_r
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -24,7 +25,7 @@ client_t*
 new_player(game_t* game, addr_t client, char* name)
 {
     // allocate memory for a new client, of type player
-    client_t* player = mem_malloc_assert(sizeof(client_t), "Error allocating memory in new_player.\n");
+    client_t* player = mem_pool_alloc(game->clientPool);
     char* alpha = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
     // store their address, whether they are a spectator, and their ID based on the time of them joining
     player->clientAddr = client;
@@ -44,9 +45,18 @@ new_player(game_t* game, addr_t client, char* name)
     (game->playersJoined)++;
 
     player->quit = false;
+    player->viewRows = 0;
+    player->viewColumns = 0;
+    player->frame = 0;
+    player->chunkBytes = 0;
+    player->layered = false;
+    player->displayPending = false;
+    player->isBot = false;
+    player->sightRows = 0;
+    player->sightColumns = 0;
     
     // assign player to a random spot, then update their grid to reflect what is visible to them
-    assign_random_spot(game->grid, game->rows, game->columns, player->id, &player->r, &player->c);
+    assign_random_spot(game->grid, game->rows, game->columns, player->id, &player->r, &player->c, &game->randomState);
     get_player_visible(game, player);
 
     return player;
@@ -98,7 +108,7 @@ client_t*
 new_spectator(game_t* game, const addr_t client)
 {
     // allocate memory for a new client, of type spectator
-    client_t* spectator = mem_malloc_assert(sizeof(client_t), "Error allocating memory in new_spectator.\n");
+    client_t* spectator = mem_pool_alloc(game->clientPool);
     // mark that this client is a spectator, store the appropriate address and id
     spectator->isSpectator = true;
     spectator->clientAddr = client;
@@ -113,6 +123,15 @@ new_spectator(game_t* game, const addr_t client)
     (game->clients)[0] = spectator;
     game->spectatorActive = true;
     spectator->quit = false;
+    spectator->viewRows = 0;
+    spectator->viewColumns = 0;
+    spectator->frame = 0;
+    spectator->chunkBytes = 0;
+    spectator->layered = false;
+    spectator->displayPending = false;
+    spectator->isBot = false;
+    spectator->sightRows = 0;
+    spectator->sightColumns = 0;
     // return spectator 
     return spectator;
 }
@@ -134,13 +153,13 @@ delete_client(client_t* client, game_t* game)
     // set the client in the clients array to null
     (game->clients)[client->clientsArr_Idx] = NULL;
 
-    // free the client object
-    mem_free(client);
+    // return the client object to the game's pool
+    mem_pool_free(game->clientPool, client);
 }
 
 /**************** new_game ****************/
 game_t*
-new_game(FILE* map_file, const int maxPlayers)
+new_game(FILE* map_file, const int maxPlayers, const unsigned int seed)
 {
     // allocate memory for a new game object and a new clients array
     game_t* new_game = mem_malloc_assert(sizeof(game_t), "Error allocating memory in new_game.\n");
@@ -155,6 +174,15 @@ new_game(FILE* map_file, const int maxPlayers)
     new_game->goldRemaining = 0;
     new_game->playersJoined = 0;
     new_game->spectatorActive = false;
+    new_game->locations = NULL;
+    new_game->totalGoldPiles = 0;
+    new_game->randomState = seed;
+    new_game->goldField = NULL;
+    new_game->moveField = NULL;
+    new_game->scratch = mem_arena_new(128 * 1024, "Error allocating memory in new_game.\n");
+    new_game->clientPool = mem_pool_new(sizeof(client_t), maxPlayers + 1, "Error allocating memory in new_game.\n");
+    metrics_init(&new_game->metrics);
+    new_game->goldPool = NULL;
 
     // load in the map
     new_game->grid = load_grid(map_file, &(new_game->rows), &(new_game->columns));
@@ -184,16 +212,16 @@ end_game(game_t* game, int maxGoldPiles)
         grid_delete(game->grid, game->rows);
     }
 
-    // if the gold locations array within the game is not null, free everything stored within it
+    // if the gold locations array within the game is not null, free it; the piles go with their pool
     if (game->locations != NULL){
-        for (int i = 0; i < game->totalGoldPiles; i++){
-            mem_free(game->locations[i]);
-        }
-
-        // free the locations array itself 
         mem_free(game->locations);
     }
     
+    mem_pool_delete(game->goldPool);
+    mem_pool_delete(game->clientPool);
+    mem_arena_delete(game->scratch);
+    metrics_done(&game->metrics);
+
     // free the game struct
     mem_free(game);
 }
@@ -203,13 +231,9 @@ int
 update_gold(game_t* game, client_t* player, int r, int c, int goldMaxPiles)
 {
     // loop over all the gold piles
-    for (int i = 0; i < goldMaxPiles; i++){
+    for (int i = 0; i < game->totalGoldPiles; i++){
         gold_location_t* location = game->locations[i];
 
-        if (location->nuggetCount < 0){
-            break; // there is no such gold location if this condition is reached
-        }
-
         // if the pile matches the row and column that was passed in
         if (location->r == r && location->c == c){
             // subtract the amount of gold in that pile from the overall gold in the game
@@ -231,8 +255,12 @@ load_gold(game_t* game, const int goldTotal, const int goldMinPiles, const int g
     
     // allocate memory for an array within the game struct that holds gold locations
     game->locations =  mem_malloc_assert((goldMaxPiles) * sizeof(gold_location_t*), "Error allocating memory in load_gold.\n");
+    game->goldPool = mem_pool_new(sizeof(gold_location_t), goldMaxPiles, "Error allocating memory in load_gold.\n");
+
+    int* nugget_counts = nugget_count_array(goldMinPiles, goldMaxPiles, goldTotal, &game->randomState);
 
-    int* nugget_counts = nugget_count_array(goldMinPiles, goldMaxPiles, goldTotal);
+    // every pile is used unless the array ends sooner
+    game->totalGoldPiles = goldMaxPiles;
 
     // loop over all the possible gold piles
     for (int i = 0; i < goldMaxPiles; i++){
@@ -259,9 +287,9 @@ add_gold_pile(game_t* game, int gold_amt, int piles)
 {
 
     // allocate memory for a gold_location type object that stores where a gold pile is located
-    gold_location_t* gold_spot = mem_malloc_assert(sizeof(gold_location_t), "Error allocating memory in add_gold_pile.\n");
+    gold_location_t* gold_spot = mem_pool_alloc(game->goldPool);
     // assign it to a random open spot in the grid
-    assign_random_spot(game->grid, game->rows, game->columns, '*', &(gold_spot->r), &(gold_spot->c));
+    assign_random_spot(game->grid, game->rows, game->columns, '*', &(gold_spot->r), &(gold_spot->c), &game->randomState);
     // assign it a gold amount, then update the game variable goldRemaining accordingly
     gold_spot->nuggetCount = gold_amt;
     game->goldRemaining += gold_amt;
@@ -271,7 +299,7 @@ add_gold_pile(game_t* game, int gold_amt, int piles)
 
 /**************** nugget_count_array ****************/
 int*
-nugget_count_array(const int goldMinPiles, const int goldMaxPiles, int goldTotal)
+nugget_count_array(const int goldMinPiles, const int goldMaxPiles, int goldTotal, unsigned int* randomState)
 {
     const int lower_bound = 5;
     const int upper_bound = 30;
@@ -285,7 +313,7 @@ nugget_count_array(const int goldMinPiles, const int goldMaxPiles, int goldTotal
         // create gold piles and add gold to them, until you reach the maximum number of piles or the maximum amount of gold
         while (piles < goldMaxPiles && total_gold_added < goldTotal){
             // generate a pseudo-random number between the upper and lower bound that represents the amount of gold that will be assigned to this pile
-            gold_amt = (rand() % (upper_bound - lower_bound + 1)) + lower_bound;
+            gold_amt = (rand_r(randomState) % (upper_bound - lower_bound + 1)) + lower_bound;
             // if this + the gold already added would be greater than the allowed total, or we have reached the max # of gold piles
             if (gold_amt + total_gold_added > goldTotal || piles == goldMaxPiles - 1){
                 // make the amount the max that can be added
@@ -98,11 +98,12 @@ void delete_client(client_t* client, game_t* game);
  * Inputs:
  *     - map_file: pointer to the file containing the game map
  *     - maxPlayers: maximum number of players allowed in the game
+ *     - seed: seed of the game's own random-number generator; the same seed and the same messages make the same game
  * Outputs:
  *     - Returns the newly created game object.
  * Notes: the game_t* must be freed at some point by the caller using end_game.
  */
-game_t* new_game(FILE* map_file, const int maxPlayers);
+game_t* new_game(FILE* map_file, const int maxPlayers, const unsigned int seed);
 
 /* end_game
  * Ends the game and deallocates the global grid and each of the clients.
@@ -142,7 +143,7 @@ int update_gold(game_t* game, client_t* player, int r_pos, int c_pos, int goldMa
 void load_gold(game_t* game, const int goldTotal, const int goldMinPiles, const int goldMaxPiles);
 
 /* add_gold_pile
- * Adds a new gold pile to the game at a random location.
+ * Adds a new gold pile to the game at a random location, allocated from the game's gold pool (created by load_gold).
  * Inputs:
  *     - game: pointer to the game object
  *     - gold_amt: amount of gold in the new pile
@@ -158,10 +159,11 @@ void add_gold_pile(game_t* game, int gold_amt, int piles);
  *     - goldMinPiles: minimum number of gold piles in the game
  *     - goldMaxPiles: maximum number of gold piles in the game
  *     - goldTotal: total amount of gold in the game
+ *     - randomState: the state of the game's random-number generator (see rand_r)
  * Outputs:
  *     - Returns an array containing the number of gold nuggets in each pile.
  * Notes: Caller is responsible for freeing the array.
  */
-int* nugget_count_array(const int goldMinPiles, const int goldMaxPiles, int goldTotal);
+int* nugget_count_array(const int goldMinPiles, const int goldMaxPiles, int goldTotal, unsigned int* randomState);
 
 #endif // __GAME_H_
\ No newline at end of file
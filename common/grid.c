@@ -5,12 +5,12 @@ specific function descriptions are located in grid.h
 Team 9: Plankton, May 2023
 */
 
+#define _POSIX_C_SOURCE 200809L // for rand_r
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
-#include <time.h>
 #include <math.h>
 
 #include "../libs/file.h"
@@ -23,8 +23,24 @@ Team 9: Plankton, May 2023
 #include "game.h"
 #include "grid.h"
 
+/**************** constants  ****************/
+// Most of the map a player without a window sees around them: every map that fits in one DISPLAY fits in it too
+static const int MaxSightRows = 48;
+static const int MaxSightColumns = 160;
+
 /**************** static function declarations  ****************/
 
+/*
+* sight_box: finds the part of the map a player sees: its window if it has one, otherwise as much of the map
+* as MaxSightRows by MaxSightColumns, centered on the player as far as the edges allow
+*/
+static void sight_box(game_t* game, client_t* player, int* top, int* left, int* rows, int* columns);
+
+/*
+* forget_spot: a spot the player no longer sees keeps its map, but not the gold or players last seen on it
+*/
+static bool forget_spot(game_t* game, client_t* player, int r, int c);
+
 /*
 * is_open: takes in game, column, and row, and returns true if the spot is one where a player can move to
 */
@@ -40,6 +56,11 @@ static bool is_integer(float num);
 */
 static bool is_gridspot(double a, double b);
 
+/*
+* reach_neighbours: one step of grid_distances, reaching the neighbours of a spot not yet reached
+*/
+static void reach_neighbours(char** grid, int rows, int columns, int spot, int* distances, int* nearest, int* queue, int* tail);
+
 
 /**************** local function declarations  ****************/
 
@@ -59,16 +80,28 @@ load_grid(FILE* fp, int* rows, int* columns)
     char* newRow = NULL;
     int row = 0; // keeps track of our position while filling in grid array
 
-    char* line = file_readLine(fp);
-    *columns = strlen(line);
-    mem_free(line); // responsible for freeing this memory
-
-    rewind(fp);  // reset pointer to beginning of the file
-
-    while ((newRow = file_readLine(fp)) != NULL){
+    // the widest row gives the number of columns
+    *columns = 0;
+    while (row < *rows && (newRow = file_readLine(fp)) != NULL){
         grid[row] = newRow;
+        if ((int)strlen(newRow) > *columns){
+            *columns = strlen(newRow);
+        }
         row++;
     }
+    *rows = row;
+
+    // rows may differ in length: pad each with spaces to the full width, so every spot of the grid exists.
+    // file_readLine mallocs each line itself, so every row is copied into memory of our own, which grid_delete frees
+    for (int r = 0; r < *rows; r++){
+        int length = strlen(grid[r]);
+        char* padded = mem_malloc_assert(*columns + 1, "Error allocating memory in load_grid.\n");
+        memcpy(padded, grid[r], length);
+        memset(padded + length, ' ', *columns - length);
+        padded[*columns] = '\0';
+        free(grid[r]);
+        grid[r] = padded;
+    }
     // this is a 2D character array
 
     return grid;
@@ -102,47 +135,203 @@ load_player_grid(game_t* game)
 
 /**************** grid_toStr  ****************/
 char*
-grid_toStr(char** global_grid, char** player_grid, int rows, int columns)
+grid_toStr(char** global_grid, char** player_grid, int rows, int columns, mem_arena_t* arena)
+{
+    return grid_toStrWindow(global_grid, player_grid, 0, 0, rows, columns, arena);
+}
+
+/**************** grid_toStrWindow  ****************/
+char*
+grid_toStrWindow(char** global_grid, char** player_grid, int top, int left, int rows, int columns, mem_arena_t* arena)
 {
    // Create string for string version of grid map, must have rows*columns characters plus new lines & a terminating null
-   char* display = mem_malloc_assert((rows* (columns + 1)) , "Error allocating memory in grid_toStr.\n");
+   char* display = mem_arena_alloc(arena, (rows* (columns + 1)) , "Error allocating memory in grid_toStrWindow.\n");
+   grid_writeWindow(global_grid, player_grid, top, left, rows, columns, display);
+
+    // this is a string, in a format that can be sent directly to the client 
+   return display;
+}
+
+/**************** grid_writeWindow  ****************/
+void
+grid_writeWindow(char** global_grid, char** player_grid, int top, int left, int rows, int columns, char* display)
+{
+   // the grid to show: the player's if a player grid was passed in
+   char** grid = player_grid != NULL ? player_grid : global_grid;
 
    for (int r = 0; r < rows; r++){
-        for (int c = 0; c < columns; c++){
-            // adding 1 because new line isn't included in column count
-            display[(r * (columns + 1)) + c] = global_grid[r][c];
-           
-            if (player_grid != NULL){
-                // if a player grid was passed in, set to player_grid value
-                display[(r* (columns + 1)) + c] = player_grid[r][c];
-            }
-        }
+        // adding 1 because new line isn't included in column count
+        memcpy(display + (r * (columns + 1)), grid[top + r] + left, columns);
 
         display[(r* (columns + 1)) + columns] = '\n'; // add new line to the end of each row
     
     }
 
     display[(rows*columns) + rows - 1] = '\0'; // null terminate string
+}
 
-    // this is a string, in a format that can be sent directly to the client 
-   return display;
+/**************** grid_toStaticStr  ****************/
+char*
+grid_toStaticStr(game_t* game)
+{
+    char* map = grid_toStr(game->grid, NULL, game->rows, game->columns, game->scratch);
+
+    // gold lies on floor; a player stands on floor or in a tunnel
+    for (char* spot = map; *spot != '\0'; spot++){
+        if (*spot == '*'){
+            *spot = '.';
+        }
+        else if (isalpha(*spot)){
+            client_t* player = find_player(*spot, game);
+            *spot = (player != NULL && player->onTunnel) ? '#' : '.';
+        }
+    }
+    return map;
+}
+
+/**************** grid_toFrame  ****************/
+char*
+grid_toFrame(char** global_grid, char** player_grid, int rows, int columns, unsigned int frame, mem_arena_t* arena)
+{
+    char** grid = player_grid != NULL ? player_grid : global_grid;
+    const int entityLength = 24; // room for "<symbol><row>,<column> "
+
+    // count the players and gold, to size the message, and find the rectangle of the spots seen
+    int entities = 0;
+    int top = rows, left = columns, bottom = -1, right = -1;
+    for (int r = 0; r < rows; r++){
+        for (int c = 0; c < columns; c++){
+            if (grid[r][c] == '*' || grid[r][c] == '@' || isalpha(grid[r][c])){
+                entities++;
+            }
+            if (player_grid != NULL && player_grid[r][c] != ' '){
+                top = r < top ? r : top;
+                bottom = r > bottom ? r : bottom;
+                left = c < left ? c : left;
+                right = c > right ? c : right;
+            }
+        }
+    }
+    if (bottom < 0){
+        top = left = 0;  // nothing seen: an empty rectangle
+    }
+    const int maskRows = bottom - top + 1;
+    const int maskColumns = right - left + 1;
+    const int maskLength = (maskRows * maskColumns + 5) / 6;
+
+    char* message = mem_arena_alloc(arena, 64 + maskLength + 1 + entities * entityLength + 1, "Error allocating memory in grid_toFrame.\n");
+    char* end = message + sprintf(message, "FRAME %u %d %d %d %d\n", frame, top, left, maskRows, maskColumns);
+
+    // the mask of the spots seen
+    if (maskLength > 0){
+        memset(end, 0, maskLength);
+        for (int i = 0; i < maskRows * maskColumns; i++){
+            if (player_grid[top + i / maskColumns][left + i % maskColumns] != ' '){
+                end[i / 6] |= 1 << (i % 6);
+            }
+        }
+        for (int i = 0; i < maskLength; i++){
+            end[i] += '0';
+        }
+        end += maskLength;
+    }
+    *end++ = '\n';
+
+    // the players and gold
+    for (int r = 0; r < rows; r++){
+        for (int c = 0; c < columns; c++){
+            if (grid[r][c] == '*' || grid[r][c] == '@' || isalpha(grid[r][c])){
+                end += sprintf(end, "%c%d,%d ", grid[r][c], r, c);
+            }
+        }
+    }
+    if (entities > 0){
+        end--; // drop the last space
+    }
+    *end = '\0';
+
+    return message;
+}
+
+/**************** grid_distances  ****************/
+void
+grid_distances(char** grid, int rows, int columns, const int* sources, int nsources, int* distances, int* nearest, int* queue)
+{
+    int head = 0;
+    int tail = 0;
+
+    for (int i = 0; i < rows * columns; i++){
+        distances[i] = -1;
+        if (nearest != NULL){
+            nearest[i] = -1;
+        }
+    }
+    for (int s = 0; s < nsources; s++){
+        if (distances[sources[s]] < 0 && grid_isPassable(grid[sources[s] / columns][sources[s] % columns])){
+            distances[sources[s]] = 0;
+            if (nearest != NULL){
+                nearest[sources[s]] = sources[s];
+            }
+            queue[tail++] = sources[s];
+        }
+    }
+
+    // each spot is reached first along a shortest path
+    while (head < tail){
+        reach_neighbours(grid, rows, columns, queue[head++], distances, nearest, queue, &tail);
+    }
+}
+
+/**************** grid_distancesUntil  ****************/
+void
+grid_distancesUntil(char** grid, int rows, int columns, int* distances, int* queue, int* head, int* tail, int goal)
+{
+    while (*head < *tail && distances[goal] < 0){
+        reach_neighbours(grid, rows, columns, queue[(*head)++], distances, NULL, queue, tail);
+    }
+}
+
+/**************** reach_neighbours  ****************/
+/* One step of the search of grid_distances: gives each passable neighbour of the spot
+ * not yet reached its distance (and nearest source), and queues it.
+ */
+static void
+reach_neighbours(char** grid, int rows, int columns, int spot, int* distances, int* nearest, int* queue, int* tail)
+{
+    int r = spot / columns;
+    int c = spot % columns;
+    for (int dr = -1; dr <= 1; dr++){
+        for (int dc = -1; dc <= 1; dc++){
+            int nr = r + dr;
+            int nc = c + dc;
+            if (nr < 0 || nr >= rows || nc < 0 || nc >= columns || distances[nr * columns + nc] >= 0){
+                continue;
+            }
+            if (grid_isPassable(grid[nr][nc])){
+                distances[nr * columns + nc] = distances[spot] + 1;
+                if (nearest != NULL){
+                    nearest[nr * columns + nc] = nearest[spot];
+                }
+                queue[(*tail)++] = nr * columns + nc;
+            }
+        }
+    }
 }
 
 /**************** assign_random_spot  ****************/
 void
-assign_random_spot(char** grid, int rows, int columns, char thing, int* spot_r, int* spot_c)
+assign_random_spot(char** grid, int rows, int columns, char thing, int* spot_r, int* spot_c, unsigned int* randomState)
 {
     // assigns a "thing" to a random open spot, can be used to place either gold or a player
     bool placed = false;
     int r;
     int c;
-    srand(time(NULL));
 
     while (!placed){
-        // get a pseudo-random x coordinate and y coordinate from stdlib
+        // get a pseudo-random x coordinate and y coordinate from the game's own generator
 
-        r = rand() % rows;
-        c = rand() % columns;
+        r = rand_r(randomState) % rows;
+        c = rand_r(randomState) % columns;
 
         // try to place the "thing" there
 
@@ -197,6 +386,14 @@ is_open(game_t* game, const int c, const int r){
     return false;
 }
 
+/**************** grid_isPassable ****************/
+bool
+grid_isPassable(char symbol)
+{
+    // room floor, passage, gold, or a player (whom the stepping player swaps places with)
+    return symbol == '.' || symbol == '#' || symbol == '*' || isalpha(symbol);
+}
+
 /**************** is_integer ****************/
 static bool is_integer(float num)
 {
@@ -353,8 +550,25 @@ get_player_visible(game_t* game, client_t* player)
     int pr = player->r;
     int pc = player->c;
 
-    for (int r = 0; r < game->rows; r++){
-        for (int c = 0; c < game->columns; c++){
+    // only the part of the map the player sees is searched, so the work is the same on a map of any size
+    int top, left, rows, columns;
+    sight_box(game, player, &top, &left, &rows, &columns);
+
+    // what the player saw last time, but is now out of sight
+    for (int r = player->sightTop; r < player->sightTop + player->sightRows; r++){
+        for (int c = player->sightLeft; c < player->sightLeft + player->sightColumns; c++){
+            if (r < top || r >= top + rows || c < left || c >= left + columns){
+                modified |= forget_spot(game, player, r, c);
+            }
+        }
+    }
+    player->sightTop = top;
+    player->sightLeft = left;
+    player->sightRows = rows;
+    player->sightColumns = columns;
+
+    for (int r = top; r < top + rows; r++){
+        for (int c = left; c < left + columns; c++){
             // don't compute anything if the game grid space is empty
             if (isspace(game->grid[r][c])){
                 continue;
@@ -372,29 +586,66 @@ get_player_visible(game_t* game, client_t* player)
                 }
                 player->grid[r][c] = game->grid[r][c];
             }
-            else if (player->grid[r][c] == '*'){
-                player->grid[r][c] = '.';
-                modified = true;
+            else {
+                modified |= forget_spot(game, player, r, c);
             }
-            else if (isalpha(player->grid[r][c])){
-                // get the player
-                client_t* other_player = find_player(player->grid[r][c], game);
-               
-                // check if tunnel and change spot accordingly
-                if (other_player->onTunnel){
-                    player->grid[r][c] = '#';
-                }
-                else{
-                    player->grid[r][c] = '.';
-                }
-                modified = true;
-            }
-
-            
         }
     }
 
-    return modified;                                                                                                                                                                             
+    return modified;
+}
+
+/**************** sight_box ****************/
+static void
+sight_box(game_t* game, client_t* player, int* top, int* left, int* rows, int* columns)
+{
+    *rows = player->viewRows > 0 ? player->viewRows : MaxSightRows;
+    *columns = player->viewRows > 0 ? player->viewColumns : MaxSightColumns;
+    if (*rows > game->rows){
+        *rows = game->rows;
+    }
+    if (*columns > game->columns){
+        *columns = game->columns;
+    }
+
+    // as send_displayMsg places a window
+    *top = player->r - *rows / 2;
+    *top = *top < 0 ? 0 : (*top > game->rows - *rows ? game->rows - *rows : *top);
+    *left = player->c - *columns / 2;
+    *left = *left < 0 ? 0 : (*left > game->columns - *columns ? game->columns - *columns : *left);
+}
+
+/**************** forget_spot ****************/
+static bool
+forget_spot(game_t* game, client_t* player, int r, int c)
+{
+    if (player->grid[r][c] == '*'){
+        player->grid[r][c] = '.';
+        return true;
+    }
+    if (isalpha(player->grid[r][c])){
+        // get the player
+        client_t* other_player = find_player(player->grid[r][c], game);
+
+        // check if tunnel and change spot accordingly
+        if (other_player->onTunnel){
+            player->grid[r][c] = '#';
+        }
+        else{
+            player->grid[r][c] = '.';
+        }
+        return true;
+    }
+    if (player->grid[r][c] == '@'){
+        // where the player stood, left out of sight at once only by a window of a single spot
+        char spot = game->grid[r][c];
+        if (isalpha(spot)){
+            spot = find_player(spot, game)->onTunnel ? '#' : '.';
+        }
+        player->grid[r][c] = spot == '*' ? '.' : spot;
+        return true;
+    }
+    return false;
 }
 
 /**************** grid_delete ****************/
@@ -57,10 +57,105 @@ char** load_player_grid(game_t* game);
  *   - player_grid: Pointer to the player's grid array.
  *   - rows: Number of rows in the grids.
  *   - columns: Number of columns in the grids.
+ *   - arena: The arena to allocate the string from.
  * Outputs:
- *   - Returns a dynamically allocated string representing the grids.
+ *   - Returns a string representing the grids, allocated from arena.
  */
-char* grid_toStr(char** global_grid, char** player_grid, int rows, int columns);
+char* grid_toStr(char** global_grid, char** player_grid, int rows, int columns, mem_arena_t* arena);
+
+/*
+ * grid_toStrWindow
+ * Converts a window of the game grids to a string representation, as grid_toStr does for the whole grid.
+ * Inputs:
+ *   - global_grid: Pointer to the global grid array.
+ *   - player_grid: Pointer to the player's grid array, or NULL to show the global grid.
+ *   - top, left: Row and column of the grids at the top left of the window.
+ *   - rows, columns: Size of the window, which must lie within the grids.
+ *   - arena: The arena to allocate the string from.
+ * Outputs:
+ *   - Returns a string representing the window, one line per row, allocated from arena.
+ */
+char* grid_toStrWindow(char** global_grid, char** player_grid, int top, int left, int rows, int columns, mem_arena_t* arena);
+
+/*
+ * grid_writeWindow
+ * Writes a window of the game grids into a buffer, in the format of grid_toStrWindow.
+ * Inputs:
+ *   - global_grid, player_grid, top, left, rows, columns: as for grid_toStrWindow.
+ *   - display: Where to write the window, with room for rows * (columns + 1) characters; it ends with a terminating null.
+ */
+void grid_writeWindow(char** global_grid, char** player_grid, int top, int left, int rows, int columns, char* display);
+
+/*
+ * grid_toStaticStr
+ * Converts the static layer of the game grid to a string: the map as loaded, without players or gold.
+ * Inputs:
+ *   - game: Pointer to the game.
+ * Outputs:
+ *   - Returns a string of the map, one line per row, in the format of grid_toStr, allocated from the game's scratch arena.
+ */
+char* grid_toStaticStr(game_t* game);
+
+/*
+ * grid_toFrame
+ * Converts the dynamic layer of a client's view to a FRAME message, which drawn over the static layer gives its DISPLAY:
+ *   "FRAME frame top left rows columns", then a line with the mask of the spots the player has seen,
+ *   then a line of the players and gold it sees now.
+ * The mask covers only the rectangle of rows x columns spots at (top, left) that holds every spot seen.
+ * It has one bit per spot of the rectangle, row by row, packed 6 to a character: spot i is bit i%6 of character i/6, offset by '0'.
+ * Each of the players and gold is written "<symbol><row>,<column>" (the player itself as '@'), separated by spaces.
+ * Inputs:
+ *   - global_grid: Pointer to the global grid array.
+ *   - player_grid: Pointer to the player's grid array, or NULL for the spectator, who sees every spot (its rectangle is empty).
+ *   - rows, columns: Size of the grids.
+ *   - frame: Number of the frame.
+ *   - arena: The arena to allocate the message from.
+ * Outputs:
+ *   - Returns a string of the message, allocated from arena.
+ */
+char* grid_toFrame(char** global_grid, char** player_grid, int rows, int columns, unsigned int frame, mem_arena_t* arena);
+
+/*
+ * grid_distances
+ * Finds how many steps each spot of the grid is from the nearest of some sources (a breadth-first search),
+ * stepping as players do: to any of the 8 neighbouring spots that is room floor or passage.
+ * Players and gold do not block the way.
+ * Inputs:
+ *   - grid: Pointer to the game grid array.
+ *   - rows, columns: Size of the grid.
+ *   - sources: The spots to measure from, each row * columns + column.
+ *   - nsources: How many sources there are.
+ *   - distances: Where to write the distances, rows * columns of them, indexed as the sources are;
+ *     -1 for a spot that no source can reach.
+ *   - nearest: Where to write the nearest source to each spot, likewise; -1 for a spot that no source can reach.
+ *     May be NULL.
+ *   - queue: Room for the search, rows * columns spots; it may be the sources themselves.
+ * Outputs: None
+ */
+void grid_distances(char** grid, int rows, int columns, const int* sources, int nsources, int* distances, int* nearest, int* queue);
+
+/*
+ * grid_distancesUntil
+ * Goes on with a search like grid_distances, only until it reaches a goal spot, leaving the rest of it in the queue
+ * so that it can go on toward another goal later. By then every spot nearer the sources than the goal has its distance.
+ * To start a search, set every distance to -1, then each source's to 0, and queue the sources.
+ * Inputs:
+ *   - grid: Pointer to the game grid array.
+ *   - rows, columns: Size of the grid.
+ *   - distances: The distances found so far, as grid_distances writes them; -1 for a spot not yet reached.
+ *   - queue: The spots reached, in the order they were reached, room for rows * columns of them.
+ *   - head: How many of them the search has gone on from; updated.
+ *   - tail: How many of them there are; updated.
+ *   - goal: The spot to reach, row * columns + column.
+ * Outputs: None; the goal's distance is still -1 if no source can reach it.
+ */
+void grid_distancesUntil(char** grid, int rows, int columns, int* distances, int* queue, int* head, int* tail, int goal);
+
+/*
+ * grid_isPassable
+ * Returns true if a player can step onto a spot of the grid showing this symbol: room floor, passage, gold, or another player.
+ */
+bool grid_isPassable(char symbol);
 
 /*
  * assign_random_spot
@@ -73,9 +168,10 @@ char* grid_toStr(char** global_grid, char** player_grid, int rows, int columns);
  *   - thing: Character representing the thing to assign.
  *   - spot_r: Pointer to the variable that will store the assigned row.
  *   - spot_c: Pointer to the variable that will store the assigned column.
+ *   - randomState: the state of the game's random-number generator (see rand_r).
  * Outputs: None
  */
-void assign_random_spot(char** grid, int rows, int columns, char thing, int* spot_x, int* spot_y);
+void assign_random_spot(char** grid, int rows, int columns, char thing, int* spot_x, int* spot_y, unsigned int* randomState);
 
 
 /*
@@ -122,7 +218,9 @@ bool is_visible(game_t* game, const int playerColumn, const int playerRow, const
 /*
  * get_player_visible
  * Retrieves the visibility status of a player.
- * Loops over each point in the grid and calls `is_visible`, updating the player's grid accordingly. 
+ * Loops over each point of the part of the grid the player sees (its window, or a box of the map around it
+ * no bigger than every map that fits in one DISPLAY) and calls `is_visible`, updating the player's grid accordingly;
+ * gold and players last seen outside that part are forgotten.
  * Returns true if the player's grid was modified.
  * Inputs:
  *   - game: Pointer to the game state structure.
@@ -0,0 +1,147 @@
+/*
+ * metrics.c - the metrics a game keeps about itself
+ * see metrics.h for the interface
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#define _POSIX_C_SOURCE 200809L // for clock_gettime
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../libs/mem.h"
+#include "../support/hist.h"
+#include "metrics.h"
+
+
+/**************** constants ****************/
+// The first word of each kind of message sent
+static const struct {
+    const char* word;
+    size_t length;
+} SentWords[Sent_NumTypes] = {
+    [Sent_Ok]          = { "OK", 2 },
+    [Sent_Grid]        = { "GRID", 4 },
+    [Sent_Gold]        = { "GOLD", 4 },
+    [Sent_Display]     = { "DISPLAY", 7 },
+    [Sent_DisplayRows] = { "DISPLAYROWS", 11 },
+    [Sent_Map]         = { "MAP", 3 },
+    [Sent_MapRows]     = { "MAPROWS", 7 },
+    [Sent_Frame]       = { "FRAME", 5 },
+    [Sent_Quit]        = { "QUIT", 4 },
+    [Sent_Stats]       = { "STATS", 5 },
+    [Sent_Bundle]      = { "BUNDLE", 6 },
+    [Sent_Other]       = { "other", 0 },
+};
+
+
+/**************** local functions ****************/
+static int format_hist(const hist_t* hist, const char* name, char* text, const size_t size);
+static int appended(int length, int more, const size_t size);
+
+
+/**************** metrics_init ****************/
+void
+metrics_init(metrics_t* metrics)
+{
+    memset(metrics, 0, sizeof(metrics_t));
+    metrics->handlerNanos = mem_assert(hist_new(), "Error allocating memory in metrics_init.\n");
+    metrics->updateNanos = mem_assert(hist_new(), "Error allocating memory in metrics_init.\n");
+}
+
+/**************** metrics_done ****************/
+void
+metrics_done(metrics_t* metrics)
+{
+    hist_delete(metrics->handlerNanos);
+    hist_delete(metrics->updateNanos);
+    metrics->handlerNanos = NULL;
+    metrics->updateNanos = NULL;
+}
+
+/**************** metrics_countSent ****************/
+void
+metrics_countSent(metrics_t* metrics, const char* message)
+{
+    size_t wordLength = strcspn(message, " \n");
+    metrics_sent_t type = Sent_Other;
+    for (int i = 0; i < Sent_Other; i++){
+        if (SentWords[i].length == wordLength && memcmp(message, SentWords[i].word, wordLength) == 0){
+            type = i;
+            break;
+        }
+    }
+    metrics->sent[type]++;
+    metrics->sentBytes[type] += strlen(message);
+}
+
+/**************** metrics_nanos ****************/
+uint64_t
+metrics_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**************** metrics_format ****************/
+int
+metrics_format(const metrics_t* metrics, const char* const* requestNames, const int nrequests, char* text, const size_t size)
+{
+    int length = 0;
+    text[0] = '\0';
+
+    length = appended(length, snprintf(text + length, size - length, "requests:"), size);
+    for (int i = 0; i < nrequests && i < Metrics_MaxRequests; i++){
+        length = appended(length, snprintf(text + length, size - length, " %s %ld,", requestNames[i], metrics->requests[i]), size);
+    }
+    length = appended(length, snprintf(text + length, size - length, " malformed %ld\n", metrics->malformed), size);
+
+    // only the kinds of message that were sent
+    length = appended(length, snprintf(text + length, size - length, "sent:"), size);
+    const char* separator = " ";
+    for (int i = 0; i < Sent_NumTypes; i++){
+        if (metrics->sent[i] > 0){
+            length = appended(length, snprintf(text + length, size - length, "%s%s %ld (%ld bytes)", separator,
+                                               SentWords[i].word, metrics->sent[i], metrics->sentBytes[i]), size);
+            separator = ", ";
+        }
+    }
+    length = appended(length, snprintf(text + length, size - length, "\nviews computed %ld, displays skipped as unchanged %ld\n",
+                                       metrics->viewsComputed, metrics->displaysSkipped), size);
+
+    length = appended(length, format_hist(metrics->handlerNanos, "handler", text + length, size - length), size);
+    length = appended(length, format_hist(metrics->updateNanos, "update_displays", text + length, size - length), size);
+    return length;
+}
+
+/**
+ * @brief Formats one line summarizing a histogram of nanoseconds, as hist_print does.
+ *
+ * @return int - what snprintf returns
+ */
+static int
+format_hist(const hist_t* hist, const char* name, char* text, const size_t size)
+{
+    return snprintf(text, size, "%s: count %llu, mean %.1f, p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu ns\n", name,
+                    (unsigned long long)hist_count(hist), hist_mean(hist),
+                    (unsigned long long)hist_percentile(hist, 50),
+                    (unsigned long long)hist_percentile(hist, 90),
+                    (unsigned long long)hist_percentile(hist, 99),
+                    (unsigned long long)hist_percentile(hist, 99.9),
+                    (unsigned long long)hist_max(hist));
+}
+
+/**
+ * @brief Returns the length of the text after snprintf appended `more` bytes, no more than fits in it.
+ */
+static int
+appended(int length, int more, const size_t size)
+{
+    length += more > 0 ? more : 0;
+    return length < (int)size ? length : (int)size - 1;
+}
@@ -0,0 +1,80 @@
+/*
+ * metrics.h - header for the metrics a game keeps about itself
+ *
+ * Each game counts the requests it handles, the messages it sends (and their bytes) by type,
+ * how often it recomputes what a player sees, and how many displays it skips because they did
+ * not change; and it times each message it handles, and each update of the displays, in
+ * log-linear histograms (see hist.h). A game is played on one thread, so its metrics need no
+ * locks; counting is a few increments, and allocates nothing.
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#ifndef __METRICS_H_
+#define __METRICS_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../support/hist.h"
+
+
+/**************** constants ****************/
+enum { Metrics_MaxRequests = 16 };  // most kinds of request a game counts
+
+/**************** types ****************/
+// The kinds of message a game sends, by their first word
+typedef enum metrics_sent {
+    Sent_Ok, Sent_Grid, Sent_Gold, Sent_Display, Sent_DisplayRows, Sent_Map, Sent_MapRows,
+    Sent_Frame, Sent_Quit, Sent_Stats, Sent_Bundle, Sent_Other, Sent_NumTypes
+} metrics_sent_t;
+
+typedef struct metrics {
+    long requests[Metrics_MaxRequests];  // messages handled, by request (numbered by the engine)
+    long malformed;                      // messages not understood, or not allowed of their sender
+    long sent[Sent_NumTypes];            // messages sent, by type (each message of a BUNDLE counts, and so does the BUNDLE)
+    long sentBytes[Sent_NumTypes];
+    long viewsComputed;                  // times what a player sees was recomputed
+    long displaysSkipped;                // of the views recomputed, those that had not changed, so no display was sent
+    hist_t* handlerNanos;                // time to handle each message
+    hist_t* updateNanos;                 // time of each update of the displays
+} metrics_t;
+
+
+/**************** Functions ****************/
+
+/* metrics_init
+ * Zeroes the counters, and creates the histograms.
+ * Notes: free the histograms with metrics_done.
+ */
+void metrics_init(metrics_t* metrics);
+
+/* metrics_done
+ * Frees the histograms.
+ */
+void metrics_done(metrics_t* metrics);
+
+/* metrics_countSent
+ * Counts a message sent, by its first word, and its bytes.
+ */
+void metrics_countSent(metrics_t* metrics, const char* message);
+
+/* metrics_nanos
+ * Returns the time of a monotonic clock in nanoseconds, to time a stretch of code by.
+ */
+uint64_t metrics_nanos(void);
+
+/* metrics_format
+ * Formats the metrics as lines of text: the requests, the messages sent, the views computed
+ * and displays skipped, and a summary of each histogram.
+ * Inputs:
+ *     - metrics: the metrics
+ *     - requestNames, nrequests: the name of each request counted
+ *     - text: where to write the text
+ *     - size: the size of text; lines that do not fit are cut short
+ * Outputs:
+ *     - Returns the length of the text written.
+ */
+int metrics_format(const metrics_t* metrics, const char* const* requestNames, const int nrequests, char* text, const size_t size);
+
+#endif // __METRICS_H_
@@ -11,7 +11,9 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include "../libs/mem.h"
 #include "../support/message.h"
+#include "metrics.h"
 
 
 // Containing information about nugget piles
@@ -34,9 +36,38 @@ typedef struct client {
     bool onTunnel;  // is the player standing in a tunnel
     int clientsArr_Idx;  // the index of the player in the game structs clients array
     bool quit;  // has this client quit the game
+    int viewRows;  // rows of the client's window on the map, or 0 to see the whole map
+    int viewColumns;  // columns of the client's window on the map
+    unsigned int frame;  // number of the next DISPLAY sent to the client in chunks
+    int chunkBytes;  // largest datagram the client takes a DISPLAY in, or 0 for the largest possible
+    bool layered;  // does the client draw the map itself, from the static map and FRAME messages
+    bool displayPending;  // has the client's display changed since its last DISPLAY, during a batch of keys
+    bool isBot;  // is the player a bot, played by the server itself
+    int sightTop;  // the part of the map last searched for what the player sees (see get_player_visible)
+    int sightLeft;
+    int sightRows;  // 0 until the first search
+    int sightColumns;
     
 } client_t;
 
+// The bots' view of the gold: how far each spot is from the nearest pile left, kept up to date as piles are taken
+typedef struct gold_field {
+    int* distances;  // steps from each spot to the nearest pile left, or -1 if no pile can be reached
+    int* nearest;    // the spot of that pile, row * columns + column, or -1
+    int* queue;      // room to search every spot
+    long long* seeds;  // room for the spots bordering a taken pile's region, each as distance * spots + spot
+    bool* isSeed;    // which spots are among the seeds
+} gold_field_t;
+
+// The distances to the target of the last MOVETO, found only as far out from it as the players who moved toward it
+typedef struct move_field {
+    int target;      // the spot of the target, row * columns + column, or -1
+    int* distances;  // steps from each spot to the target, or -1 if not yet searched (see grid_distancesUntil)
+    int* queue;      // the spots searched, in order
+    int head;        // how many of them the search has gone on from
+    int tail;        // how many of them there are
+} move_field_t;
+
 // Holds game relevant information
 typedef struct game {
     char** grid;  // the global grid map
@@ -48,6 +79,14 @@ typedef struct game {
     int columns;  // how many columns does the grid have
     gold_location_t** locations;  // array of gold nugget location structs
     int totalGoldPiles;  // how many piles of nuggets there are
+    unsigned int randomState;  // the game's own random-number generator, so a seed replays the same game
+    gold_field_t* goldField;  // distances to the gold, for bots; NULL until a bot joins
+    move_field_t* moveField;  // distances to the last MOVETO target; NULL until the first MOVETO
+    mem_arena_t* scratch;  // buffers that live only while one message is handled, such as each DISPLAY
+    mem_pool_t* clientPool;  // the clients, side by side, each reusing the place of one who left
+    mem_pool_t* goldPool;  // the gold piles, side by side; NULL until the gold is loaded
+    int number;  // the game's number in the event log (see events_newGame)
+    metrics_t metrics;  // what the game counts about itself, for STATS and the report at its end
 
 } game_t;
 
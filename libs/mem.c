@@ -8,18 +8,114 @@
  * 2. Variants that 'assert' the result is non-NULL;
  *    if NULL occurs, kick out an error and die.
  *
+ * 3. Scratch arenas, whose blocks are counted as mallocs,
+ *    and whose allocations are counted apart.
+ *
+ * 4. Pools of fixed-size objects, whose slabs are counted as mallocs.
+ *
+ * 5. Compiled with -DMEMPROFILE (make FLAGS=-DMEMPROFILE), a profile of
+ *    the heap by tag: each block carries a header naming the message
+ *    it was allocated with, so mem_free can charge it back.
+ *
  * David Kotz, April 2016, 2017, 2019, 2021
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 #include "mem.h"
 
+/**************** file-local types ****************/
+typedef struct block {
+  struct block* next;     // the next block, in use after this one
+  size_t capacity;        // bytes in data
+  size_t used;            // bytes of data allocated
+  max_align_t data[];     // the memory handed out; aligned for any type
+} block_t;
+
+// a slab of a pool: this header, padded to a cache line, then the objects
+typedef struct slab {
+  struct slab* next;      // the slab allocated before this one
+} slab_t;
+
+// an object on a pool's free list
+typedef struct freeObject {
+  struct freeObject* next;
+} freeObject_t;
+
+#ifdef MEMPROFILE
+// the allocations made with one message: the call sites that pass it
+typedef struct tag {
+  _Atomic(const char*) message;   // the message, or NULL if this slot is free
+  _Atomic long long allocs;       // blocks allocated
+  _Atomic long long bytes;        // bytes allocated
+  _Atomic long long live;         // blocks not yet freed
+  _Atomic long long liveBytes;    // bytes not yet freed
+  _Atomic long long peakBytes;    // most bytes live at once
+} tag_t;
+
+// what precedes each block on the heap
+typedef struct header {
+  tag_t* tag;             // the block's tag
+  size_t size;            // bytes asked for
+  void* base;             // what malloc returned, to free
+} header_t;
+#endif
+
+/**************** file-local constants ****************/
+static const size_t CacheLine = 64;     // bytes in a cache line, on the machines we run on
+#ifdef MEMPROFILE
+static const size_t HeaderRoom = 32;    // room for a header_t, keeping malloc's alignment
+enum { TagSlots = 1024 };               // most distinct messages profiled; more share the last
+static const char* Untagged = "(mem_malloc or mem_calloc, untagged)";
+#endif
+
+/**************** global types ****************/
+typedef struct mem_pool {
+  slab_t* slabs;          // the slabs, newest first
+  freeObject_t* free;     // objects freed, to reuse, most recent first
+  char* next;             // the next object never used, in the newest slab
+  char* end;              // the end of the newest slab
+  size_t slabObjects;     // objects in each slab
+  const char* message;    // the message of each slab's allocation
+  mem_poolStats_t stats;  // how the pool is being used
+} mem_pool_t;
+
+typedef struct mem_arena {
+  block_t* first;         // the blocks, in order of use
+  block_t* current;       // the block allocations now come from
+  size_t blockSize;       // capacity of each new block, unless an allocation needs more
+  size_t inUse;           // bytes allocated since the arena was created or last reset
+} mem_arena_t;
+
 /**************** file-local global variables ****************/
-// track malloc and free across *all* calls within this program.
-static int nmalloc = 0;         // number of successful malloc calls
-static int nfree = 0;           // number of free calls
-static int nfreenull = 0;       // number of free(NULL) calls
+// track malloc and free across *all* calls within this program,
+// from every thread (hence atomic).
+static _Atomic int nmalloc = 0;         // number of successful malloc calls
+static _Atomic int nfree = 0;           // number of free calls
+static _Atomic int nfreenull = 0;       // number of free(NULL) calls
+static _Atomic long narena = 0;         // number of arena allocations
+static _Atomic long long narenabytes = 0; // bytes allocated from arenas
+static _Atomic size_t arenapeak = 0;    // most bytes any arena has held at once
+#ifdef MEMPROFILE
+static FILE* reportFile = NULL;         // where to print the report at exit
+static const char* reportMessage = NULL;
+static tag_t tags[TagSlots];            // an open-addressed table of tags, by message pointer
+#endif
+
+/**************** local functions ****************/
+static block_t* block_new(const size_t capacity, const char* message);
+static void* heap_alloc(const size_t size, const size_t align, const bool zero, const char* message);
+static void heap_free(void* ptr);
+#ifdef MEMPROFILE
+static void report_atExit(void);
+static tag_t* tag_find(const char* message);
+static int compare_tags(const void* a, const void* b);
+#endif
 
 
 /**************** mem_assert ****************/
@@ -51,7 +147,7 @@ mem_assert_const(const void* ptr, const char* message)
 void*
 mem_malloc_assert(const size_t size, const char* message)
 {
-  void* ptr = malloc(size);
+  void* ptr = heap_alloc(size, 0, false, message);
   if (ptr == NULL) {
     fprintf(stderr, "Out of memory: %s\n", message);
     exit (99);
@@ -66,7 +162,7 @@ mem_malloc_assert(const size_t size, const char* message)
 void*
 mem_malloc(const size_t size)
 {
-  void* ptr = malloc(size);
+  void* ptr = heap_alloc(size, 0, false, NULL);
   if (ptr != NULL) {
     nmalloc++;
   }
@@ -78,7 +174,8 @@ mem_malloc(const size_t size)
 void*
 mem_calloc_assert(const size_t nmemb, const size_t size, const char* message)
 {
-  void* ptr = mem_assert(calloc(nmemb, size), message);
+  void* ptr = mem_assert(size == 0 || nmemb <= SIZE_MAX / size ? heap_alloc(nmemb * size, 0, true, message) : NULL,
+                         message);
   nmalloc++;
   return ptr;
 }
@@ -88,7 +185,7 @@ mem_calloc_assert(const size_t nmemb, const size_t size, const char* message)
 void*
 mem_calloc(const size_t nmemb, const size_t size)
 {
-  void* ptr = calloc(nmemb, size);
+  void* ptr = size == 0 || nmemb <= SIZE_MAX / size ? heap_alloc(nmemb * size, 0, true, NULL) : NULL;
   if (ptr != NULL) {
     nmalloc++;
   }
@@ -101,7 +198,7 @@ void
 mem_free(void* ptr)
 {
   if (ptr != NULL) {
-    free(ptr);
+    heap_free(ptr);
     nfree++;
   } else {
     // it's an error to call free(NULL)!
@@ -109,13 +206,381 @@ mem_free(void* ptr)
   }
 }
 
+/**************** mem_arena_new() ****************/
+/* see mem.h for description */
+mem_arena_t*
+mem_arena_new(const size_t blockSize, const char* message)
+{
+  mem_arena_t* arena = mem_malloc_assert(sizeof(mem_arena_t), message);
+  arena->blockSize = blockSize;
+  arena->first = block_new(blockSize, message);
+  arena->current = arena->first;
+  arena->inUse = 0;
+  return arena;
+}
+
+/**************** mem_arena_alloc() ****************/
+/* see mem.h for description */
+void*
+mem_arena_alloc(mem_arena_t* arena, const size_t size, const char* message)
+{
+  // keep every allocation aligned for any type
+  const size_t align = sizeof(max_align_t);
+  const size_t rounded = (size + align - 1) / align * align;
+
+  // move on to the next block, reusing it if it is big enough
+  while (arena->current->capacity - arena->current->used < rounded) {
+    block_t* next = arena->current->next;
+    if (next == NULL || next->capacity < rounded) {
+      block_t* block = block_new(rounded > arena->blockSize ? rounded : arena->blockSize, message);
+      block->next = next;
+      arena->current->next = block;
+      next = block;
+    }
+    next->used = 0;
+    arena->current = next;
+  }
+
+  void* ptr = (char*)arena->current->data + arena->current->used;
+  arena->current->used += rounded;
+  arena->inUse += rounded;
+
+  narena++;
+  narenabytes += rounded;
+  size_t peak = arenapeak;
+  while (arena->inUse > peak && !atomic_compare_exchange_weak(&arenapeak, &peak, arena->inUse)) {
+  }
+  return ptr;
+}
+
+/**************** mem_arena_mark() ****************/
+/* see mem.h for description */
+mem_mark_t
+mem_arena_mark(mem_arena_t* arena)
+{
+  mem_mark_t mark = { arena->current, arena->current->used, arena->inUse };
+  return mark;
+}
+
+/**************** mem_arena_reset() ****************/
+/* see mem.h for description */
+void
+mem_arena_reset(mem_arena_t* arena, const mem_mark_t mark)
+{
+  // the blocks after the mark's stay linked, to be reused
+  arena->current = mark.block;
+  arena->current->used = mark.used;
+  arena->inUse = mark.inUse;
+}
+
+/**************** mem_arena_delete() ****************/
+/* see mem.h for description */
+void
+mem_arena_delete(mem_arena_t* arena)
+{
+  if (arena != NULL) {
+    for (block_t* block = arena->first; block != NULL; ) {
+      block_t* next = block->next;
+      mem_free(block);
+      block = next;
+    }
+    mem_free(arena);
+  }
+}
+
+/**************** block_new() ****************/
+/* Allocate an empty block of an arena, holding capacity bytes.
+ */
+static block_t*
+block_new(const size_t capacity, const char* message)
+{
+  block_t* block = mem_malloc_assert(sizeof(block_t) + capacity, message);
+  block->next = NULL;
+  block->capacity = capacity;
+  block->used = 0;
+  return block;
+}
+
+/**************** mem_pool_new() ****************/
+/* see mem.h for description */
+mem_pool_t*
+mem_pool_new(const size_t objectSize, const size_t slabObjects, const char* message)
+{
+  mem_pool_t* pool = mem_malloc_assert(sizeof(mem_pool_t), message);
+
+  // room for the free list's link; then a size dividing a cache line, or a whole number of lines
+  size_t size = objectSize < sizeof(freeObject_t) ? sizeof(freeObject_t) : objectSize;
+  if (size < CacheLine) {
+    size_t fit = sizeof(max_align_t);
+    while (fit < size) {
+      fit *= 2;
+    }
+    size = fit;
+  } else {
+    size = (size + CacheLine - 1) / CacheLine * CacheLine;
+  }
+
+  pool->slabs = NULL;
+  pool->free = NULL;
+  pool->next = NULL;
+  pool->end = NULL;
+  pool->slabObjects = slabObjects > 0 ? slabObjects : 1;
+  pool->message = message;
+  pool->stats = (mem_poolStats_t){ .objectSize = size };
+  return pool;
+}
+
+/**************** mem_pool_alloc() ****************/
+/* see mem.h for description */
+void*
+mem_pool_alloc(mem_pool_t* pool)
+{
+  void* ptr;
+
+  if (pool->free != NULL) {
+    ptr = pool->free;
+    pool->free = pool->free->next;
+  } else {
+    if (pool->next == pool->end) {
+      // a new slab: its header takes the first cache line, and its size must be a multiple of the alignment
+      const size_t bytes = CacheLine + pool->slabObjects * pool->stats.objectSize;
+      slab_t* slab = mem_assert(heap_alloc((bytes + CacheLine - 1) / CacheLine * CacheLine, CacheLine, false, pool->message),
+                                pool->message);
+      nmalloc++;
+      slab->next = pool->slabs;
+      pool->slabs = slab;
+      pool->next = (char*)slab + CacheLine;
+      pool->end = pool->next + pool->slabObjects * pool->stats.objectSize;
+      pool->stats.slabs++;
+      pool->stats.capacity += pool->slabObjects;
+    }
+    ptr = pool->next;
+    pool->next += pool->stats.objectSize;
+  }
+
+  pool->stats.allocs++;
+  pool->stats.inUse++;
+  if (pool->stats.inUse > pool->stats.peak) {
+    pool->stats.peak = pool->stats.inUse;
+  }
+  return ptr;
+}
+
+/**************** mem_pool_free() ****************/
+/* see mem.h for description */
+void
+mem_pool_free(mem_pool_t* pool, void* ptr)
+{
+  if (ptr != NULL) {
+    freeObject_t* object = ptr;
+    object->next = pool->free;
+    pool->free = object;
+    pool->stats.inUse--;
+  }
+}
+
+/**************** mem_pool_delete() ****************/
+/* see mem.h for description */
+void
+mem_pool_delete(mem_pool_t* pool)
+{
+  if (pool != NULL) {
+    for (slab_t* slab = pool->slabs; slab != NULL; ) {
+      slab_t* next = slab->next;
+      mem_free(slab);
+      slab = next;
+    }
+    mem_free(pool);
+  }
+}
+
+/**************** mem_pool_stats() ****************/
+/* see mem.h for description */
+mem_poolStats_t
+mem_pool_stats(const mem_pool_t* pool)
+{
+  return pool->stats;
+}
+
+/**************** mem_pool_report() ****************/
+/* see mem.h for description */
+void
+mem_pool_report(FILE* fp, const mem_pool_t* pool, const char* message)
+{
+  fprintf(fp, "%s: %zu in use, %zu peak, %zu allocs; %zu slabs of %zu objects of %zu bytes\n",
+          message, pool->stats.inUse, pool->stats.peak, pool->stats.allocs,
+          pool->stats.slabs, pool->slabObjects, pool->stats.objectSize);
+}
+
 /**************** mem_report() ****************/
 /* see mem.h for description */
 void 
 mem_report(FILE* fp, const char* message)
 {
-  fprintf(fp, "%s: %d malloc, %d free, %d free(NULL), %d net\n", 
-          message, nmalloc, nfree, nfreenull, nmalloc - nfree - nfreenull);
+  fprintf(fp, "%s: %d malloc, %d free, %d free(NULL), %d net; "
+          "%ld arena alloc, %lld arena bytes, %zu arena peak\n",
+          message, nmalloc, nfree, nfreenull, nmalloc - nfree - nfreenull,
+          (long)narena, (long long)narenabytes, (size_t)arenapeak);
+
+#ifdef MEMPROFILE
+  // a snapshot of the tags in use, most bytes allocated first
+  static tag_t* sorted[TagSlots];
+  int ntags = 0;
+  for (int i = 0; i < TagSlots; i++) {
+    if (tags[i].message != NULL) {
+      sorted[ntags++] = &tags[i];
+    }
+  }
+  qsort(sorted, ntags, sizeof(tag_t*), compare_tags);
+
+  fprintf(fp, "%14s %10s %10s %12s %12s  %s\n", "bytes", "allocs", "live", "live bytes", "peak bytes", "tag");
+  for (int i = 0; i < ntags; i++) {
+    const char* tag = sorted[i]->message;
+    int length = strlen(tag);
+    if (length > 0 && tag[length - 1] == '\n') {
+      length--;
+    }
+    fprintf(fp, "%14lld %10lld %10lld %12lld %12lld  %.*s\n",
+            (long long)sorted[i]->bytes, (long long)sorted[i]->allocs, (long long)sorted[i]->live,
+            (long long)sorted[i]->liveBytes, (long long)sorted[i]->peakBytes, length, tag);
+  }
+#endif
+}
+
+/**************** mem_reportAtExit() ****************/
+/* see mem.h for description */
+void
+mem_reportAtExit(FILE* fp, const char* message)
+{
+#ifdef MEMPROFILE
+  if (reportFile == NULL) {
+    atexit(report_atExit);
+  }
+  reportFile = fp;
+  reportMessage = message;
+#else
+  (void)fp;
+  (void)message;
+#endif
+}
+
+#ifdef MEMPROFILE
+/**************** report_atExit() ****************/
+/* Print the report that mem_reportAtExit asked for; an atexit handler.
+ */
+static void
+report_atExit(void)
+{
+  mem_report(reportFile, reportMessage);
+}
+#endif
+
+/**************** heap_alloc() ****************/
+/* The allocator under all the others: malloc, or calloc if zero is true,
+ * or, if align is not 0, aligned_alloc of that alignment (of which size
+ * must then be a multiple). Returns NULL if they do.
+ * With MEMPROFILE, each block is preceded by room for a header, which
+ * charges it to the tag of its message.
+ */
+static void*
+heap_alloc(const size_t size, const size_t align, const bool zero, const char* message)
+{
+#ifdef MEMPROFILE
+  // the header lies at the end of the room before the block, which keeps the block's alignment
+  const size_t room = align > HeaderRoom ? align : HeaderRoom;
+  if (size > SIZE_MAX - room) {
+    return NULL;
+  }
+  void* base = align != 0 ? aligned_alloc(align, room + size) : zero ? calloc(1, room + size) : malloc(room + size);
+  if (base == NULL) {
+    return NULL;
+  }
+  void* ptr = (char*)base + room;
+  header_t* header = (header_t*)ptr - 1;
+  header->tag = tag_find(message != NULL ? message : Untagged);
+  header->size = size;
+  header->base = base;
+
+  tag_t* tag = header->tag;
+  tag->allocs++;
+  tag->bytes += size;
+  tag->live++;
+  long long liveBytes = (tag->liveBytes += size);
+  long long peak = tag->peakBytes;
+  while (liveBytes > peak && !atomic_compare_exchange_weak(&tag->peakBytes, &peak, liveBytes)) {
+  }
+  return ptr;
+#else
+  (void)message;
+  return align != 0 ? aligned_alloc(align, size) : zero ? calloc(1, size) : malloc(size);
+#endif
+}
+
+/**************** heap_free() ****************/
+/* Free a block from heap_alloc; with MEMPROFILE, charge it back to its tag.
+ */
+static void
+heap_free(void* ptr)
+{
+#ifdef MEMPROFILE
+  header_t* header = (header_t*)ptr - 1;
+  header->tag->live--;
+  header->tag->liveBytes -= header->size;
+  free(header->base);
+#else
+  free(ptr);
+#endif
+}
+
+#ifdef MEMPROFILE
+/**************** tag_find() ****************/
+/* Return the tag of a message, adding it to the table if it is new.
+ * Call sites pass string literals, so the message's address identifies
+ * it; a message with the same text at another address (in another file,
+ * say) gets a tag of its own. Safe from any thread, without locks.
+ */
+static tag_t*
+tag_find(const char* message)
+{
+  size_t slot = ((uintptr_t)message >> 3) % (TagSlots - 1);
+  for (int probes = 0; probes < TagSlots - 1; probes++) {
+    const char* found = atomic_load(&tags[slot].message);
+    if (found == message) {
+      return &tags[slot];
+    }
+    if (found == NULL) {
+      // claim the free slot, unless another thread just claimed it
+      if (atomic_compare_exchange_strong(&tags[slot].message, &found, message) || found == message) {
+        return &tags[slot];
+      }
+    }
+    slot = (slot + 1) % (TagSlots - 1);
+  }
+
+  // the table is full: the last slot takes the rest
+  const char* found = NULL;
+  atomic_compare_exchange_strong(&tags[TagSlots - 1].message, &found, "(other tags)");
+  return &tags[TagSlots - 1];
+}
+
+/**************** compare_tags() ****************/
+/* qsort comparator of tag pointers: most bytes allocated first.
+ */
+static int
+compare_tags(const void* a, const void* b)
+{
+  long long bytesA = (*(tag_t* const*)a)->bytes;
+  long long bytesB = (*(tag_t* const*)b)->bytes;
+  return (bytesA < bytesB) - (bytesA > bytesB);
+}
+#endif
+
+/**************** mem_allocs() ****************/
+/* see mem.h for description */
+int
+mem_allocs(void)
+{
+  return nmalloc;
 }
 
 /**************** mem_net() ****************/
@@ -14,6 +14,16 @@
  *    that needs to defensively check function parameters that
  *    "should never be NULL".
  *
+ * 4. Scratch arenas: a bump allocator for short-lived buffers,
+ *    released all at once by resetting the arena to a mark.
+ *
+ * 5. Pools: slabs of fixed-size objects, with a free list,
+ *    so that objects of one kind lie together and are reused.
+ *
+ * 6. A heap profiler, compiled in with -DMEMPROFILE (make FLAGS=-DMEMPROFILE):
+ *    every allocation is charged to the tag of its 'message' parameter,
+ *    and mem_report prints a table of the tags.
+ *
  * David Kotz, April 2016, 2017, 2019, 2021
  */
 
@@ -23,6 +33,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/**************** global types ****************/
+typedef struct mem_arena mem_arena_t;  // opaque to users of the module
+typedef struct mem_pool mem_pool_t;    // opaque to users of the module
+
+/* How a pool is being used; see mem_pool_stats. */
+typedef struct mem_poolStats {
+  size_t objectSize;  // bytes each object takes in its slab
+  size_t slabs;       // slabs allocated
+  size_t capacity;    // objects the slabs hold
+  size_t inUse;       // objects allocated and not yet freed
+  size_t peak;        // most objects in use at once
+  size_t allocs;      // calls to mem_pool_alloc
+} mem_poolStats_t;
+
+/* A point in an arena's allocations, to reset it to; see mem_arena_mark. */
+typedef struct mem_mark {
+  void* block;        // the block then in use
+  size_t used;        // bytes then used of that block
+  size_t inUse;       // bytes then allocated from the whole arena
+} mem_mark_t;
+
 /**************** mem_assert **************************/
 /* If pointer p is NULL, print error message to stderr and die,
  * otherwise, return p unchanged.  Works nicely as a pass-through:
@@ -98,10 +129,125 @@ void mem_free(void* ptr);
  * We assume:
  *   caller provides a FILE open for writing, and message suitable for printf.
  * We format and print a report to that FILE, indicating the number of calls
- * to mem_malloc/calloc and of calls to mem_free, and the net difference.
+ * to mem_malloc/calloc and of calls to mem_free, and the net difference;
+ * then the number of calls to mem_arena_alloc, the bytes they allocated,
+ * and the most bytes any arena held at once.
+ * With MEMPROFILE, we follow that with a table of every tag (the message
+ * passed to mem_malloc_assert and the like, which names the call site),
+ * most bytes allocated first: the bytes and blocks allocated with it,
+ * the blocks and bytes still live, and the most bytes live at once.
  */
 void mem_report(FILE* fp, const char* message);
 
+/**************** mem_reportAtExit() ****************/
+/* With MEMPROFILE, print mem_report(fp, message) when the program exits;
+ * otherwise, do nothing. Call it again to change fp or message.
+ */
+void mem_reportAtExit(FILE* fp, const char* message);
+
+/**************** mem_arena_new() ****************/
+/* Create a scratch arena, which hands out memory by bumping a pointer
+ * through large blocks, and takes it all back at once (mem_arena_reset).
+ * Caller provides:
+ *   the size of each block, the most the arena holds before it
+ *   mallocs another (a larger allocation gets a block of its own);
+ *   a message string suitable for printf, as in mem_malloc_assert.
+ * We return:
+ *   the new arena, which the caller must mem_arena_delete.
+ * We exit if any error, after printing to stderr.
+ * Notes:
+ *   an arena is not thread-safe; each thread should use its own.
+ *   Blocks are kept when the arena is reset, and reused, so an arena
+ *   that has grown to its steady-state size calls malloc no more.
+ */
+mem_arena_t* mem_arena_new(const size_t blockSize, const char* message);
+
+/**************** mem_arena_alloc() ****************/
+/* Like mem_malloc_assert, but allocate from an arena.
+ * We return:
+ *   a pointer to size bytes, aligned for any type, valid until the
+ *   arena is reset to a mark taken before this call, or deleted.
+ * We exit if the arena needs another block and malloc fails.
+ * We track the number of calls and the bytes allocated - see mem_report().
+ */
+void* mem_arena_alloc(mem_arena_t* arena, const size_t size, const char* message);
+
+/**************** mem_arena_mark() ****************/
+/* Return a mark of the arena's allocations so far.
+ */
+mem_mark_t mem_arena_mark(mem_arena_t* arena);
+
+/**************** mem_arena_reset() ****************/
+/* Free, all at once, everything allocated from the arena since the mark.
+ * We assume:
+ *   marks are reset in the reverse order they were taken, as a stack.
+ */
+void mem_arena_reset(mem_arena_t* arena, const mem_mark_t mark);
+
+/**************** mem_arena_delete() ****************/
+/* Free the arena and all its blocks; NULL is ignored.
+ */
+void mem_arena_delete(mem_arena_t* arena);
+
+/**************** mem_pool_new() ****************/
+/* Create a pool of objects of one size, allocated from slabs of
+ * slabObjects objects each.
+ * Caller provides:
+ *   the size of each object, e.g., sizeof(client_t);
+ *   how many objects each slab holds (the expected number, say);
+ *   a message string suitable for printf, as in mem_malloc_assert.
+ * We return:
+ *   the new pool, which the caller must mem_pool_delete.
+ * We exit if any error, after printing to stderr.
+ * Notes:
+ *   slabs are aligned to a cache line, and each object is padded so
+ *   that no object smaller than a line straddles two, and larger ones
+ *   start on a line of their own.
+ *   A pool is not thread-safe; each thread should use its own.
+ */
+mem_pool_t* mem_pool_new(const size_t objectSize, const size_t slabObjects, const char* message);
+
+/**************** mem_pool_alloc() ****************/
+/* Like mem_malloc_assert, but allocate one object from a pool:
+ * the object last freed, if any, else the next in the newest slab,
+ * else the first of a new slab.
+ * We return:
+ *   a pointer to the (uninitialized) object.
+ * We exit if the pool needs another slab and malloc fails.
+ */
+void* mem_pool_alloc(mem_pool_t* pool);
+
+/**************** mem_pool_free() ****************/
+/* Return an object to its pool, for the next mem_pool_alloc; NULL is ignored.
+ * We assume:
+ *   caller provides an object allocated from this pool.
+ */
+void mem_pool_free(mem_pool_t* pool, void* ptr);
+
+/**************** mem_pool_delete() ****************/
+/* Free the pool and all its slabs, with any objects still in use;
+ * NULL is ignored.
+ */
+void mem_pool_delete(mem_pool_t* pool);
+
+/**************** mem_pool_stats() ****************/
+/* Return how the pool is being used.
+ */
+mem_poolStats_t mem_pool_stats(const mem_pool_t* pool);
+
+/**************** mem_pool_report() ****************/
+/* Print a one-line report of a pool's statistics to fp, after message.
+ */
+void mem_pool_report(FILE* fp, const mem_pool_t* pool, const char* message);
+
+/**************** mem_allocs() ****************/
+/* Return how many blocks have been allocated from the heap so far:
+ * the calls to mem_malloc/calloc, and the blocks that arenas and
+ * pools took to grow. Compare two counts to tell whether the code
+ * between them allocated. We count from every thread.
+ */
+int mem_allocs(void);
+
 /**************** mem_net() ****************/
 /* Return the current net malloc-free counts.
  * We assume:
@@ -0,0 +1,132 @@
+/*
+eventdump.c
+decodes the binary event log the server writes (see common/events.h), as text or as CSV
+
+Each record becomes one line: as text, its time since the log was opened, its game, its event,
+and the fields that apply to that event; as CSV, every field, with the absolute time of each event,
+for a spreadsheet or a script to take apart.
+
+Team 9: Plankton, May 2023
+*/
+
+#define _POSIX_C_SOURCE 200809L // for getopt, localtime_r
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../common/events.h"
+
+
+/**************** constants ****************/
+static const char* Usage = "Call using the format ./eventdump [-c] events\n"
+    "  -c  print comma-separated values, with a header line, in place of text\n";
+
+
+/**************** function prototypes ****************/
+static void print_text(const event_t* event);
+static void print_csv(const event_t* event, uint64_t epochMicros);
+
+
+/**************** functions ****************/
+/**
+ * @brief Parses arguments, then prints every record of the event log.
+ *
+ * @param argc
+ * @param argv
+ * @return int - 0 on success, 1 if the file is no event log
+ */
+int
+main(const int argc, char* argv[])
+{
+    bool csv = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "c")) != -1){
+        switch (opt) {
+            case 'c': csv = true; break;
+            default:
+                fprintf(stderr, "Invalid option provided. %s", Usage);
+                exit(1);
+        }
+    }
+    if (optind != argc - 1){
+        fprintf(stderr, "Invalid arguments provided. %s", Usage);
+        exit(1);
+    }
+
+    FILE* fp = fopen(argv[optind], "rb");
+    uint64_t epochMicros;
+    if (fp == NULL || !events_readHeader(fp, &epochMicros)){
+        fprintf(stderr, "Error. %s is no event log this program can read\n", argv[optind]);
+        if (fp != NULL){
+            fclose(fp);
+        }
+        exit(1);
+    }
+
+    if (csv){
+        printf("unix_us,us,game,event,slot,row,column,bytes,value\n");
+    }
+    else {
+        time_t opened = epochMicros / 1000000;
+        struct tm local;
+        char when[64];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&opened, &local));
+        printf("# event log opened %s\n", when);
+    }
+
+    // a truncated last record (the server was killed mid-write) is the end
+    event_t event;
+    while (fread(&event, sizeof(event), 1, fp) == 1){
+        if (csv){
+            print_csv(&event, epochMicros);
+        }
+        else {
+            print_text(&event);
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * @brief Prints an event as a line of text, with only the fields that apply to it.
+ */
+static void
+print_text(const event_t* event)
+{
+    printf("%12.6f  game %-3u %-9s", event->micros / 1e6, event->game, events_typeName(event->type));
+    if (event->slot >= 0){
+        printf("  slot %d", event->slot);
+    }
+    if (event->row >= 0){
+        printf("  %s %d,%d", event->type == Event_GameStart ? "size" : "at", event->row, event->column);
+    }
+    if (event->bytes > 0){
+        printf("  %u bytes", event->bytes);
+    }
+
+    switch (event->type) {
+        case Event_GameStart: printf("  gold %d", event->value); break;
+        case Event_GameOver:  printf("  players %d", event->value); break;
+        case Event_Move:      printf("  key %c", event->value); break;
+        case Event_Gold:      printf("  nuggets %d", event->value); break;
+        case Event_Quit:      printf("  gold %d", event->value); break;
+        default: break;
+    }
+    putchar('\n');
+}
+
+/**
+ * @brief Prints every field of an event as a line of comma-separated values.
+ */
+static void
+print_csv(const event_t* event, uint64_t epochMicros)
+{
+    printf("%llu,%llu,%u,%s,%d,%d,%d,%u,%d\n",
+           (unsigned long long)(epochMicros + event->micros), (unsigned long long)event->micros,
+           event->game, events_typeName(event->type), event->slot, event->row, event->column,
+           event->bytes, event->value);
+}
@@ -0,0 +1,592 @@
+/*
+ * lobby.c - hosting several games in one server process
+ * routes each client's messages, by address, to the game it joined
+ * see lobby.h for the interface
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#define _GNU_SOURCE     // for pthreads (Linux)
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "../libs/mem.h"
+#include "../support/message.h"
+#include "../support/spsc.h"
+#include "lobby.h"
+
+
+/**************** constants ****************/
+static const size_t WorkerQueueBytes = 1 << 20; // queue of routed messages
+static const size_t AdmissionQueueBytes = 1 << 16; // queue of joins a worker has handled
+static const int ReceiveBatch = 32;             // max datagrams per receive
+static const size_t MinRoutes = 64;             // initial size of route table
+
+
+/**************** types ****************/
+// One concurrently running game
+typedef struct slot {
+    game_t* game;                   // the game, touched only by its worker
+    const char* mapFilename;        // map on which it is played
+    int worker;                     // index of its worker, -1 if run inline
+    _Atomic unsigned generation;    // bumped by the worker at each restart
+    _Atomic int joined;             // players who have joined the current game (seats taken), published by the worker
+    _Atomic int active;             // of them, those still playing
+    _Atomic int handledJoins;       // PLAYs the worker has handled, in any generation
+
+    // the lobby's view of the game, touched only by the lobby thread
+    int routedJoins;                // PLAYs of new clients routed to the game
+} slot_t;
+
+// Where one client's messages go
+typedef struct route {
+    addr_t addr;                    // the client
+    int slot;                       // index of its game
+    unsigned generation;            // generation of the game it joined
+    bool used;                      // is this entry of the table in use?
+} route_t;
+
+// A worker thread, its queue of messages routed by the lobby, and its queue of joins handled, back to the lobby
+typedef struct worker {
+    pthread_t thread;
+    spsc_t* queue;
+    spsc_t* admissions;
+    lobby_t* lobby;
+} worker_t;
+
+// A message as queued for a worker: its game, address, and text; or a tick of the game
+typedef struct routed {
+    int slot;
+    bool tick;
+    bool join;                      // the first message of a new client (PLAY or SPECTATE)
+    addr_t addr;
+    char message[];
+} routed_t;
+
+// A join as the worker handled it: the generation of the game that the client joined
+typedef struct admission {
+    addr_t addr;
+    int slot;
+    unsigned generation;
+} admission_t;
+
+struct lobby {
+    slot_t* slots;                  // the games
+    int nslots;
+    worker_t* workers;              // the worker threads
+    int nworkers;
+    int maxPlayers;                 // players that fit in one game
+    lobby_game_ops_t ops;           // how to start, play, and end a game
+
+    route_t* routes;                // open-addressed table of routes
+    size_t maxroutes;               // size of the table (a power of two)
+    size_t nroutes;                 // entries in use
+    int nextSpectator;              // game to which the next spectator goes
+    int dropped;                    // messages dropped: worker queue full
+};
+
+
+/**************** function prototypes ****************/
+static bool route_message(void* arg, const addr_t from, const char* message);
+static bool handle_stop(void* arg);
+static bool handle_tick(void* arg);
+static route_t* find_route(lobby_t* lobby, const addr_t addr);
+static void drain_admissions(lobby_t* lobby);
+static void publish_players(slot_t* slot);
+static void grow_routes(lobby_t* lobby);
+static int assign_player(lobby_t* lobby);
+static int assign_spectator(lobby_t* lobby);
+static bool is_request(const char* message, const char* request);
+static void play(lobby_t* lobby, slot_t* slot, const addr_t from, const char* message);
+static void tick(lobby_t* lobby, slot_t* slot);
+static void restart(lobby_t* lobby, slot_t* slot);
+static void admit(worker_t* worker, const routed_t* routed);
+static void* worker_thread(void* arg);
+
+
+/**************** lobby_new ****************/
+lobby_t*
+lobby_new(const int ngames, char** mapFiles, const int nmaps,
+          const int nworkers, const int maxPlayers,
+          const lobby_game_ops_t* ops)
+{
+    if (ngames < 1 || nmaps < 1 || nworkers < 0 || ops == NULL){
+        fprintf(stderr, "Error. Invalid arguments to lobby_new\n");
+        return NULL;
+    }
+
+    lobby_t* lobby = mem_malloc_assert(sizeof(lobby_t), "Error allocating memory in lobby_new.\n");
+    lobby->nslots = ngames;
+    lobby->nworkers = nworkers < ngames ? nworkers : ngames;
+    lobby->maxPlayers = maxPlayers;
+    lobby->ops = *ops;
+    lobby->maxroutes = MinRoutes;
+    lobby->nroutes = 0;
+    lobby->routes = mem_calloc_assert(lobby->maxroutes, sizeof(route_t), "Error allocating memory in lobby_new.\n");
+    lobby->nextSpectator = 0;
+    lobby->dropped = 0;
+
+    // start every game before any worker runs
+    lobby->slots = mem_calloc_assert(ngames, sizeof(slot_t), "Error allocating memory in lobby_new.\n");
+    for (int i = 0; i < ngames; i++){
+        slot_t* slot = &lobby->slots[i];
+        slot->mapFilename = mapFiles[i % nmaps];
+        slot->game = (*ops->startGame)(slot->mapFilename);
+        slot->worker = lobby->nworkers > 0 ? i % lobby->nworkers : -1;
+        atomic_init(&slot->generation, 0);
+        atomic_init(&slot->handledJoins, 0);
+        slot->routedJoins = 0;
+        publish_players(slot);
+    }
+
+    lobby->workers = NULL;
+    if (lobby->nworkers > 0){
+        lobby->workers = mem_calloc_assert(lobby->nworkers, sizeof(worker_t), "Error allocating memory in lobby_new.\n");
+        for (int w = 0; w < lobby->nworkers; w++){
+            worker_t* worker = &lobby->workers[w];
+            worker->lobby = lobby;
+            worker->queue = mem_assert(spsc_new(WorkerQueueBytes), "Error allocating queue in lobby_new.\n");
+            worker->admissions = mem_assert(spsc_new(AdmissionQueueBytes), "Error allocating queue in lobby_new.\n");
+            pthread_create(&worker->thread, NULL, worker_thread, worker);
+        }
+    }
+
+    return lobby;
+}
+
+/**************** lobby_run ****************/
+bool
+lobby_run(lobby_t* lobby, const int sock, const int stopFd)
+{
+    message_loop_t* loop = message_loopNew();
+    bool ok = loop != NULL
+        && message_loopSetBatch(loop, ReceiveBatch)
+        && message_loopAddSocket(loop, sock, lobby, route_message)
+        && message_loopAddInput(loop, stopFd, lobby, handle_stop)
+        && (lobby->ops.tickGame == NULL
+            || message_loopAddTimer(loop, lobby->ops.tickInterval, false, lobby, handle_tick));
+
+    if (ok){
+        ok = message_loopRun(loop);
+    }
+    else {
+        fprintf(stderr, "Error. Could not start the lobby's message loop\n");
+    }
+    message_loopDelete(loop);
+    return ok;
+}
+
+/**************** lobby_delete ****************/
+void
+lobby_delete(lobby_t* lobby)
+{
+    if (lobby == NULL){
+        return;
+    }
+
+    // let each worker finish its queue, then stop it
+    for (int w = 0; w < lobby->nworkers; w++){
+        spsc_close(lobby->workers[w].queue);
+        pthread_join(lobby->workers[w].thread, NULL);
+        spsc_delete(lobby->workers[w].queue);
+        spsc_delete(lobby->workers[w].admissions);
+    }
+    if (lobby->workers != NULL){
+        mem_free(lobby->workers);
+    }
+
+    if (lobby->dropped > 0){
+        fprintf(stderr, "lobby: %d messages dropped\n", lobby->dropped);
+    }
+
+    for (int i = 0; i < lobby->nslots; i++){
+        (*lobby->ops.finishGame)(lobby->slots[i].game);
+    }
+    mem_free(lobby->slots);
+    mem_free(lobby->routes);
+    mem_free(lobby);
+}
+
+/**
+ * @brief Message handler of the lobby: finds (or assigns) the client's game and passes the message to it.
+ * Messages from clients in no game, other than PLAY, SPECTATE, and STATS, are ignored.
+ * `STATS game` from a client in no game that may ask (see lobby_game_ops_t) asks that game (counting from 0;
+ * the first, if none is given) for its metrics, without joining it.
+ *
+ * @param arg - the lobby
+ * @param from - the address of the client who sent the message
+ * @param message - the message string sent from the client
+ * @return false - always, keep looping
+ */
+static bool
+route_message(void* arg, const addr_t from, const char* message)
+{
+    lobby_t* lobby = arg;
+    int s = -1;
+    bool join = false;
+
+    // the games that clients have joined, as their workers report them, before any client is routed by them
+    drain_admissions(lobby);
+    route_t* route = find_route(lobby, from);
+
+    // a known client, whose game has not ended since it joined?
+    if (route->used && route->generation == atomic_load(&lobby->slots[route->slot].generation)){
+        s = route->slot;
+    }
+    else if (is_request(message, "STATS")){
+        s = message[5] == ' ' ? atoi(message + 6) : 0;
+        if (s < 0 || s >= lobby->nslots || !(*lobby->ops.mayAskStats)(from)){
+            return false;
+        }
+    }
+    else {
+        // a new client (or one whose game ended) must join a game
+        if (is_request(message, "PLAY")){
+            s = assign_player(lobby);
+        }
+        else if (is_request(message, "SPECTATE")){
+            s = assign_spectator(lobby);
+        }
+        else {
+            return false;
+        }
+
+        // the generation for now; the game may restart before its worker handles the join,
+        // so the worker reports the generation the client joined (see drain_admissions)
+        join = true;
+        if (!route->used){
+            route->used = true;
+            route->addr = from;
+            lobby->nroutes++;
+        }
+        route->slot = s;
+        route->generation = atomic_load(&lobby->slots[s].generation);
+        if (lobby->nroutes * 2 > lobby->maxroutes){
+            grow_routes(lobby);
+        }
+    }
+
+    slot_t* slot = &lobby->slots[s];
+    if (slot->worker < 0){
+        play(lobby, slot, from, message);
+        return false;
+    }
+
+    // hand it to the worker that owns the game
+    spsc_t* queue = lobby->workers[slot->worker].queue;
+    size_t len = strlen(message) + 1;
+    routed_t* routed = spsc_reserve(queue, sizeof(routed_t) + len);
+    if (routed == NULL){
+        lobby->dropped++; // as if the network had lost it
+        return false;
+    }
+    routed->slot = s;
+    routed->tick = false;
+    routed->join = join;
+    routed->addr = from;
+    memcpy(routed->message, message, len);
+    spsc_commit(queue);
+    if (join && is_request(message, "PLAY")){
+        slot->routedJoins++; // on its way, until the worker counts it handled
+    }
+    return false;
+}
+
+/**
+ * @brief Input handler of the lobby, for stopFd; leaves it readable for other lobbies.
+ *
+ * @param arg - the lobby
+ * @return true - always, stop looping
+ */
+static bool
+handle_stop(void* arg)
+{
+    return true;
+}
+
+/**
+ * @brief Timer handler of the lobby: ticks every game, on the thread that owns it.
+ * A game whose worker's queue is full misses this tick.
+ *
+ * @param arg - the lobby
+ * @return false - always, keep looping
+ */
+static bool
+handle_tick(void* arg)
+{
+    lobby_t* lobby = arg;
+    for (int s = 0; s < lobby->nslots; s++){
+        slot_t* slot = &lobby->slots[s];
+        if (slot->worker < 0){
+            tick(lobby, slot);
+            continue;
+        }
+
+        spsc_t* queue = lobby->workers[slot->worker].queue;
+        routed_t* routed = spsc_reserve(queue, sizeof(routed_t) + 1);
+        if (routed != NULL){
+            routed->slot = s;
+            routed->tick = true;
+            routed->join = false;
+            routed->message[0] = '\0';
+            spsc_commit(queue);
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Finds the route for an address in the open-addressed route table.
+ *
+ * @param lobby - the lobby
+ * @param addr - the client's address
+ * @return route_t* - the client's route, or the unused entry where it belongs
+ */
+static route_t*
+find_route(lobby_t* lobby, const addr_t addr)
+{
+    uint32_t hash = (uint32_t)addr.sin_addr.s_addr * 2654435761u ^ (uint32_t)addr.sin_port * 40503u;
+    size_t i = hash & (lobby->maxroutes - 1);
+
+    while (lobby->routes[i].used && !message_eqAddr(lobby->routes[i].addr, addr)){
+        i = (i + 1) & (lobby->maxroutes - 1);
+    }
+    return &lobby->routes[i];
+}
+
+/**
+ * @brief Brings each route of a client that has joined a game up to date with the generation of the game
+ * that the client joined, as the game's worker reports it.
+ *
+ * @param lobby - the lobby
+ */
+static void
+drain_admissions(lobby_t* lobby)
+{
+    for (int w = 0; w < lobby->nworkers; w++){
+        spsc_t* admissions = lobby->workers[w].admissions;
+        size_t len;
+        const admission_t* admission;
+        while ((admission = spsc_peek(admissions, &len)) != NULL){
+            route_t* route = find_route(lobby, admission->addr);
+            if (route->used && route->slot == admission->slot){
+                route->generation = admission->generation;
+            }
+            spsc_release(admissions);
+        }
+    }
+}
+
+/**
+ * @brief Doubles the route table, leaving behind routes into games that have since ended.
+ *
+ * @param lobby - the lobby
+ */
+static void
+grow_routes(lobby_t* lobby)
+{
+    route_t* old = lobby->routes;
+    size_t oldmax = lobby->maxroutes;
+
+    lobby->maxroutes *= 2;
+    lobby->routes = mem_calloc_assert(lobby->maxroutes, sizeof(route_t), "Error allocating memory in grow_routes.\n");
+    lobby->nroutes = 0;
+
+    for (size_t i = 0; i < oldmax; i++){
+        if (old[i].used && old[i].generation == atomic_load(&lobby->slots[old[i].slot].generation)){
+            *find_route(lobby, old[i].addr) = old[i];
+            lobby->nroutes++;
+        }
+    }
+    mem_free(old);
+}
+
+/**
+ * @brief Publishes how many players have joined the game, and how many are still playing, for the lobby to assign players by.
+ * Called only by the thread that owns the game.
+ *
+ * @param slot - the game
+ */
+static void
+publish_players(slot_t* slot)
+{
+    game_t* game = slot->game;
+    int active = 0;
+    for (int i = 1; i < game->playersJoined + 1; i++){
+        if (game->clients[i] != NULL && !game->clients[i]->quit){
+            active++;
+        }
+    }
+    atomic_store(&slot->joined, game->playersJoined);
+    atomic_store(&slot->active, active);
+}
+
+/**
+ * @brief Chooses a game for a new player: of the games with a seat left, the one with the fewest players still playing.
+ * Players on their way (routed, but not yet handled by the game's worker) count as playing, and as taking a seat.
+ * Seats are not given back when players quit, so if every game is full, the chosen game tells the player so.
+ *
+ * @param lobby - the lobby
+ * @return int - index of the game
+ */
+static int
+assign_player(lobby_t* lobby)
+{
+    int best = 0;
+    int bestActive = 0;
+    bool bestHasSeat = false;
+    for (int i = 0; i < lobby->nslots; i++){
+        slot_t* slot = &lobby->slots[i];
+        // the handled count first, so that a join just handled is counted at worst twice, never not at all
+        int pending = slot->routedJoins - atomic_load(&slot->handledJoins);
+        int active = atomic_load(&slot->active) + pending;
+        bool hasSeat = atomic_load(&slot->joined) + pending < lobby->maxPlayers;
+        if (i == 0 || (hasSeat && !bestHasSeat) || (hasSeat == bestHasSeat && active < bestActive)){
+            best = i;
+            bestActive = active;
+            bestHasSeat = hasSeat;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Chooses a game for a new spectator: each game in turn.
+ *
+ * @param lobby - the lobby
+ * @return int - index of the game
+ */
+static int
+assign_spectator(lobby_t* lobby)
+{
+    int s = lobby->nextSpectator;
+    lobby->nextSpectator = (s + 1) % lobby->nslots;
+    return s;
+}
+
+/**
+ * @brief Is the first word of the message the given request?
+ *
+ * @param message - the message string sent from the client
+ * @param request - the request, e.g., "PLAY"
+ * @return true if so
+ */
+static bool
+is_request(const char* message, const char* request)
+{
+    size_t len = strlen(request);
+    return strncmp(message, request, len) == 0 && (message[len] == ' ' || message[len] == '\0');
+}
+
+/**
+ * @brief Passes a message to its game; when the game ends, starts a fresh one on the same map.
+ * Called only by the thread that owns the game.
+ *
+ * @param lobby - the lobby
+ * @param slot - the game
+ * @param from - the address of the client who sent the message
+ * @param message - the message string sent from the client
+ */
+static void
+play(lobby_t* lobby, slot_t* slot, const addr_t from, const char* message)
+{
+    if ((*lobby->ops.handleMessage)(slot->game, from, message)){
+        restart(lobby, slot);
+    }
+    publish_players(slot);
+}
+
+/**
+ * @brief Ticks a game; when the game ends, starts a fresh one on the same map.
+ * Called only by the thread that owns the game.
+ *
+ * @param lobby - the lobby
+ * @param slot - the game
+ */
+static void
+tick(lobby_t* lobby, slot_t* slot)
+{
+    if ((*lobby->ops.tickGame)(slot->game)){
+        restart(lobby, slot);
+    }
+    publish_players(slot);
+}
+
+/**
+ * @brief Replaces a game that ended with a fresh one on the same map.
+ * Called only by the thread that owns the game.
+ *
+ * @param lobby - the lobby
+ * @param slot - the game
+ */
+static void
+restart(lobby_t* lobby, slot_t* slot)
+{
+    (*lobby->ops.finishGame)(slot->game);
+    slot->game = (*lobby->ops.startGame)(slot->mapFilename);
+    atomic_fetch_add(&slot->generation, 1);
+}
+
+/**
+ * @brief Plays the first message of a new client, after telling the lobby the generation of the game it joins:
+ * the game may have restarted since the lobby routed the client. The report goes back before the game replies,
+ * so the lobby knows the client's game before it sees the client's next message.
+ * Called only by the worker that owns the game.
+ *
+ * @param worker - the worker
+ * @param routed - the message, as routed
+ */
+static void
+admit(worker_t* worker, const routed_t* routed)
+{
+    lobby_t* lobby = worker->lobby;
+    slot_t* slot = &lobby->slots[routed->slot];
+
+    admission_t* admission = spsc_reserve(worker->admissions, sizeof(admission_t));
+    if (admission != NULL){
+        admission->addr = routed->addr;
+        admission->slot = routed->slot;
+        admission->generation = atomic_load(&slot->generation);
+        spsc_commit(worker->admissions);
+    }
+
+    play(lobby, slot, routed->addr, routed->message);
+    if (is_request(routed->message, "PLAY")){
+        atomic_fetch_add(&slot->handledJoins, 1);
+    }
+}
+
+/**
+ * @brief A worker thread: plays each message routed to it, until its queue is closed and empty.
+ *
+ * @param arg - the worker_t
+ * @return void* - NULL
+ */
+static void*
+worker_thread(void* arg)
+{
+    worker_t* worker = arg;
+    lobby_t* lobby = worker->lobby;
+
+    while (spsc_wait(worker->queue)){
+        size_t len;
+        const routed_t* routed = spsc_peek(worker->queue, &len);
+        slot_t* slot = &lobby->slots[routed->slot];
+        if (routed->tick){
+            tick(lobby, slot);
+        }
+        else if (routed->join){
+            admit(worker, routed);
+        }
+        else {
+            play(lobby, slot, routed->addr, routed->message);
+        }
+        spsc_release(worker->queue);
+    }
+    return NULL;
+}
@@ -0,0 +1,81 @@
+/*
+ * lobby.h - header for hosting several games in one server process
+ *
+ * The lobby receives every datagram on one socket.  The first PLAY or
+ * SPECTATE from a new address assigns that client to one of the games
+ * (PLAY to the game with a seat left that has the fewest players still
+ * playing, SPECTATE to each game in turn); after that, the client's
+ * messages are routed to its game by address.  Each worker reports back,
+ * on a second queue, the game each new client actually joined, and
+ * publishes how many players its games have.  A STATS from an address in no game is passed to the game it
+ * names (see engine.h), without joining it, if the address may ask (see mayAskStats below).  Games are spread across
+ * worker threads, each with a lock-free queue of messages from the lobby
+ * (see spsc.h).
+ * When a game ends, its worker starts a fresh game on the same map,
+ * and the clients of the old game are forgotten.  Games may also be
+ * ticked periodically (to move the server's own bots), each by its worker.
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#ifndef __LOBBY_H_
+#define __LOBBY_H_
+
+#include <stdbool.h>
+#include "../support/message.h"
+#include "../common/structs.h"
+
+/**************** types ****************/
+typedef struct lobby lobby_t;  // opaque to users of this module
+
+// How the lobby starts, plays, and ends a game
+typedef struct lobby_game_ops {
+    game_t* (*startGame)(const char* mapFilename);  // new game with gold
+    void (*finishGame)(game_t* game);               // free the game
+    bool (*handleMessage)(void* game, const addr_t from, const char* message);
+                                                    // true at game over
+    bool (*tickGame)(void* game);                   // true at game over;
+                                                    // NULL if not ticked
+    float tickInterval;                             // seconds between ticks
+    bool (*mayAskStats)(const addr_t from);         // may a client in no game
+                                                    // ask one for STATS?
+} lobby_game_ops_t;
+
+/**************** functions ****************/
+
+/* lobby_new
+ * Creates a lobby and starts its games.
+ * Inputs:
+ *   - ngames: number of concurrent games
+ *   - mapFiles, nmaps: game i is played on mapFiles[i % nmaps]
+ *   - nworkers: number of worker threads among which to spread the games;
+ *     zero runs the games on the thread that runs the lobby
+ *   - maxPlayers: number of clients that may join one game as players
+ *   - ops: how to start, play, and end a game
+ * Outputs:
+ *   - Returns the new lobby, or NULL on error.
+ * Notes: the lobby must be freed with lobby_delete.
+ */
+lobby_t* lobby_new(const int ngames, char** mapFiles, const int nmaps,
+                   const int nworkers, const int maxPlayers,
+                   const lobby_game_ops_t* ops);
+
+/* lobby_run
+ * Receives and routes messages on the given socket until stopFd is readable.
+ * Inputs:
+ *   - lobby: the lobby
+ *   - sock: socket on which to receive client messages
+ *   - stopFd: descriptor (e.g., a signalfd) that becomes readable when the
+ *     lobby should stop; it is not read, so it may stop several lobbies
+ * Outputs:
+ *   - Returns true when stopped by stopFd, false on error.
+ */
+bool lobby_run(lobby_t* lobby, const int sock, const int stopFd);
+
+/* lobby_delete
+ * Stops the worker threads, finishing whatever messages are queued,
+ * then ends every game and frees the lobby.
+ */
+void lobby_delete(lobby_t* lobby);
+
+#endif // __LOBBY_H_
@@ -5,12 +5,19 @@ server module for nuggets game: handles overall game logic and all communication
 Team 9: Plankton, May 2023
 */
 
+#define _POSIX_C_SOURCE 200809L // for getopt, signals
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/signalfd.h>
+#include <arpa/inet.h>
 
 
 
@@ -20,30 +27,64 @@ Team 9: Plankton, May 2023
 #include "../support/message.h"
 #include "../common/game.h"
 #include "../common/grid.h"
+#include "../common/engine.h"
+#include "../common/events.h"
+#include "threaded.h"
+#include "lobby.h"
+#include "trace.h"
 
 
 /**************** game variables  ****************/
-static const int MaxNameLength = 50;   // max number of chars in playerName
-static const int MaxPlayers = 26;      // maximum number of players
-static const int GoldTotal = 250;      // amount of gold in the game
-static const int GoldMinNumPiles = 10; // minimum number of gold piles
-static const int GoldMaxNumPiles = 30; // maximum number of gold piles
+static const int ReceiveBatch = 32;    // max datagrams per receive syscall
+static const int MaxScoresLength = 2048; // room for the final scores of every player
+static const size_t LogRingBytes = 1 << 20; // each thread's ring of message-module log lines
+
+static const char* Usage = "Call using the format ./server [-t] [-g games] [-w workers] [-s shards] [-p port] [-m map.txt]... [-r trace] [-e events] [-a bots] [-f hz] [-o host] [-v] map.txt [seed]\n"
+    "                    or ./server -R trace\n"
+    "  -t  threaded mode: receive, run the game, and send on separate threads\n"
+    "  -g  host this many games at once (default: one per map), restarting each when it ends\n"
+    "  -w  spread the games across this many worker threads (default: one per core)\n"
+    "  -m  another map for the games to be played on; may be repeated\n"
+    "  -s  split the games among this many threads, each with its own socket on one shared port\n"
+    "  -p  the port on which to receive messages, with -s (default: any)\n"
+    "  -r  record every message the game accepts, with the map and seed, into a trace file\n"
+    "  -R  replay a trace into the game logic at full speed, without sockets, and check its outcome\n"
+    "  -e  the binary event log of every game, for eventdump to decode (default: server.events)\n"
+    "  -a  fill each game with this many bots, played by the server itself\n"
+    "  -f  how many steps each bot takes per second, with -a (default: 10)\n"
+    "  -o  the IPv4 address of an operator's host, which may ask any game for STATS, as this host may\n"
+    "  -v  log every message sent and received, to stderr\n";
+
+// One of several threads sharing a port, each with its own lobby of games
+typedef struct shard {
+    lobby_t* lobby;     // the shard's games
+    char** mapFiles;    // map of each of the shard's games
+    int sock;           // the shard's socket on the shared port
+    int stopFd;         // readable when the shard should stop
+    pthread_t thread;   // the thread that runs the lobby
+} shard_t;
+
+// Counts of the messages sent during a replay
+typedef struct sent {
+    long messages;
+    long bytes;
+} sent_t;
+
+static unsigned int baseSeed;           // seed of the first game; the others follow from it
+static atomic_uint gamesStarted;        // how many games have been started
+static trace_t* recording = NULL;       // trace of the game, if recording
+static int botsPerGame = 0;             // bots added to each game as it starts
 
 
 /**************** function prototypes  ****************/
-bool handleMessage(void* arg, const addr_t from, const char* message);
-void update_displays(game_t* game, int r1, int c1, int r2, int c2);
-void inform_newClient(client_t* client, game_t* game);
-void send_goldMsg(game_t* game, client_t* client, int goldPickedUp);
-void send_displayMsg(game_t* game, client_t* client);
-char* extract_playerName(const char* message, addr_t clientAddr);
-char* extractRequest(const char* input);
-int handle_movement(client_t* player, char key, game_t* game);
-static void update_previous_spot(client_t* player, game_t* game, char grid_val);
-void send_quitMsg(addr_t clientAddr, int quitCode, bool isSpectator);
-void quit_all(game_t* game, int maxPlayers);
-void handle_quit(client_t* player, game_t* game);
-void send_gameOverMsg(game_t* game, int maxNameLength);
+static game_t* start_game(const char* mapFilename);
+static bool run_lobby(char** mapFiles, int nmaps, int ngames, int nworkers, float botSteps);
+static bool run_shards(char** mapFiles, int nmaps, int ngames, int nshards, int port, float botSteps);
+static int watch_stopSignals(void);
+static void* run_shard(void* arg);
+static bool record_message(void* arg, const addr_t from, const char* message);
+static bool run_replay(const char* traceFilename);
+static void count_sent(void* arg, const addr_t to, const char* message);
 
 
 /**************** functions ****************/
@@ -57,17 +98,81 @@ void send_gameOverMsg(game_t* game, int maxNameLength);
 int
 main(const int argc, char* argv[])
 {
+    // in a build profiling the heap (make FLAGS=-DMEMPROFILE), print the profile on the way out
+    mem_reportAtExit(stderr, "server");
+
+    // parse options: -t runs the server in threaded mode; -g, -w, and -m host several games
+    bool threaded = false;
+    int ngames = 0;  // zero means one per map
+    int nworkers = -1;  // negative means one per core
+    int nshards = 1;
+    int port = 0;  // zero means any port
+    char* recordFilename = NULL;
+    char* eventsFilename = "server.events";
+    float botSteps = 10;  // steps per second of each bot
+    char** mapFiles = mem_malloc_assert(argc * sizeof(char*), "Error allocating memory in main.\n");
+    int nmaps = 1;  // mapFiles[0] is the map given as an argument
+    int opt;
+    addr_t operator;
+    while ((opt = getopt(argc, argv, "tg:w:m:s:p:r:R:e:a:f:o:v")) != -1){
+        switch (opt) {
+            case 't': threaded = true; break;
+            case 'g': ngames = atoi(optarg); break;
+            case 'w': nworkers = atoi(optarg); break;
+            case 's': nshards = atoi(optarg); break;
+            case 'p': port = atoi(optarg); break;
+            case 'm': mapFiles[nmaps++] = optarg; break;
+            case 'r': recordFilename = optarg; break;
+            case 'e': eventsFilename = optarg; break;
+            case 'a': botsPerGame = atoi(optarg); break;
+            case 'f': botSteps = atof(optarg); break;
+            case 'o':
+                memset(&operator, 0, sizeof(operator));
+                if (inet_pton(AF_INET, optarg, &operator.sin_addr) != 1){
+                    fprintf(stderr, "Invalid option provided: -o takes an IPv4 address. %s", Usage);
+                    exit(1);
+                }
+                engine_allowStats(operator);
+                break;
+            case 'v': flog_setLevel(Log_Debug); break;
+            case 'R':
+                // a trace names its own map and seed
+                mem_free(mapFiles);
+                return run_replay(optarg) ? 0 : 1;
+            default:
+                fprintf(stderr, "Invalid option provided. %s", Usage);
+                exit(1);
+        }
+    }
+    if (ngames == 0){
+        ngames = nmaps;
+    }
+    if (ngames < nshards){
+        ngames = nshards;  // every shard hosts at least one game
+    }
+    if (ngames < 1 || nshards < 1 || (ngames > 1 && (threaded || recordFilename != NULL))){
+        fprintf(stderr, "Invalid options provided: -g and -s must be positive, and -t and -r host only one game. %s", Usage);
+        exit(1);
+    }
+    // bots move on a timer of the message loop, which -t has not, and a trace holds only the clients' messages
+    if (botsPerGame < 0 || botsPerGame > MaxPlayers || botSteps <= 0 || (botsPerGame > 0 && (threaded || recordFilename != NULL))){
+        fprintf(stderr, "Invalid options provided: -a from 0 to %d, -f positive, and neither with -t or -r. %s", MaxPlayers, Usage);
+        exit(1);
+    }
 
     // parse args: first argument should be the pathname for a map file, the second is an optional seed for the random-number generator, which must be a positive int if provided
-    
+    const int nargs = argc - optind;
+    char** args = argv + optind;
+
     // make sure there are no more than 2 arguments
-    if (argc != 3 && argc != 2){
-        fprintf(stderr, "Invalid number of arguments provided. Call using the format ./server map.txt [seed]\n");
+    if (nargs != 2 && nargs != 1){
+        fprintf(stderr, "Invalid number of arguments provided. %s", Usage);
 	    exit(1);
     }
 
     // parse the command line, open the file
-    char* mapFilename = argv[1];
+    char* mapFilename = args[0];
+    mapFiles[0] = mapFilename;
     FILE* map_file;
     map_file = fopen(mapFilename, "r");
 
@@ -76,31 +181,106 @@ main(const int argc, char* argv[])
         fprintf(stderr, "Error. File could not be opened\n");
 	    exit(1);
     }
+    for (int i = 1; i < nmaps; i++){
+        FILE* fp = fopen(mapFiles[i], "r");
+        if (fp == NULL){
+            fprintf(stderr, "Error. File %s could not be opened\n", mapFiles[i]);
+            exit(1);
+        }
+        fclose(fp);
+    }
 
 
     // if the user provided a seed and it's a valid number, use it to initialize the random sequence:
-    if (argc == 3 && (atoi(argv[2]) != 0)) {
-        srand(atoi(argv[2]));
+    if (nargs == 2 && (atoi(args[1]) != 0)) {
+        baseSeed = atoi(args[1]);
     }
 
     // if they did not, seed the random-number generator with the process id
     else {
-        srand(getpid());
+        baseSeed = getpid();
     }
+    atomic_init(&gamesStarted, 0);
+
+    // every game's events go to one log, open until the server stops
+    if (!events_open(eventsFilename)){
+        fprintf(stderr, "Error. Could not write the event log %s\n", eventsFilename);
+        exit(1);
+    }
+
+    // host several games, until interrupted
+    if (ngames > 1){
+        fclose(map_file);
+        FILE* fp = fopen("server.log", "w");
+        flog_init(fp);
+        engine_reportMetrics(fp);
+        flog_async(stderr, LogRingBytes);
+        if (nshards > 1){
+            message_initShared(stderr);  // each shard opens its own socket
+        }
+        else {
+            message_init(stderr);
+        }
+        bool ok = nshards > 1 ? run_shards(mapFiles, nmaps, ngames, nshards, port, botSteps)
+                              : run_lobby(mapFiles, nmaps, ngames, nworkers, botSteps);
+        message_done();
+        flog_sync(stderr);
+        flog_done(fp);
+        fclose(fp);
+        events_close();
+        mem_free(mapFiles);
+        return ok ? 0 : 1;
+    }
+    mem_free(mapFiles);
 
     // create a new game first
-    game_t* game = new_game(map_file, MaxPlayers);
-    load_gold(game, GoldTotal, GoldMinNumPiles, GoldMaxNumPiles);
+    game_t* game = start_game(mapFilename);
+
+    // record the game, if asked; recording wraps the message handler
+    bool (*handler)(void*, const addr_t, const char*) = handleMessage;
+    if (recordFilename != NULL){
+        recording = trace_create(recordFilename, mapFilename, baseSeed);
+        if (recording == NULL){
+            fprintf(stderr, "Error. Could not write trace %s\n", recordFilename);
+            exit(1);
+        }
+        handler = record_message;
+    }
 
-    // start logging
+    // start logging; the game's metrics go in the log when it ends
     FILE* fp = fopen("server.log", "w");
     flog_init(fp);
+    engine_reportMetrics(fp);
 
-    // start up message module
+    // start up message module, whose log lines a background thread writes out
+    flog_async(stderr, LogRingBytes);
     message_init(stderr);
-    message_loop(game, 0, NULL, NULL, handleMessage);
+    if (threaded){
+        threaded_run(game, message_socket(), handler);
+    }
+    else {
+        // receive bursts of client messages in batches, rather than one per wakeup
+        message_loop_t* loop = message_loopNew();
+        if (loop == NULL || !message_loopSetBatch(loop, ReceiveBatch)
+            || !message_loopAddSocket(loop, message_socket(), game, handler)
+            || (botsPerGame > 0 && !message_loopAddTimer(loop, 1 / botSteps, false, game, engine_tickBots))){
+            fprintf(stderr, "Error. Could not start the message loop\n");
+            exit(1);
+        }
+        message_loopRun(loop);
+        message_loopDelete(loop);
+    }
     message_done();
-    end_game(game, GoldMaxNumPiles);
+    flog_sync(stderr);
+
+    // finish the trace with the outcome, for replays to check theirs against
+    if (recording != NULL){
+        char scores[MaxScoresLength];
+        format_scores(game, scores, sizeof(scores));
+        trace_recordOutcome(recording, scores);
+        trace_close(recording);
+    }
+    engine_finishGame(game);
 
     // close the file
     fclose(map_file);
@@ -108,576 +288,269 @@ main(const int argc, char* argv[])
     // stop logging
     flog_done(fp);
     fclose(fp);
+    events_close();
     return(0);
 }
 
 /**
- * @brief Handles messages to `PLAY`, `SPECTATE`, or a specific `KEY` sent by a client. 
- * The function allows new players to join the game if the maximum amount of player has not been reached,
- * ensures the most recent spectator is observing the game, and calls `handle_movement` for any key press.
+ * @brief Starts a game on the given map, with its gold placed, and with its own seed following from the server's seed.
  * 
- * @param arg - the game_t struct holding game information
- * @param from - the address of the client who sent the message
- * @param message - the message string sent from the client
- * @return true 
- * @return false 
+ * @param mapFilename - the pathname of the map file
+ * @return game_t* - the new game, which must be freed with `engine_finishGame`
  */
-bool
-handleMessage(void* arg, const addr_t from, const char* message)
+static game_t*
+start_game(const char* mapFilename)
 {
-    game_t* game = arg;
-    char* request = extractRequest(message);
-
-    if (strcmp(request, "PLAY") == 0){
-        mem_free(request);
-        if (game->playersJoined < MaxPlayers){
-
-            char* name = extract_playerName(message, from); 
-            if (name == NULL){
-                FILE* fp = fopen("server.log", "w");
-                flog_v(fp, "player name was invalid");
-                fclose(fp);
-                return false;
-            }
-
-            client_t* player = new_player(game, from, name);
-            mem_free(name);
-
-            char* response = mem_malloc_assert(5, "Error allocating memory in handleMessage.\n");
-            sprintf(response, "OK %c", player->id);
-
-            message_send(from, response);
-            mem_free(response); 
-
-            // send new client messages: grid, gold, display
-            inform_newClient(player, game);
-
-            update_displays(game, player->r, player->c, -1, -1);
-
-        }
-        else {
-            send_quitMsg(from, 2, false);
-        }
+    unsigned int seed = baseSeed + atomic_fetch_add(&gamesStarted, 1) * 2654435761u;
+    game_t* game = engine_startGame(mapFilename, seed);
+    if (game == NULL){
+        fprintf(stderr, "Error. File %s could not be opened\n", mapFilename);
+        exit(1);
     }
-    else if (strcmp(request, "SPECTATE") == 0){
-        mem_free(request);
-        if (game->spectatorActive && game->clients[0] != NULL){
-            send_quitMsg(game->clients[0]->clientAddr, 0, true);
-            delete_client((game->clients)[0], game);
-            game->spectatorActive = false;
-        }
-
-        client_t* spectator = new_spectator(game, from);
-
-        // send new client messages: grid, gold, display
-        inform_newClient(spectator, game);
-
-    }
-    else if (strcmp(request, "KEY") == 0){
-        mem_free(request);
-
-        if (strlen(message) != 5 || !isalpha(message[4])){
-            FILE* fp = fopen("server.log", "w");
-            flog_e(fp, "message was malformed");
-            fclose(fp);
-        }
-
-        client_t* player = find_client(from, game);
-
-        // returns true when all gold is found
-        if (tolower(message[4]) == 'q'){
-            handle_quit(player, game);
-        }
-        else{
-            int movementCode = handle_movement(player, message[4], game);
-            // signifies all gold was found
-            if (movementCode == 2){
-                return true; // causes message loop to end
-            }
-            // if we were able to move and the the key was uppercase
-            else if (movementCode != 1 && isupper(message[4])){
-                // keep moving while possible
-                while (movementCode == 0){
-                    movementCode = handle_movement(player, message[4], game);
-                }
-            }
-            if (movementCode == 2){ // handles edge case of shift moving into the last gold
-                return true; // causes message loop to end
-            }
-        }
-    }
-    else{
-        // log error and move on
-        FILE* fp = fopen("server.log", "w");
-        flog_e(fp, "message was malformed");
-        fclose(fp);
-    }
-    return false;
+    engine_addBots(game, botsPerGame);
+    return game;
 }
 
 /**
- * @brief Sends a message to all players and the spectator to update their local displays by calling `send_displayMsg`.
+ * @brief Hosts several games at once in a lobby, spread across worker threads, until the server receives SIGINT or SIGTERM.
  * 
- * @param game - the game_t struct holding game information
- * @param takes in two positions to check if they changed for the player, second point is optional and will be ignored if -1 is passed for r2 and c2
+ * @param mapFiles - the maps to play on
+ * @param nmaps - how many maps there are
+ * @param ngames - how many games to host
+ * @param nworkers - how many worker threads, or negative for one per core
+ * @param botSteps - how many steps each bot takes per second, if the games have bots
+ * @return true if the lobby ran until stopped
+ * @return false on error
  */
-void
-update_displays(game_t* game, int r1, int c1, int r2, int c2)
+static bool
+run_lobby(char** mapFiles, int nmaps, int ngames, int nworkers, float botSteps)
 {
-    // update spectator if there is one no matter what
-    if (game->spectatorActive){
-        send_displayMsg(game, game->clients[0]);
-    }
-
-    // used to check whether or not the points that changed are visible for the player
-    bool point1_vis = false;
-    bool point2_vis = false; // this second point is options
-
-    for (int i = 1; i < game->playersJoined + 1; i++){
-        client_t* player = game->clients[i];
-
-        if (player != NULL && !player->quit){
-            point1_vis = !isspace(player->grid[r1][c1]); // checks if the player can see that point
-            if (r2 != -1){ //point2_vis is set to true if -1 is passed otherwise we check if it is visible
-                point2_vis = !isspace(player->grid[r2][c2]);
-            }
-            else {
-                point2_vis = true;
-            }
-            // only update visibility if points changed are currently in sight
-            if (point1_vis && point2_vis){
-                if (get_player_visible(game, player)){
-                    send_displayMsg(game, player); // only send a new message if their display changes
-                }
-            }
-
-        }
+    int stopFd = watch_stopSignals();
+    if (stopFd < 0){
+        return false;
     }
-}
-
-/**
- * @brief - Sends new clients a gold message by calling `send_goldMsg` and a display message by calling `send_displayMsg`.
- * 
- * @param client - the client_t struct holding information about the new client
- * @param game -the game_t struct holding game information
- */
-void
-inform_newClient(client_t* client, game_t* game)
-{
-    // send grid message
-    char* gridMsg = mem_malloc_assert(13, "Error allocating memory in inform_newClient.\n"); // allows for max 3 digit row, columns numbers
-    // check size of rows, columns here
-    
-    sprintf(gridMsg, "GRID %d %d", game->rows, game->columns);
-    message_send(client->clientAddr, gridMsg);
-    mem_free(gridMsg);
 
-    // send gold message
-    send_goldMsg(game, client, 0);
-
-    // send display message
-    send_displayMsg(game, client);
-
-}
-
-/**
- * @brief Informs players of the amount of gold they pick up, the amount in their purses, and both players and spectators of the amount left in the game.
- * 
- * @param game - the game_t struct holding game information
- * @param client - the client_t struct holding information about the new client
- * @param goldPickedUp - the amount of gold the client just picked up
- */
-void
-send_goldMsg(game_t* game, client_t* client, int goldPickedUp)
-{
-    // send gold message
-    char* goldMsg = mem_malloc_assert(17, "Error allocating memory in inform_newClient.\n"); // allows for max 3 digit gold count numbers
-    sprintf(goldMsg, "GOLD %d %d %d", goldPickedUp, client->gold, game->goldRemaining); //initial gold message always 0 just picked up
-    message_send(client->clientAddr, goldMsg);
-    mem_free(goldMsg);
-
-}
-
-/**
- * @brief Sends message to update a client's local display.
- * 
- * @param game - the game_t struct holding game information
- * @param client - the client_t struct holding information about the new client
- */
-void
-send_displayMsg(game_t* game, client_t* client)
-{
-    int msgSize;
-    char* map;
-    char* display;
-
-    if (client->isSpectator){
-        map = grid_toStr(game->grid, NULL, game->rows, game->columns);
-    }
-    else{ // assmumes that grid is already up to date
-        map = grid_toStr(game->grid, client->grid, game->rows, game->columns);
+    if (nworkers < 0){
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = ncpus > 0 ? ncpus : 1;
     }
 
-    msgSize = 10 + strlen(map);
-    display = mem_malloc_assert(msgSize, "Error allocating memory in sendDisplayMsg.\n");
-    sprintf(display, "DISPLAY\n%s", map);
-    mem_free(map);
-
-    message_send(client->clientAddr, display);
-    mem_free(display);
-
+    // games with bots are ticked as often as the bots step; the bots' seats are not for clients
+    lobby_game_ops_t ops = { start_game, engine_finishGame, handleMessage,
+                             botsPerGame > 0 ? engine_tickBots : NULL, 1 / botSteps, engine_mayAskStats };
+    lobby_t* lobby = lobby_new(ngames, mapFiles, nmaps, nworkers, MaxPlayers - botsPerGame, &ops);
+    bool ok = lobby != NULL && lobby_run(lobby, message_socket(), stopFd);
+    lobby_delete(lobby);
+    close(stopFd);
+    return ok;
 }
 
 /**
- * @brief Extracts each player's name when they first join the game, storing the string up to a maximum of 50 characters.
+ * @brief Hosts several games split among threads that share one port with SO_REUSEPORT, until the server receives SIGINT or SIGTERM.
+ * Each shard thread has its own socket and its own lobby, and plays its games itself; the kernel steers each client's datagrams,
+ * by a hash of the client's address, to the same shard every time, so each client stays with the shard that owns its game.
  * 
- * @param message - the message string received from a client
- * @param clientAddr - the client's address
- * @return char* - the name extracted from the message
+ * @param mapFiles - the maps to play on
+ * @param nmaps - how many maps there are
+ * @param ngames - how many games to host, at least one per shard
+ * @param nshards - how many shard threads
+ * @param port - the port to share, or zero for any
+ * @param botSteps - how many steps each bot takes per second, if the games have bots
+ * @return true if the shards ran until stopped
+ * @return false on error
  */
-char*
-extract_playerName(const char* message, addr_t clientAddr)
+static bool
+run_shards(char** mapFiles, int nmaps, int ngames, int nshards, int port, float botSteps)
 {
-    bool reachedNameStart = false;
-    bool emptyName = true;
-    char* name = mem_malloc_assert(MaxNameLength + 1, "Error allocating memory in extract_playerName.\n");
-    int curr_nameLength = 0;
-
-    for (int i = 0; i < (int)strlen(message); i++){
-        if (isspace(message[i]) && !reachedNameStart){
-            reachedNameStart = true;
-            continue;
-        }
-        else if (reachedNameStart && !isspace(message[i]) && emptyName){
-            emptyName = false;
-        }
+    int stopFd = watch_stopSignals();
+    if (stopFd < 0){
+        return false;
+    }
 
-        if (reachedNameStart){
-            if (curr_nameLength < MaxNameLength){
-                if(!isgraph(message[i]) && !isblank(message[i])){
-                    name[curr_nameLength] = '_';
-                }
-                else{
-                    name[curr_nameLength] = message[i];
-                }
-                curr_nameLength++;
-            }
-            else{
-                break;
-            }
+    // bind every socket before any datagram is steered: the kernel numbers them in order of binding
+    shard_t* shards = mem_calloc_assert(nshards, sizeof(shard_t), "Error allocating memory in run_shards.\n");
+    for (int k = 0; k < nshards; k++){
+        shards[k].sock = message_openShared(port);
+        if (shards[k].sock == 0){
+            fprintf(stderr, "Error. Could not share port %d\n", port);
+            exit(1);
         }
+        port = message_port(shards[k].sock);  // the others join the first
     }
-    name[curr_nameLength] = '\0';
-    
-    if(emptyName){
-        send_quitMsg(clientAddr, 3, false);
-        mem_free(name);
-        return NULL;
-    }
-
-    return name;
-}
-
-/**
- * @brief Called by `handleMessage` to handle each request (message) of a client playing the game.
- * 
- * @param input - the whole string received from the client
- * @return char* - the extracted request string sent from the client
- */
-char* 
-extractRequest(const char* input) 
-{
-    if (input == NULL || input[0] == '\0') {
-        // Handle empty input string or null pointer
-        return NULL;
+    if (!message_steerBySource(shards[0].sock, nshards)){
+        fprintf(stderr, "Warning. Steering clients by the kernel's own hash\n");
     }
-
-    int length = strlen(input);
-    int wordEndIndex = -1;
-
-    // Find the end index of the first word
-    for (int i = 0; i < length; i++) {
-        if (input[i] == ' ') {
-            wordEndIndex = i;
-            break;
+    fprintf(stderr, "%d shards ready at port %d\n", nshards, port);
+
+    // deal the games out to the shards, and the maps out to the games
+    // games with bots are ticked as often as the bots step; the bots' seats are not for clients
+    lobby_game_ops_t ops = { start_game, engine_finishGame, handleMessage,
+                             botsPerGame > 0 ? engine_tickBots : NULL, 1 / botSteps, engine_mayAskStats };
+    for (int k = 0; k < nshards; k++){
+        int shardGames = (ngames - k + nshards - 1) / nshards;
+        shards[k].mapFiles = mem_malloc_assert(shardGames * sizeof(char*), "Error allocating memory in run_shards.\n");
+        for (int j = 0; j < shardGames; j++){
+            shards[k].mapFiles[j] = mapFiles[(k + j * nshards) % nmaps];
         }
+        shards[k].lobby = mem_assert(lobby_new(shardGames, shards[k].mapFiles, shardGames, 0, MaxPlayers - botsPerGame, &ops), "Error creating lobby in run_shards.\n");
+        shards[k].stopFd = stopFd;
+        pthread_create(&shards[k].thread, NULL, run_shard, &shards[k]);
     }
 
-    if (wordEndIndex == -1) {
-        // If no space is found, the entire input is considered as the first word
-        wordEndIndex = length;
+    for (int k = 0; k < nshards; k++){
+        pthread_join(shards[k].thread, NULL);
+        lobby_delete(shards[k].lobby);
+        mem_free(shards[k].mapFiles);
+        message_closeSocket(shards[k].sock);
     }
-
-    // Allocate memory for the new string
-    char* firstWord = mem_malloc_assert((wordEndIndex + 1) * sizeof(char), "Error allocating memory in extractFirstWord.\n");
-
-
-    // Copy the first word into the new string
-    strncpy(firstWord, input, wordEndIndex);
-    firstWord[wordEndIndex] = '\0';  // Null-terminate the string
-
-    return firstWord;
+    mem_free(shards);
+    close(stopFd);
+    return true;
 }
 
 /**
- * @brief Sends quitting message and removes a client from the game, updating the displays of remaining clients to reflect changes.
+ * @brief A shard thread: runs its lobby on its own socket until stopped.
  * 
- * @param game - the game_t struct holding game information
- * @param player - the client_t struct holding information about the new client
+ * @param arg - the shard_t
+ * @return void* - NULL
  */
-void 
-handle_quit(client_t* player, game_t* game)
+static void*
+run_shard(void* arg)
 {
-    send_quitMsg(player->clientAddr, 1, player->isSpectator);
-    
-    if (!player->isSpectator){
-        // reset spot
-        if (player->onTunnel){
-            change_spot(game, player->r, player->c, '#');
-        }
-        else{
-            change_spot(game, player->r, player->c, '.');
-        }
-    }
-
-    player->quit = true;
-
-    update_displays(game, player->r, player->c, -1, -1);
+    shard_t* shard = arg;
+    lobby_run(shard->lobby, shard->sock, shard->stopFd);
+    return NULL;
 }
 
 /**
- * @brief Handles the action a player whenever they press `Q` for quitting or a key for moving within the grid. 
- * When moving, the function updates a player's position, visibility, and handles the cases when a player steps on gold or another player.
+ * @brief Blocks SIGINT and SIGTERM in this thread and every thread it creates later, and watches for them on a signalfd instead.
  * 
- * @param player- the client_t struct holding information about the new client
- * @param key - the key entered by the client
- * @param game - the game_t struct holding game information
- * @return int - a code representing the result of the move: 0 means success, 1 means unable to move, 2 means game over
+ * @return int - the signalfd, readable once a stop signal arrives; -1 on error
  */
-int
-handle_movement(client_t* player, char key, game_t* game)
+static int
+watch_stopSignals(void)
 {
-
-    int newPos_r = player->r;
-    int newPos_c = player->c;
-
-    switch (tolower(key)) {
-        // update new Pos based on the key inputted
-        case 'h': newPos_c--; break;
-        case 'l': newPos_c++; break;
-        case 'j': newPos_r++; break;
-        case 'k': newPos_r--; break;
-        case 'y': newPos_c--; newPos_r--; break;
-        case 'u': newPos_c++; newPos_r--; break;
-        case 'b': newPos_c--; newPos_r++; break;
-        case 'n': newPos_c++; newPos_r++; break;
-        default: return 1;
-    }
-
-    char grid_val = get_grid_value(game, newPos_r, newPos_c);
-
-    if (grid_val == '+' || grid_val == '-' || grid_val == '|' || grid_val == ' '){
-        return 1; // code meaning unable to move
-    }
-    else if (grid_val == '.' || grid_val == '#'){
-        // change the spot the player came from back
-        update_previous_spot(player, game, grid_val);
-        
-        // change the global grid on the spot they are now on to be their letter
-        change_spot(game, newPos_r, newPos_c, player->id);
-
-        int pr = player->r;
-        int pc = player->c;
-
-        // update the player's position in the player struct
-        update_position(player, newPos_r, newPos_c);
-
-        // call update function
-        update_displays(game, pr, pc, newPos_r, newPos_c);
-        
-    }
-    else if (isalpha(grid_val)){
-        // find the player there using a game function
-        client_t* other_player = find_player(grid_val, game);
-
-        // switch the positions of the two players
-        update_position(other_player, player->r, player->c);
-        update_position(player, newPos_r, newPos_c);
-
-        // update the player's records on the spot they stand on 
-        bool player_OnTunnel = player->onTunnel;
-        player->onTunnel = other_player->onTunnel;
-        other_player->onTunnel = player_OnTunnel;
-
-        // update the global grid to reflect change
-        change_spot(game, player->r, player->c, player->id);
-        change_spot(game, other_player->r, other_player->c, other_player->id);
-
-        // call update function
-        update_displays(game, other_player->r, other_player->c, player->r, player->c);
-
-
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+
+    int stopFd = signalfd(-1, &stopSignals, SFD_CLOEXEC);
+    if (stopFd < 0){
+        fprintf(stderr, "Error. Could not watch for signals\n");
     }
-    else if (grid_val == '*'){
-        int nuggetsFound = update_gold(game, player, newPos_r, newPos_c, GoldMaxNumPiles);
-
-        if (nuggetsFound < 0){
-            // attempted to access a spot that wasn't a gold location
-            FILE* fp = fopen("server.log", "w");
-            flog_e(fp, "tried to access a spot that wasn't a gold location.");
-            fclose(fp);
-            return 0;
-        }
-        
-        // update the client that just picked up gold
-        send_goldMsg(game, player, nuggetsFound);
-
-        // update the other clients about the gold counts
-        for (int i = 0; i < game->playersJoined + 1; i++){
-            if (game->clients[i] != NULL && ((game->clients)[i])->id != player->id && !((game->clients[i])->quit)){
-                send_goldMsg(game, (game->clients)[i], 0);
-            }
-        }
-                
-        // change the spot the player came from back
-        update_previous_spot(player, game, grid_val);
-        
-        // change the global grid on the spot they are now on to be their letter
-        change_spot(game, newPos_r, newPos_c, player->id);
-
-        int pr = player->r;
-        int pc = player->c;
-
-        // update the player's position in the player struct
-        update_position(player, newPos_r, newPos_c);
-
-        // call update function
-        update_displays(game, pr, pc, newPos_r, newPos_c);
-
-
-        if (game->goldRemaining == 0){
-            send_gameOverMsg(game, MaxNameLength);
-            return 2; // code meaning game over
-        }
-
-    }
-    
-
-    return 0; // code meaning sucessful move 
+    return stopFd;
 }
 
 /**
- * @brief Sends quit messages to all the clients when the game is over.
+ * @brief Message handler when recording: appends the message to the trace, then handles it as usual.
+ * A trace that runs out of sender slots is closed where it stands, and the game goes on unrecorded.
  * 
- * @param game - the game_t struct holding game information
- * @param maxPlayers - the maximum players that can join
+ * @param arg - the game_t struct holding game information
+ * @param from - the address of the client who sent the message
+ * @param message - the message string sent from the client
+ * @return true at game over
  */
-void quit_all(game_t* game, int maxPlayers)
+static bool
+record_message(void* arg, const addr_t from, const char* message)
 {
-    for (int i = 0; i < maxPlayers + 1; i++){
-        client_t* client = game->clients[i];
-        if (client != NULL && !client->quit){
-            send_quitMsg(client->clientAddr, 1, client->isSpectator);
-        }
+    if (recording != NULL && !trace_record(recording, from, message)){
+        fprintf(stderr, "Error. The trace holds no more senders; recording stops here\n");
+        trace_close(recording);
+        recording = NULL;
     }
-
+    return handleMessage(arg, from, message);
 }
 
-
 /**
- * @brief Updates the previous spot occupies by a player when they move to the next spot.
+ * @brief Replays a trace: plays the recorded messages into a new game on the recorded map and seed, as fast as possible,
+ * with every message the game sends counted rather than sent. Prints the rate, how many KEY and KEYS messages allocated on the heap
+ * (none should), the final scores, and whether they match the recording.
  * 
- * @param player- the client_t struct holding information about the new client
- * @param game - the game_t struct holding game information
- * @param grid_val - the char representing the current spot the player is on
+ * @param traceFilename - the trace to replay
+ * @return true if the outcome matches the recorded one (or none was recorded)
+ * @return false on error, or if the outcome differs
  */
-static void
-update_previous_spot(client_t* player, game_t* game, char grid_val)
+static bool
+run_replay(const char* traceFilename)
 {
-    //change the global grid on the spot they came from back to what it was
-    if (player->onTunnel){
-        change_spot(game, player->r, player->c, '#');
+    trace_t* trace = trace_open(traceFilename);
+    if (trace == NULL){
+        fprintf(stderr, "Error. %s could not be read as a trace\n", traceFilename);
+        return false;
     }
-    else{
-        change_spot(game, player->r, player->c, '.');
+    game_t* game = engine_startGame(trace_mapFilename(trace), trace_seed(trace));
+    if (game == NULL){
+        fprintf(stderr, "Error. File %s could not be opened\n", trace_mapFilename(trace));
+        trace_close(trace);
+        return false;
     }
-    player->onTunnel = (grid_val == '#');
-}
 
-/**
- * @brief Sends message to client about to quit the game, according to their role (player or spectator) and the reason for quitting.
- * 
- * @param clientAddr - the address the reach the client
- * @param quitCode - a code representing why the client quit: 0 means spectator was replaced, 1 mean player quit, 2 means full game, 3 means invalid player name
- * @param isSpectator - boolean, is the client a spectator
- */
-void
-send_quitMsg(addr_t clientAddr, int quitCode, bool isSpectator)
-{
-    char* quitMsg = mem_malloc_assert(55, "Error allocating memory in send_quitMsg.\n"); 
-    char* quitReason = mem_malloc_assert(45, "Error allocating memory in send_quitMsg.\n");
-
-    if (isSpectator){
-        if (quitCode == 0){
-            strcpy(quitReason, "You have been replaced by a new spectator.");
-        }
-        else{
-            strcpy(quitReason, "Thanks for watching!");
+    FILE* fp = fopen("server.log", "w");
+    flog_init(fp);
+    sent_t sent = { 0, 0 };
+    message_setSendHook(count_sent, &sent);
+    engine_guardAllocations(Guard_Count);
+
+    // play every message, back to back
+    struct timespec start, stop;
+    long replayed = 0;
+    addr_t from;
+    const char* message;
+    uint32_t delay;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (trace_next(trace, &from, &message, &delay)){
+        replayed++;
+        if (handleMessage(game, from, message)){
+            trace_next(trace, &from, &message, &delay); // read on to the outcome
+            break;
         }
     }
-    else {
-        if (quitCode == 1){
-            strcpy(quitReason, "Thanks for playing!");
-        }
-        if (quitCode == 2){
-            strcpy(quitReason, "Game is full: no more players can join.");
-        }
-        if (quitCode == 3){
-            strcpy(quitReason, "Sorry - you must provide player's name.");
-        }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double secs = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
 
-    }
+    message_setSendHook(NULL, NULL);
+    engine_guardAllocations(Guard_Off);
+    flog_done(fp);
+    fclose(fp);
 
-    sprintf(quitMsg, "QUIT %s", quitReason);
-    message_send(clientAddr, quitMsg);
-    mem_free(quitMsg);
-    mem_free(quitReason);
+    char scores[MaxScoresLength];
+    format_scores(game, scores, sizeof(scores));
+    printf("replayed %ld messages in %.3f s (%.0f messages/s); the game sent %ld messages, %ld bytes\n",
+           replayed, secs, secs > 0 ? replayed / secs : 0, sent.messages, sent.bytes);
+    printf("KEY and KEYS messages that allocated on the heap: %ld\n", engine_allocatingKeys());
+    printf("final scores:\n%s", scores);
+
+    bool ok = true;
+    const char* outcome = trace_outcome(trace);
+    if (outcome == NULL){
+        printf("no outcome was recorded\n");
+    }
+    else if (strcmp(outcome, scores) == 0){
+        printf("outcome matches the recording\n");
+    }
+    else {
+        printf("outcome DIFFERS from the recording:\n%s", outcome);
+        ok = false;
+    }
 
+    engine_finishGame(game);
+    trace_close(trace);
+    return ok;
 }
 
 /**
- * @brief Sends a message to all clients reflecting the leaderboard when the game ends.
+ * @brief Send hook during a replay: counts each message instead of sending it.
  * 
- * @param game - the game_t struct holding game information
- * @param maxNameLength - the longest a name can be
+ * @param arg - the sent_t counts
+ * @param to - the address the message was for
+ * @param message - the message
  */
-void
-send_gameOverMsg(game_t* game, int maxNameLength)
+static void
+count_sent(void* arg, const addr_t to, const char* message)
 {
-    char* message = mem_malloc_assert(16+ ((maxNameLength + 14) * game->playersJoined), "Error allocating memory in send_gameOverMsg.\n");
-    strcpy(message, "QUIT GAME OVER:");
-
-    for (int i = 1; i < game->playersJoined + 1; i++){
-        client_t* player = game->clients[i];
-        if (player != NULL){
-            char* playerStr = mem_malloc_assert(strlen(player->real_name) + 14, "Error allocating memory in send_gameOverMsg.\n");
-            sprintf(playerStr, "\n%c       %3d %s", player->id, player->gold, player->real_name);
-            strcat(message, playerStr);
-            mem_free(playerStr);
-        }
-    }    
-
-    // Add the null terminator at the end of the message string
-    int messageLength = strlen(message);
-    message[messageLength] = '\0';
-
-    for (int i = 0; i < game->playersJoined + 1; i++){
-        client_t* client = game->clients[i];
-        if (client != NULL && !client->quit){
-            message_send(client->clientAddr, message);
-        }
-    }
-
-    mem_free(message);
-
-}
\ No newline at end of file
+    sent_t* sent = arg;
+    sent->messages++;
+    sent->bytes += strlen(message);
+}
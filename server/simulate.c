@@ -0,0 +1,433 @@
+/*
+simulate.c
+plays many seeded games of nuggets at once, with scripted bots and no network, to benchmark and stress-test the game engine
+
+Each worker thread takes the next game, starts it on the next map with a seed of its own, joins the bots,
+and feeds them random steps and sprints straight into the engine's message handler until the game ends.
+Every message the engine sends is counted, not sent (see message_setSendHook), so no socket or system call
+gets in the way. The report gives games/s, moves/s, the distribution of game times, the process's CPU usage,
+and (where the kernel allows) each thread's hardware counters.
+
+Team 9: Plankton, May 2023
+*/
+
+#define _GNU_SOURCE     // for syscall, pthreads (Linux)
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "../libs/mem.h"
+#include "../support/log.h"
+#include "../support/message.h"
+#include "../support/hist.h"
+#include "../common/engine.h"
+
+
+/**************** constants ****************/
+static const char* Usage = "Call using the format ./simulate [-n games] [-j threads] [-b bots] [-k keys] [-K batch] [-a] [-Z] [-s seed] map.txt...\n"
+    "  -n  how many games to play (default: 1000)\n"
+    "  -j  how many threads to play them on (default: one per core)\n"
+    "  -b  how many bots play each game (default: 8)\n"
+    "  -k  give up on a game after this many keys (default: 100000)\n"
+    "  -K  each bot sends this many keys at a time, in one KEYS request (default: 1, with KEY)\n"
+    "  -a  the bots are the server's own, heading for the nearest gold, in place of random keys\n"
+    "  -Z  abort if handling a KEY or KEYS allocates on the heap (with -j 1)\n"
+    "  -s  seed of the first game; game i is seeded from seed and i (default: 1)\n";
+
+// Hardware counters to read from each thread, if the kernel lets us
+static const struct {
+    uint64_t config;
+    const char* name;
+} Counters[] = {
+    { PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+    { PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+    { PERF_COUNT_HW_CACHE_MISSES, "cache-misses" },
+    { PERF_COUNT_HW_BRANCH_MISSES, "branch-misses" },
+};
+#define NCOUNTERS (sizeof(Counters) / sizeof(Counters[0]))
+
+
+/**************** types ****************/
+// What the batch is, shared by every worker
+typedef struct batch {
+    char** mapFiles;
+    int nmaps;
+    int ngames;
+    int nbots;
+    long maxKeys;
+    int keysPerMessage;
+    bool serverBots;
+    unsigned int seed;
+    atomic_int nextGame;        // next game for a worker to take
+} batch_t;
+
+// One worker thread, and what it counted
+typedef struct worker {
+    pthread_t thread;
+    batch_t* batch;
+    long games;                 // games started
+    long finished;              // games that ended with all gold found
+    long failed;                // games whose map could not be opened
+    long* unfinished;           // games given up, for each map
+    long keys;                  // keys handled
+    long messages;              // messages the engine sent
+    long bytes;
+    hist_t* gameTimes;          // microseconds per game
+    bool counted;               // were the hardware counters read?
+    uint64_t counters[NCOUNTERS];
+} worker_t;
+
+
+/**************** function prototypes ****************/
+static void* run_worker(void* arg);
+static void play_game(worker_t* worker, int index);
+static void count_sent(void* arg, const addr_t to, const char* message);
+static uint32_t next_random(uint32_t* state);
+static int open_counter(uint64_t config);
+static double now(void);
+static void report(batch_t* batch, worker_t* workers, int nworkers, double secs);
+
+
+/**************** functions ****************/
+/**
+ * @brief Parses arguments, plays the games on the worker threads, and prints the report.
+ *
+ * @param argc
+ * @param argv
+ * @return int - 0 if every game finished, 1 otherwise
+ */
+int
+main(const int argc, char* argv[])
+{
+    // in a build profiling the heap (make FLAGS=-DMEMPROFILE), print the profile on the way out
+    mem_reportAtExit(stderr, "simulate");
+    batch_t batch = { .ngames = 1000, .nbots = 8, .maxKeys = 100000, .keysPerMessage = 1, .seed = 1 };
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nworkers = ncpus > 0 ? ncpus : 1;
+
+    int opt;
+    bool guarded = false;
+    while ((opt = getopt(argc, argv, "n:j:b:k:K:aZs:")) != -1){
+        switch (opt) {
+            case 'n': batch.ngames = atoi(optarg); break;
+            case 'j': nworkers = atoi(optarg); break;
+            case 'b': batch.nbots = atoi(optarg); break;
+            case 'k': batch.maxKeys = atol(optarg); break;
+            case 'K': batch.keysPerMessage = atoi(optarg); break;
+            case 'a': batch.serverBots = true; break;
+            case 'Z': guarded = true; break;
+            case 's': batch.seed = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Invalid option provided. %s", Usage);
+                exit(1);
+        }
+    }
+    if (optind == argc || batch.ngames < 1 || nworkers < 1
+        || batch.nbots < 1 || batch.nbots > MaxPlayers || batch.maxKeys < 1
+        || batch.keysPerMessage < 1 || batch.keysPerMessage > 1000 || (guarded && nworkers != 1)){
+        fprintf(stderr, "Invalid arguments provided: at least one map, -b from 1 to %d, -K from 1 to 1000, and -j 1 with -Z. %s", MaxPlayers, Usage);
+        exit(1);
+    }
+
+    // other threads' allocations would be charged to the keys, so the guard needs the games on one thread
+    if (guarded){
+        engine_guardAllocations(Guard_Abort);
+    }
+    batch.mapFiles = argv + optind;
+    batch.nmaps = argc - optind;
+    atomic_init(&batch.nextGame, 0);
+
+    // errors in the games go to the log, as in the server
+    FILE* fp = fopen("simulate.log", "w");
+    flog_init(fp);
+
+    worker_t* workers = mem_calloc_assert(nworkers, sizeof(worker_t), "Error allocating memory in main.\n");
+    double start = now();
+    for (int w = 0; w < nworkers; w++){
+        workers[w].batch = &batch;
+        workers[w].unfinished = mem_calloc_assert(batch.nmaps, sizeof(long), "Error allocating memory in main.\n");
+        workers[w].gameTimes = mem_assert(hist_new(), "Error allocating histogram in main.\n");
+        pthread_create(&workers[w].thread, NULL, run_worker, &workers[w]);
+    }
+    for (int w = 0; w < nworkers; w++){
+        pthread_join(workers[w].thread, NULL);
+    }
+    double secs = now() - start;
+
+    report(&batch, workers, nworkers, secs);
+
+    bool allFinished = true;
+    for (int w = 0; w < nworkers; w++){
+        allFinished = allFinished && workers[w].finished == workers[w].games;
+        hist_delete(workers[w].gameTimes);
+        mem_free(workers[w].unfinished);
+    }
+    mem_free(workers);
+    flog_done(fp);
+    fclose(fp);
+    return allFinished ? 0 : 1;
+}
+
+/**
+ * @brief A worker thread: diverts the engine's messages to its counters, and plays games until none are left.
+ *
+ * @param arg - the worker_t
+ * @return void* - NULL
+ */
+static void*
+run_worker(void* arg)
+{
+    worker_t* worker = arg;
+    batch_t* batch = worker->batch;
+    message_setSendHook(count_sent, worker);
+
+    // count this thread's hardware events, if we may
+    int fds[NCOUNTERS];
+    worker->counted = true;
+    for (int i = 0; i < NCOUNTERS; i++){
+        fds[i] = open_counter(Counters[i].config);
+        worker->counted = worker->counted && fds[i] >= 0;
+    }
+
+    int index;
+    while ((index = atomic_fetch_add(&batch->nextGame, 1)) < batch->ngames){
+        play_game(worker, index);
+    }
+
+    for (int i = 0; i < NCOUNTERS; i++){
+        if (fds[i] >= 0){
+            if (read(fds[i], &worker->counters[i], sizeof(uint64_t)) != sizeof(uint64_t)){
+                worker->counted = false;
+            }
+            close(fds[i]);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Plays one game: the bots join, then take turns sending random keys, half of them sprints, until all the gold is found
+ * or the batch's limit of keys is reached. With -K, each turn is a KEYS request of several keys.
+ * With -a, the server's own bots play instead, every bot taking a step (counted as a key) at each tick.
+ *
+ * @param worker - the worker playing the game
+ * @param index - which game of the batch; it picks the map and the seed
+ */
+static void
+play_game(worker_t* worker, int index)
+{
+    batch_t* batch = worker->batch;
+    const int map = index % batch->nmaps;
+    const unsigned int seed = batch->seed + index * 2654435761u;
+    double start = now();
+
+    worker->games++;
+    game_t* game = engine_startGame(batch->mapFiles[map], seed);
+    if (game == NULL){
+        fprintf(stderr, "Error. File %s could not be opened\n", batch->mapFiles[map]);
+        worker->failed++;
+        return;
+    }
+
+    if (batch->serverBots){
+        engine_addBots(game, batch->nbots);
+        bool over = false;
+        long k;
+        for (k = 0; k < batch->maxKeys && !over; k += batch->nbots){
+            over = engine_tickBots(game);
+        }
+        worker->keys += k;
+        if (over){
+            worker->finished++;
+        }
+        else {
+            worker->unfinished[map]++;
+        }
+        engine_finishGame(game);
+        hist_record(worker->gameTimes, (now() - start) * 1e6);
+        return;
+    }
+
+    // each bot has a made-up address: the loopback address, port bot+1
+    addr_t bots[MaxPlayers];
+    char message[1024];  // room for "KEYS " and the largest batch of keys
+    for (int b = 0; b < batch->nbots; b++){
+        memset(&bots[b], 0, sizeof(addr_t));
+        bots[b].sin_family = AF_INET;
+        bots[b].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bots[b].sin_port = htons(b + 1);
+        snprintf(message, sizeof(message), "PLAY bot%d", b);
+        handleMessage(game, bots[b], message);
+    }
+
+    // the bots' keys follow from the game's seed, too
+    const char* keys = "hjklyubnHJKLYUBN";
+    uint32_t random = seed | 1;
+    bool over = false;
+    long k;
+    long turn;
+    for (k = 0, turn = 0; k < batch->maxKeys && !over; turn++){
+        if (batch->keysPerMessage == 1){
+            snprintf(message, sizeof(message), "KEY %c", keys[next_random(&random) % 16]);
+            k++;
+        }
+        else {
+            int length = sprintf(message, "KEYS ");
+            for (int i = 0; i < batch->keysPerMessage && k < batch->maxKeys; i++, k++){
+                message[length++] = keys[next_random(&random) % 16];
+            }
+            message[length] = '\0';
+        }
+        over = handleMessage(game, bots[turn % batch->nbots], message);
+    }
+    worker->keys += k;
+    if (over){
+        worker->finished++;
+    }
+    else {
+        worker->unfinished[map]++;
+    }
+
+    engine_finishGame(game);
+    hist_record(worker->gameTimes, (now() - start) * 1e6);
+}
+
+/**
+ * @brief Send hook of each worker thread: counts the message instead of sending it.
+ *
+ * @param arg - the worker_t
+ * @param to - the address the message was for
+ * @param message - the message
+ */
+static void
+count_sent(void* arg, const addr_t to, const char* message)
+{
+    worker_t* worker = arg;
+    worker->messages++;
+    worker->bytes += strlen(message);
+}
+
+/**
+ * @brief A small, fast, seeded generator (xorshift32), so the bots' keys are the same for the same seed.
+ *
+ * @param state - the generator's state, never zero
+ * @return uint32_t - the next random number
+ */
+static uint32_t
+next_random(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/**
+ * @brief Opens a hardware counter of the calling thread, counting in user space only.
+ *
+ * @param config - which counter (PERF_COUNT_HW_*)
+ * @return int - a file descriptor from which to read the count, or -1 if the kernel refuses
+ */
+static int
+open_counter(uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * @brief Returns the time in seconds, by a clock that never goes backward.
+ */
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Prints the totals of every worker: rates, game times, CPU usage, hardware counters, and maps on which games did not finish.
+ *
+ * @param batch - the batch played
+ * @param workers - the workers, with their counts
+ * @param nworkers - how many workers
+ * @param secs - how long the batch took
+ */
+static void
+report(batch_t* batch, worker_t* workers, int nworkers, double secs)
+{
+    long games = 0, finished = 0, failed = 0, keys = 0, messages = 0, bytes = 0;
+    bool counted = true;
+    uint64_t counters[NCOUNTERS] = { 0 };
+    hist_t* gameTimes = mem_assert(hist_new(), "Error allocating histogram in report.\n");
+    for (int w = 0; w < nworkers; w++){
+        worker_t* worker = &workers[w];
+        games += worker->games;
+        finished += worker->finished;
+        failed += worker->failed;
+        keys += worker->keys;
+        messages += worker->messages;
+        bytes += worker->bytes;
+        hist_merge(gameTimes, worker->gameTimes);
+        counted = counted && worker->counted;
+        for (int i = 0; i < NCOUNTERS; i++){
+            counters[i] += worker->counters[i];
+        }
+    }
+
+    printf("games: %ld on %d threads in %.2f s: %.1f games/s; %ld finished, %ld unfinished, %ld failed\n",
+           games, nworkers, secs, games / secs, finished, games - finished - failed, failed);
+    printf("moves: %ld keys, %.0f moves/s\n", keys, keys / secs);
+    printf("sent: %ld messages, %.1f MB (%.0f messages/s)\n", messages, bytes / 1e6, messages / secs);
+    hist_print(gameTimes, stdout, "game time", "us");
+    hist_delete(gameTimes);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    double sys = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    printf("cpu: %.2f s user, %.2f s system (%.0f%% of %d threads), max RSS %ld KB, %ld+%ld context switches\n",
+           user, sys, 100 * (user + sys) / (secs * nworkers), nworkers, usage.ru_maxrss,
+           usage.ru_nvcsw, usage.ru_nivcsw);
+
+    if (counted && keys > 0){
+        printf("hardware (user space):");
+        for (int i = 0; i < NCOUNTERS; i++){
+            printf(" %s %.0f/move%s", Counters[i].name, (double)counters[i] / keys, i + 1 < NCOUNTERS ? "," : "\n");
+        }
+        if (counters[0] > 0){
+            printf("instructions per cycle: %.2f\n", (double)counters[1] / counters[0]);
+        }
+    }
+    else {
+        printf("hardware counters unavailable (see /proc/sys/kernel/perf_event_paranoid)\n");
+    }
+
+    for (int m = 0; m < batch->nmaps; m++){
+        long unfinished = 0;
+        for (int w = 0; w < nworkers; w++){
+            unfinished += workers[w].unfinished[m];
+        }
+        if (unfinished > 0){
+            printf("unfinished on %s: %ld games\n", batch->mapFiles[m], unfinished);
+        }
+    }
+}
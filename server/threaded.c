@@ -0,0 +1,219 @@
+/*
+ * threaded.c - threaded server mode
+ * an I/O thread, the game thread, and a sender thread, joined by spsc queues
+ * see threaded.h for the interface
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#define _GNU_SOURCE     // for eventfd, pthreads (Linux)
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "../support/message.h"
+#include "../support/spsc.h"
+#include "threaded.h"
+
+
+/**************** constants ****************/
+static const size_t InboundBytes = 1 << 20;   // queue of received requests
+static const size_t OutboundBytes = 16 << 20; // queue of messages to send
+static const int ReceiveBatch = 32;           // max datagrams per receive
+
+
+/**************** types ****************/
+// State shared by the three threads
+typedef struct threaded {
+    int sock;            // socket on which to receive and send
+    spsc_t* inbound;     // I/O thread -> game thread
+    spsc_t* outbound;    // game thread -> sender thread
+    int stopFd;          // eventfd the game thread uses to stop the I/O thread
+    int dropped;         // datagrams dropped since inbound was full (I/O thread)
+    int stalls;          // sends that waited for room in outbound (game thread)
+} threaded_t;
+
+// A datagram as queued: the address, then the null-terminated message
+typedef struct datagram {
+    addr_t addr;
+    char message[];
+} datagram_t;
+
+
+/**************** function prototypes ****************/
+static void* io_thread(void* arg);
+static void* sender_thread(void* arg);
+static bool enqueue_received(void* arg, const addr_t from, const char* message);
+static bool handle_stop(void* arg);
+static void enqueue_send(void* arg, const addr_t to, const char* message);
+
+
+/**************** threaded_run ****************/
+bool
+threaded_run(void* arg, const int sock,
+             bool (*handleMessage)(void* arg, const addr_t from,
+                                   const char* message))
+{
+    threaded_t t = { .sock = sock, .dropped = 0, .stalls = 0 };
+    t.inbound = spsc_new(InboundBytes);
+    t.outbound = spsc_new(OutboundBytes);
+    t.stopFd = eventfd(0, EFD_CLOEXEC);
+    if (t.inbound == NULL || t.outbound == NULL || t.stopFd < 0){
+        fprintf(stderr, "Error. Could not set up the threaded mode\n");
+        spsc_delete(t.inbound);
+        spsc_delete(t.outbound);
+        if (t.stopFd >= 0){
+            close(t.stopFd);
+        }
+        return false;
+    }
+
+    pthread_t io, sender;
+    pthread_create(&io, NULL, io_thread, &t);
+    pthread_create(&sender, NULL, sender_thread, &t);
+
+    // this is the game thread: handle each datagram in place in the queue,
+    // handing everything we send to the sender thread
+    bool done = false;
+    message_setSendHook(enqueue_send, &t);
+    while (!done && spsc_wait(t.inbound)){
+        size_t len;
+        const datagram_t* datagram = spsc_peek(t.inbound, &len);
+        done = (*handleMessage)(arg, datagram->addr, datagram->message);
+        spsc_release(t.inbound);
+    }
+    message_setSendHook(NULL, NULL);
+
+    // stop receiving, then let the sender finish what we queued
+    eventfd_write(t.stopFd, 1);
+    pthread_join(io, NULL);
+    spsc_close(t.outbound);
+    pthread_join(sender, NULL);
+
+    if (t.dropped > 0 || t.stalls > 0){
+        fprintf(stderr, "threaded mode: %d datagrams dropped, %d sends stalled\n", t.dropped, t.stalls);
+    }
+
+    spsc_delete(t.inbound);
+    spsc_delete(t.outbound);
+    close(t.stopFd);
+    return done;
+}
+
+/**
+ * @brief The I/O thread: receives datagrams in batches and queues them for the game thread, until told to stop.
+ * 
+ * @param arg - the threaded_t state
+ * @return void* - NULL
+ */
+static void*
+io_thread(void* arg)
+{
+    threaded_t* t = arg;
+    message_loop_t* loop = message_loopNew();
+
+    if (loop != NULL && message_loopSetBatch(loop, ReceiveBatch)
+        && message_loopAddSocket(loop, t->sock, t, enqueue_received)
+        && message_loopAddInput(loop, t->stopFd, t, handle_stop)){
+        message_loopRun(loop);
+    }
+    else {
+        fprintf(stderr, "Error. Could not start the I/O thread's loop\n");
+    }
+    message_loopDelete(loop);
+
+    // no more datagrams; the game thread stops once it has handled the rest
+    spsc_close(t->inbound);
+    return NULL;
+}
+
+/**
+ * @brief Message handler of the I/O thread: copies the datagram into the inbound queue, or drops it if the queue is full.
+ * 
+ * @param arg - the threaded_t state
+ * @param from - the address of the client who sent the message
+ * @param message - the message string sent from the client
+ * @return false - always, keep looping
+ */
+static bool
+enqueue_received(void* arg, const addr_t from, const char* message)
+{
+    threaded_t* t = arg;
+    size_t len = strlen(message) + 1;
+    datagram_t* datagram = spsc_reserve(t->inbound, sizeof(datagram_t) + len);
+
+    if (datagram == NULL){
+        t->dropped++; // as if the network had lost it
+        return false;
+    }
+    datagram->addr = from;
+    memcpy(datagram->message, message, len);
+    spsc_commit(t->inbound);
+    return false;
+}
+
+/**
+ * @brief Input handler of the I/O thread, for the stop eventfd.
+ * 
+ * @param arg - the threaded_t state
+ * @return true - always, stop looping
+ */
+static bool
+handle_stop(void* arg)
+{
+    threaded_t* t = arg;
+    eventfd_t count;
+    eventfd_read(t->stopFd, &count);
+    return true;
+}
+
+/**
+ * @brief The sender thread: sends each queued message, until the queue is closed and empty.
+ * 
+ * @param arg - the threaded_t state
+ * @return void* - NULL
+ */
+static void*
+sender_thread(void* arg)
+{
+    threaded_t* t = arg;
+
+    while (spsc_wait(t->outbound)){
+        size_t len;
+        const datagram_t* datagram = spsc_peek(t->outbound, &len);
+        message_sendOn(t->sock, datagram->addr, datagram->message);
+        spsc_release(t->outbound);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Send hook of the game thread: queues the message for the sender thread.
+ * If the queue is full, waits for room rather than lose the message.
+ * 
+ * @param arg - the threaded_t state
+ * @param to - the address to which to send
+ * @param message - the message string to send
+ */
+static void
+enqueue_send(void* arg, const addr_t to, const char* message)
+{
+    threaded_t* t = arg;
+    size_t len = strlen(message) + 1;
+    datagram_t* datagram;
+
+    if ((datagram = spsc_reserve(t->outbound, sizeof(datagram_t) + len)) == NULL){
+        t->stalls++;
+        while ((datagram = spsc_reserve(t->outbound, sizeof(datagram_t) + len)) == NULL){
+            sched_yield();
+        }
+    }
+    datagram->addr = to;
+    memcpy(datagram->message, message, len);
+    spsc_commit(t->outbound);
+}
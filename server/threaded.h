@@ -0,0 +1,38 @@
+/*
+ * threaded.h - header for the threaded server mode
+ *
+ * In the threaded mode, the server runs three threads joined by
+ * lock-free single-producer/single-consumer queues (see spsc.h):
+ *   - an I/O thread receives datagrams and queues them for the game thread,
+ *   - the game thread (the caller) runs the message handler, and queues
+ *     every message it sends, and
+ *   - a sender thread drains that queue onto the socket.
+ * Thus no system call, slow or fast, stalls an update of the game state.
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#ifndef __THREADED_H_
+#define __THREADED_H_
+
+#include <stdbool.h>
+#include "../support/message.h"
+
+/* threaded_run
+ * Runs the message handler on the calling thread, as message_loop would,
+ * with receiving and sending done by two helper threads.
+ * Inputs:
+ *   - arg: passed through to the handler (e.g., the game)
+ *   - sock: the socket on which to receive and send (e.g., message_socket())
+ *   - handleMessage: handler for each inbound message, as in message_loop;
+ *     it returns true to end the loop
+ * Outputs:
+ *   - Returns true when the handler ended the loop, false on error.
+ * Notes: every message the handler sends is on its way out before this
+ * function returns; both helper threads are stopped and joined.
+ */
+bool threaded_run(void* arg, const int sock,
+                  bool (*handleMessage)(void* arg, const addr_t from,
+                                        const char* message));
+
+#endif // __THREADED_H_
@@ -0,0 +1,300 @@
+/*
+ * trace.c - recording and replaying the messages of a game
+ * see trace.h for the interface and the layout of a trace file
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#define _POSIX_C_SOURCE 200809L // for clock_gettime
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "../libs/mem.h"
+#include "../support/message.h"
+#include "trace.h"
+
+
+/**************** constants ****************/
+static const char Magic[8] = "NUGTRC1";   // first bytes of every trace
+static const uint16_t OutcomeSlot = 0xFFFF; // slot of the outcome record
+static const int MaxSenders = 0xFFFE;      // slots available to senders
+
+
+/**************** types ****************/
+struct trace {
+    FILE* fp;
+    char* mapFilename;
+    unsigned int seed;
+
+    // recording
+    addr_t* senders;            // address of each slot
+    int nsenders;
+    int maxsenders;
+    uint64_t lastMicros;        // time of the previous message
+    bool stopped;               // out of slots: nothing more is recorded
+
+    // replay
+    char* message;              // buffer for the message last read
+    size_t maxmessage;
+    char* outcome;              // outcome, once reached
+};
+
+
+/**************** local functions ****************/
+static uint64_t now_micros(void);
+static int sender_slot(trace_t* trace, const addr_t from);
+static void write_record(trace_t* trace, uint32_t delay, uint16_t slot, const char* payload);
+static trace_t* new_trace(FILE* fp, const char* mapFilename, unsigned int seed);
+
+
+/**************** trace_create ****************/
+trace_t*
+trace_create(const char* filename, const char* mapFilename, const unsigned int seed)
+{
+    FILE* fp = fopen(filename, "wb");
+    if (fp == NULL){
+        return NULL;
+    }
+
+    uint32_t seed32 = seed;
+    uint16_t pathLength = strlen(mapFilename);
+    fwrite(Magic, sizeof(Magic), 1, fp);
+    fwrite(&seed32, sizeof(seed32), 1, fp);
+    fwrite(&pathLength, sizeof(pathLength), 1, fp);
+    fwrite(mapFilename, 1, pathLength, fp);
+    fflush(fp);
+
+    trace_t* trace = new_trace(fp, mapFilename, seed);
+    trace->lastMicros = now_micros();
+    return trace;
+}
+
+/**************** trace_record ****************/
+bool
+trace_record(trace_t* trace, const addr_t from, const char* message)
+{
+    int slot = trace->stopped ? -1 : sender_slot(trace, from);
+    if (slot < 0){
+        trace->stopped = true; // more senders than a trace can name
+        return false;
+    }
+
+    uint64_t micros = now_micros();
+    uint64_t delay = micros - trace->lastMicros;
+    trace->lastMicros = micros;
+    write_record(trace, delay > UINT32_MAX ? UINT32_MAX : delay, slot, message);
+    return true;
+}
+
+/**************** trace_recordOutcome ****************/
+void
+trace_recordOutcome(trace_t* trace, const char* outcome)
+{
+    if (!trace->stopped){
+        write_record(trace, 0, OutcomeSlot, outcome);
+    }
+    fflush(trace->fp);
+}
+
+/**************** trace_open ****************/
+trace_t*
+trace_open(const char* filename)
+{
+    FILE* fp = fopen(filename, "rb");
+    if (fp == NULL){
+        return NULL;
+    }
+
+    char magic[sizeof(Magic)];
+    uint32_t seed32;
+    uint16_t pathLength;
+    if (fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, Magic, sizeof(Magic)) != 0
+        || fread(&seed32, sizeof(seed32), 1, fp) != 1
+        || fread(&pathLength, sizeof(pathLength), 1, fp) != 1){
+        fclose(fp);
+        return NULL;
+    }
+
+    char* mapFilename = mem_malloc_assert(pathLength + 1, "Error allocating memory in trace_open.\n");
+    if (fread(mapFilename, 1, pathLength, fp) != pathLength){
+        mem_free(mapFilename);
+        fclose(fp);
+        return NULL;
+    }
+    mapFilename[pathLength] = '\0';
+
+    trace_t* trace = new_trace(fp, mapFilename, seed32);
+    mem_free(mapFilename);
+    return trace;
+}
+
+/**************** trace_mapFilename ****************/
+const char*
+trace_mapFilename(trace_t* trace)
+{
+    return trace->mapFilename;
+}
+
+/**************** trace_seed ****************/
+unsigned int
+trace_seed(trace_t* trace)
+{
+    return trace->seed;
+}
+
+/**************** trace_next ****************/
+bool
+trace_next(trace_t* trace, addr_t* from, const char** message, uint32_t* delay)
+{
+    uint32_t micros;
+    uint16_t slot;
+    uint16_t length;
+    if (fread(&micros, sizeof(micros), 1, trace->fp) != 1
+        || fread(&slot, sizeof(slot), 1, trace->fp) != 1
+        || fread(&length, sizeof(length), 1, trace->fp) != 1){
+        return false; // end of trace (a truncated record counts as the end)
+    }
+
+    if (length + 1u > trace->maxmessage){
+        trace->maxmessage = length + 1u;
+        if (trace->message != NULL){
+            mem_free(trace->message);
+        }
+        trace->message = mem_malloc_assert(trace->maxmessage, "Error allocating memory in trace_next.\n");
+    }
+    if (fread(trace->message, 1, length, trace->fp) != length){
+        return false;
+    }
+    trace->message[length] = '\0';
+
+    if (slot == OutcomeSlot){
+        trace->outcome = mem_malloc_assert(length + 1, "Error allocating memory in trace_next.\n");
+        strcpy(trace->outcome, trace->message);
+        return false;
+    }
+
+    // make up an address for the slot: the loopback address, port slot+1
+    memset(from, 0, sizeof(*from));
+    from->sin_family = AF_INET;
+    from->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    from->sin_port = htons(slot + 1);
+
+    *message = trace->message;
+    *delay = micros;
+    return true;
+}
+
+/**************** trace_outcome ****************/
+const char*
+trace_outcome(trace_t* trace)
+{
+    return trace->outcome;
+}
+
+/**************** trace_close ****************/
+void
+trace_close(trace_t* trace)
+{
+    if (trace == NULL){
+        return;
+    }
+    fclose(trace->fp);
+    mem_free(trace->mapFilename);
+    if (trace->senders != NULL){
+        mem_free(trace->senders);
+    }
+    if (trace->message != NULL){
+        mem_free(trace->message);
+    }
+    if (trace->outcome != NULL){
+        mem_free(trace->outcome);
+    }
+    mem_free(trace);
+}
+
+/**
+ * @brief Creates the trace struct around an open file.
+ *
+ * @param fp - the trace file
+ * @param mapFilename - the map, which is copied
+ * @param seed - the seed of the game
+ * @return trace_t* - the new trace
+ */
+static trace_t*
+new_trace(FILE* fp, const char* mapFilename, unsigned int seed)
+{
+    trace_t* trace = mem_calloc_assert(1, sizeof(trace_t), "Error allocating memory in new_trace.\n");
+    trace->fp = fp;
+    trace->mapFilename = mem_malloc_assert(strlen(mapFilename) + 1, "Error allocating memory in new_trace.\n");
+    strcpy(trace->mapFilename, mapFilename);
+    trace->seed = seed;
+    return trace;
+}
+
+/**
+ * @brief Returns the slot of a sender, giving it the next slot if it is new.
+ * A game has a few dozen clients at most, so a linear search is fine.
+ *
+ * @param trace - the trace being recorded
+ * @param from - the sender's address
+ * @return int - the slot, or -1 if there are too many senders
+ */
+static int
+sender_slot(trace_t* trace, const addr_t from)
+{
+    for (int i = 0; i < trace->nsenders; i++){
+        if (message_eqAddr(trace->senders[i], from)){
+            return i;
+        }
+    }
+    if (trace->nsenders == MaxSenders){
+        return -1;
+    }
+
+    if (trace->nsenders == trace->maxsenders){
+        trace->maxsenders = trace->maxsenders == 0 ? 32 : trace->maxsenders * 2;
+        addr_t* senders = mem_malloc_assert(trace->maxsenders * sizeof(addr_t), "Error allocating memory in sender_slot.\n");
+        if (trace->senders != NULL){
+            memcpy(senders, trace->senders, trace->nsenders * sizeof(addr_t));
+            mem_free(trace->senders);
+        }
+        trace->senders = senders;
+    }
+    trace->senders[trace->nsenders] = from;
+    return trace->nsenders++;
+}
+
+/**
+ * @brief Writes one record, leaving stdio to buffer it.
+ *
+ * @param trace - the trace being recorded
+ * @param delay - microseconds since the previous record
+ * @param slot - the sender's slot, or OutcomeSlot
+ * @param payload - the message
+ */
+static void
+write_record(trace_t* trace, uint32_t delay, uint16_t slot, const char* payload)
+{
+    size_t length = strlen(payload);
+    uint16_t length16 = length > UINT16_MAX ? UINT16_MAX : length;
+    fwrite(&delay, sizeof(delay), 1, trace->fp);
+    fwrite(&slot, sizeof(slot), 1, trace->fp);
+    fwrite(&length16, sizeof(length16), 1, trace->fp);
+    fwrite(payload, 1, length16, trace->fp);
+}
+
+/**
+ * @brief Returns the time in microseconds, by a clock that never goes backward.
+ */
+static uint64_t
+now_micros(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
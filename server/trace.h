@@ -0,0 +1,101 @@
+/*
+ * trace.h - header for recording and replaying the messages of a game
+ *
+ * A trace is a compact binary file holding everything needed to play a
+ * game again: the map path and the seed of the game's random-number
+ * generator, then every message the game accepted, in order, each with
+ * its arrival time and its sender.  Senders are numbered in the order
+ * they first appear (their 'slot'), so a trace holds no real addresses.
+ * A trace may end with the outcome of the game (e.g., the final scores),
+ * against which a replay can check its own outcome.
+ *
+ * Layout (integers in host byte order):
+ *   header:  "NUGTRC1\0", u32 seed, u16 length of map path, map path
+ *   message: u32 microseconds since the previous message,
+ *            u16 sender slot, u16 length of payload, payload
+ *   outcome: a message from slot 0xFFFF
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../support/message.h"
+
+/**************** types ****************/
+typedef struct trace trace_t;  // opaque to users of this module
+
+/**************** functions ****************/
+
+/* trace_create
+ * Creates a trace file, ready to record a game.
+ * Inputs:
+ *   - filename: the trace file to (re)write
+ *   - mapFilename: the map on which the game is played
+ *   - seed: the seed of the game's random-number generator
+ * Outputs:
+ *   - Returns the new trace, or NULL if the file could not be written.
+ * Notes: the trace must be closed with trace_close.
+ */
+trace_t* trace_create(const char* filename, const char* mapFilename,
+                      const unsigned int seed);
+
+/* trace_record
+ * Appends one message, stamped with the time it is recorded.
+ * Messages are buffered, and reach the file as the buffer fills, and at
+ * trace_recordOutcome and trace_close; a server killed outright loses
+ * the last of them.
+ * Outputs:
+ *   - Returns false, recording nothing, once the trace has more senders
+ *     than it can name: a trace missing a message would replay another
+ *     game, so it stops there for good (and records no outcome).
+ */
+bool trace_record(trace_t* trace, const addr_t from, const char* message);
+
+/* trace_recordOutcome
+ * Appends the outcome of the game, and flushes the trace to the file;
+ * call it at most once, last.
+ */
+void trace_recordOutcome(trace_t* trace, const char* outcome);
+
+/* trace_open
+ * Opens a trace file for replay.
+ * Outputs:
+ *   - Returns the trace, or NULL if the file cannot be read or is no trace.
+ * Notes: the trace must be closed with trace_close.
+ */
+trace_t* trace_open(const char* filename);
+
+/* trace_mapFilename, trace_seed
+ * Return the map and the seed recorded in the header of an opened trace.
+ */
+const char* trace_mapFilename(trace_t* trace);
+unsigned int trace_seed(trace_t* trace);
+
+/* trace_next
+ * Reads the next message of an opened trace.
+ * Outputs:
+ *   - Returns true, with the sender in *from, the message in *message,
+ *     and the microseconds since the previous message in *delay;
+ *     false at the end of the trace (or at the outcome).
+ * Notes: each sender slot is given a made-up address, the same each time;
+ * *message is valid until the next call.
+ */
+bool trace_next(trace_t* trace, addr_t* from, const char** message,
+                uint32_t* delay);
+
+/* trace_outcome
+ * Returns the outcome recorded at the end of the trace, once trace_next
+ * has returned false; or NULL if none was recorded.
+ */
+const char* trace_outcome(trace_t* trace);
+
+/* trace_close
+ * Closes the trace file and frees the trace.
+ */
+void trace_close(trace_t* trace);
+
+#endif // __TRACE_H_
@@ -0,0 +1,633 @@
+/*
+ * botswarm - a load generator for the Nuggets server
+ *
+ * Simulates hundreds of players from one process.  Each bot has its own
+ * socket (and thus its own address), joins with PLAY, then sends a key
+ * every tick: a seeded random walk of single steps, or a random sprint
+ * (capital letters).  All the bots share one event loop of the message
+ * module.  When the run ends, botswarm reports throughput, datagrams the
+ * kernel dropped on the bots' sockets, what became of the keys, and the
+ * distribution of key->DISPLAY latency.
+ *
+ * usage: botswarm [-n bots] [-r keys/sec] [-d seconds] [-s seed] [-S] [-C bytes] [-L] hostname port
+ *
+ * With -C, each bot asks for its views in chunks (CHUNK bytes), and so
+ * takes them as DISPLAYROWS; with -L, it draws the map itself (LAYERS),
+ * and takes them as FRAMEs.
+ *
+ * The server sends a bot a fresh view whenever anything in it changes,
+ * such as another player's step, so a view answers a key only if it
+ * shows the bot itself moved the way the key goes: its '@' moved in that
+ * direction, or, in a window that scrolls with it, stayed put while the
+ * map moved under it.  Each key gets its own latency, from when it was
+ * sent to the view that answers it.  The server handles a bot's keys in
+ * order, so keys sent before the one answered got no view at all (e.g.,
+ * a step into a wall), and are counted as having no effect; keys with no
+ * answer after one second are counted unanswered, and forgotten.
+ * A bot whose game ends (QUIT GAME OVER) joins again.
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#define _POSIX_C_SOURCE 200809L // for getopt, clock_gettime, strdup
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "message.h"
+#include "hist.h"
+
+/**************** file-local constants ****************/
+static const int MaxBots = 1000;             // (each bot takes a socket)
+static const double UnansweredSecs = 1.0;    // give up on a key after this
+static const char* Steps = "hjklyubn";       // keys of a random walk
+static const char* Sprints = "HJKLYUBN";     // keys of a random sprint
+static const int StepRows[] = { 0, 1, -1, 0, -1, -1, 1, 1 };    // the step of each key, in the order of Steps
+static const int StepColumns[] = { -1, 0, 0, 1, -1, 1, -1, 1 };
+static const int MaxOthersSpots = 8;         // most spots another player's step changes in a view
+enum { MaxPending = 64 };                    // most keys a bot waits on
+
+/**************** file-local types ****************/
+typedef struct pending {
+  double sent;          // when the key was sent
+  char key;
+} pending_t;
+
+typedef struct bot {
+  int index;            // which bot, for its name
+  int sock;             // its own socket
+  uint32_t rng;         // state of its random key stream
+  bool joined;          // has the server said OK?
+  pending_t pending[MaxPending];  // its unanswered keys, oldest first, from firstPending around the ring
+  int firstPending;
+  int npending;
+  char* view;           // its last view of the map (a DISPLAY's rows); NULL for a FRAME, or before the first
+  bool windowed;        // has its view been seen to scroll with it?
+  int atRow, atColumn;  // where it was in that view (on the map, for a FRAME); -1 before the first
+  char* rows;           // the DISPLAYROWS chunks of a frame, assembled
+  unsigned rowsFrame;   // which frame they belong to
+  int rowsSeen;         // how many of its rows have come
+} bot_t;
+
+typedef struct swarm {
+  addr_t server;        // where to send
+  bot_t* bots;
+  int nbots;
+  bool sprint;          // send sprints rather than single steps?
+  int chunkBytes;       // ask for views in chunks of this many bytes, or 0
+  bool layered;         // ask to draw the map (FRAMEs), rather than for DISPLAYs
+  double start;         // time the run began
+  hist_t* latency;      // key->DISPLAY latency, in microseconds
+  long keysSent;
+  long messagesReceived;
+  long bytesReceived;
+  long displays;        // views received: DISPLAY, whole frames of DISPLAYROWS, and FRAME
+  long answered;        // keys answered by a view showing the bot's move
+  long noEffect;        // keys the server handled without a view, a later key being answered first
+  long unanswered;      // keys with no answer after UnansweredSecs
+  long joins;           // OK messages received
+  long gameOvers;       // QUIT GAME OVER messages received
+} swarm_t;
+
+/**************** file-local functions ****************/
+static double now(void);
+static uint32_t nextRandom(uint32_t* state);
+static void join(swarm_t* swarm, bot_t* bot);
+static bool handleTick(void* arg);
+static bool handleEnd(void* arg);
+static bool handleMessage(void* arg, const addr_t from, const char* message);
+static void assembleRows(swarm_t* swarm, bot_t* bot, const char* message);
+static void seeDisplay(swarm_t* swarm, bot_t* bot, const char* map);
+static bool scrolledBy(const char* old, const char* new, char key);
+static int mismatches(const char* old, const char* new, int dr, int dc);
+static void seeFrame(swarm_t* swarm, bot_t* bot, const char* message);
+static void see(swarm_t* swarm, bot_t* bot, int atRow, int atColumn, bool scrolls);
+static bool moves(char key, int dr, int dc, bool windowed);
+static void answer(swarm_t* swarm, bot_t* bot, int which);
+static long kernelDrops(swarm_t* swarm);
+static void report(swarm_t* swarm, FILE* fp);
+
+// the message handler needs both the swarm and the bot
+static swarm_t* theSwarm = NULL;
+
+/***************** main *******************************/
+int
+main(const int argc, char* argv[])
+{
+  int nbots = 26;
+  double rate = 10;      // keys per second, per bot
+  double duration = 10;  // seconds
+  unsigned seed = 1;
+  bool sprint = false;
+  int chunkBytes = 0;
+  bool layered = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:d:s:SC:L")) != -1) {
+    switch (opt) {
+      case 'n': nbots = atoi(optarg); break;
+      case 'r': rate = atof(optarg); break;
+      case 'd': duration = atof(optarg); break;
+      case 's': seed = atoi(optarg); break;
+      case 'S': sprint = true; break;
+      case 'C': chunkBytes = atoi(optarg); break;
+      case 'L': layered = true; break;
+      default: nbots = -1; break;
+    }
+  }
+  if (argc - optind != 2 || nbots < 1 || nbots > MaxBots
+      || rate <= 0 || duration <= 0 || chunkBytes < 0) {
+    fprintf(stderr, "usage: %s [-n bots] [-r keys/sec] [-d seconds] "
+            "[-s seed] [-S] [-C bytes] [-L] hostname port\n", argv[0]);
+    return 3; // bad commandline
+  }
+
+  // initialize the message module (without logging)
+  if (message_init(NULL) == 0) {
+    return 2; // failure to initialize message module
+  }
+
+  swarm_t swarm = { .nbots = nbots, .sprint = sprint,
+                    .chunkBytes = chunkBytes, .layered = layered };
+  theSwarm = &swarm;
+  if (!message_setAddr(argv[optind], argv[optind+1], &swarm.server)) {
+    fprintf(stderr, "can't form address from %s %s\n",
+            argv[optind], argv[optind+1]);
+    return 4; // bad hostname/port
+  }
+
+  // every bot has a socket of its own, all watched by one loop
+  message_loop_t* loop = message_loopNew();
+  swarm.latency = hist_new();
+  swarm.bots = calloc(nbots, sizeof(bot_t));
+  if (loop == NULL || swarm.latency == NULL || swarm.bots == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 2;
+  }
+  for (int i = 0; i < nbots; i++) {
+    bot_t* bot = &swarm.bots[i];
+    bot->index = i;
+    bot->rng = seed * 2654435761u + i + 1;
+    bot->sock = message_openSocket(0);
+    if (bot->sock == 0 || !message_loopAddSocket(loop, bot->sock, bot,
+                                                 handleMessage)) {
+      fprintf(stderr, "cannot open a socket for bot %d\n", i);
+      return 2;
+    }
+  }
+  if (!message_loopAddTimer(loop, 1.0 / rate, false, &swarm, handleTick)
+      || !message_loopAddTimer(loop, duration, false, &swarm, handleEnd)) {
+    fprintf(stderr, "cannot start timers\n");
+    return 2;
+  }
+
+  swarm.start = now();
+  for (int i = 0; i < nbots; i++) {
+    join(&swarm, &swarm.bots[i]);
+  }
+  bool ok = message_loopRun(loop);
+
+  report(&swarm, stdout);
+
+  // say goodbye, and clean up
+  for (int i = 0; i < nbots; i++) {
+    message_sendOn(swarm.bots[i].sock, swarm.server, "KEY Q");
+    message_closeSocket(swarm.bots[i].sock);
+  }
+  message_loopDelete(loop);
+  hist_delete(swarm.latency);
+  for (int i = 0; i < nbots; i++) {
+    free(swarm.bots[i].view);
+    free(swarm.bots[i].rows);
+  }
+  free(swarm.bots);
+  message_done();
+
+  return ok? 0 : 1; // status code depends on result of message_loop
+}
+
+/**************** now ****************/
+/* Return the time in seconds, by a clock that never goes backward. */
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************** nextRandom ****************/
+/* A small, fast, seeded generator (xorshift32), one per bot. */
+static uint32_t
+nextRandom(uint32_t* state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/**************** join ****************/
+/* Ask the server to let this bot play. */
+static void
+join(swarm_t* swarm, bot_t* bot)
+{
+  char play[32];
+  snprintf(play, sizeof(play), "PLAY bot%d", bot->index);
+  bot->joined = false;
+  bot->npending = 0;
+  free(bot->view);
+  bot->view = NULL;
+  bot->atRow = bot->atColumn = -1;
+  bot->windowed = false;
+  message_sendOn(bot->sock, swarm->server, play);
+}
+
+/**************** handleTick ****************/
+/* Timer: every bot that has joined sends its next key.
+ * Return false to keep looping.
+ */
+static bool
+handleTick(void* arg)
+{
+  swarm_t* swarm = arg;
+  const double t = now();
+  const char* keys = swarm->sprint ? Sprints : Steps;
+  char key[] = "KEY ?";
+
+  for (int i = 0; i < swarm->nbots; i++) {
+    bot_t* bot = &swarm->bots[i];
+    if (!bot->joined) {
+      continue;
+    }
+
+    // forget keys that were never answered, and the oldest if there is no room for another
+    while (bot->npending > 0
+           && (t - bot->pending[bot->firstPending].sent > UnansweredSecs
+               || bot->npending == MaxPending)) {
+      swarm->unanswered++;
+      bot->firstPending = (bot->firstPending + 1) % MaxPending;
+      bot->npending--;
+    }
+
+    key[4] = keys[nextRandom(&bot->rng) % 8];
+    message_sendOn(bot->sock, swarm->server, key);
+    swarm->keysSent++;
+    pending_t* pending = &bot->pending[(bot->firstPending + bot->npending++) % MaxPending];
+    pending->sent = t;
+    pending->key = key[4];
+  }
+  return false;
+}
+
+/**************** handleEnd ****************/
+/* Timer: the run is over.  Return true to stop looping. */
+static bool
+handleEnd(void* arg)
+{
+  return true;
+}
+
+/**************** handleMessage ****************/
+/* Datagram received by one of the bots: count it, and time the keys a
+ * view answers.
+ * We use 'arg' to carry the bot.
+ * Return false to keep looping.
+ */
+static bool
+handleMessage(void* arg, const addr_t from, const char* message)
+{
+  bot_t* bot = arg;
+  swarm_t* swarm = theSwarm;
+
+  swarm->messagesReceived++;
+  swarm->bytesReceived += strlen(message);
+
+  if (strncmp(message, "DISPLAYROWS ", 12) == 0) {
+    assembleRows(swarm, bot, message);
+  } else if (strncmp(message, "DISPLAY\n", 8) == 0) {
+    seeDisplay(swarm, bot, message + 8);
+  } else if (strncmp(message, "FRAME ", 6) == 0) {
+    seeFrame(swarm, bot, message);
+  } else if (strncmp(message, "OK", 2) == 0) {
+    bot->joined = true;
+    swarm->joins++;
+    if (swarm->layered) {
+      message_sendOn(bot->sock, swarm->server, "LAYERS");
+    } else if (swarm->chunkBytes > 0) {
+      char chunk[32];
+      snprintf(chunk, sizeof(chunk), "CHUNK %d", swarm->chunkBytes);
+      message_sendOn(bot->sock, swarm->server, chunk);
+    }
+  } else if (strncmp(message, "QUIT GAME OVER", 14) == 0) {
+    swarm->gameOvers++;
+    join(swarm, bot);      // play again
+  } else if (strncmp(message, "QUIT", 4) == 0) {
+    bot->joined = false;   // e.g., the game is full
+  }
+  return false;
+}
+
+/**************** assembleRows ****************/
+/* A chunk of a frame, "DISPLAYROWS frame first count total" and its rows:
+ * once every row of the frame has come, it is a view like a DISPLAY.
+ * A chunk of a newer frame drops what came of an older one.
+ */
+static void
+assembleRows(swarm_t* swarm, bot_t* bot, const char* message)
+{
+  unsigned frame;
+  int first, count, total, length;
+  // (a newline in the format would skip the spaces the first row starts with, too)
+  if (sscanf(message, "DISPLAYROWS %u %d %d %d%n",
+             &frame, &first, &count, &total, &length) != 4
+      || message[length] != '\n' || first < 0 || count < 1 || first + count > total) {
+    return;
+  }
+  const char* rows = message + length + 1;
+  const int rowLength = strcspn(rows, "\n") + 1;   // with its newline
+  if (bot->rows == NULL || frame != bot->rowsFrame) {
+    free(bot->rows);
+    bot->rows = calloc((size_t)total * rowLength, 1);
+    if (bot->rows == NULL) {
+      return;
+    }
+    bot->rowsFrame = frame;
+    bot->rowsSeen = 0;
+  }
+
+  // rows first to first+count-1, each with its newline but the last of the frame
+  memcpy(bot->rows + (size_t)first * rowLength, rows, (size_t)count * rowLength - 1);
+  bot->rows[(size_t)(first + count) * rowLength - 1] = first + count == total ? '\0' : '\n';
+  bot->rowsSeen += count;
+  if (bot->rowsSeen == total) {
+    seeDisplay(swarm, bot, bot->rows);
+    free(bot->rows);
+    bot->rows = NULL;
+  }
+}
+
+/**************** seeDisplay ****************/
+/* A view of the map as rows of text (a DISPLAY, or a whole frame of
+ * DISPLAYROWS): find the bot in it.  In a window that follows the bot,
+ * the bot stays at the same spot of the view while the map moves under
+ * it: then the key answered is the oldest one that moves the map that way.
+ */
+static void
+seeDisplay(swarm_t* swarm, bot_t* bot, const char* map)
+{
+  const char* at = strchr(map, '@');
+  if (at == NULL) {
+    return;
+  }
+  int atRow = 0;
+  const char* rowStart = map;
+  for (const char* p = map; p < at; p++) {
+    if (*p == '\n') {
+      atRow++;
+      rowStart = p + 1;
+    }
+  }
+  const int atColumn = at - rowStart;
+
+  // a view of another size has nothing to compare with
+  const bool comparable = bot->view != NULL && strlen(bot->view) == strlen(map);
+  if (!comparable) {
+    bot->atRow = bot->atColumn = -1;
+  }
+  swarm->displays++;
+
+  if (comparable && atRow == bot->atRow && atColumn == bot->atColumn
+      && mismatches(bot->view, map, 0, 0) > MaxOthersSpots) {
+    // more changed than another player's step could: the map scrolled
+    bot->windowed = true;
+    for (int i = 0; i < bot->npending; i++) {
+      if (scrolledBy(bot->view, map, bot->pending[(bot->firstPending + i) % MaxPending].key)) {
+        answer(swarm, bot, i);
+        break;
+      }
+    }
+  } else {
+    see(swarm, bot, atRow, atColumn, true);
+  }
+
+  free(bot->view);
+  bot->view = strdup(map);
+  bot->atRow = atRow;
+  bot->atColumn = atColumn;
+}
+
+/**************** scrolledBy ****************/
+/* Does the new view show the old one moved under the bot by the key:
+ * one step of it, or for a sprint (capital) some number of steps?
+ */
+static bool
+scrolledBy(const char* old, const char* new, char key)
+{
+  const bool sprint = strchr(Sprints, key) != NULL;
+  const char* step = strchr(Steps, sprint ? key - 'A' + 'a' : key);
+  if (step == NULL) {
+    return false;
+  }
+  const int columns = strcspn(new, "\n");
+  const int most = sprint ? columns : 1;
+  for (int n = 1; n <= most; n++) {
+    if (mismatches(old, new, n * StepRows[step - Steps], n * StepColumns[step - Steps]) <= MaxOthersSpots) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**************** mismatches ****************/
+/* How many spots seen in both views differ, each spot (r, c) of the new
+ * view against spot (r + dr, c + dc) of the old; more than MaxOthersSpots
+ * counts as MaxOthersSpots + 1, as does an overlap too small to tell by.
+ */
+static int
+mismatches(const char* old, const char* new, int dr, int dc)
+{
+  const int rowLength = strcspn(new, "\n") + 1;
+  const int rows = (strlen(new) + 1) / rowLength;
+  int differ = 0;
+  int compared = 0;
+  for (int r = 0; r < rows; r++) {
+    for (int c = 0; c < rowLength - 1; c++) {
+      const int or = r + dr;
+      const int oc = c + dc;
+      if (or < 0 || or >= rows || oc < 0 || oc >= rowLength - 1) {
+        continue;
+      }
+      const char was = old[or * rowLength + oc];
+      const char is = new[r * rowLength + c];
+      if (was != ' ' && is != ' ') {
+        compared++;
+        if (was != is && ++differ > MaxOthersSpots) {
+          return MaxOthersSpots + 1;
+        }
+      }
+    }
+  }
+  return compared > 4 * MaxOthersSpots ? differ : MaxOthersSpots + 1;
+}
+
+/**************** seeFrame ****************/
+/* A FRAME: "FRAME frame top left rows columns", a line of the mask of
+ * spots seen, then a line of the players and gold, the bot as "@row,col"
+ * on the map itself.
+ */
+static void
+seeFrame(swarm_t* swarm, bot_t* bot, const char* message)
+{
+  // the mask may hold '@' too, so look only on the last line
+  const char* entities = strchr(message, '\n');
+  entities = entities == NULL ? NULL : strchr(entities + 1, '\n');
+  const char* at = entities == NULL ? NULL : strchr(entities, '@');
+  int atRow, atColumn;
+  if (at == NULL || sscanf(at, "@%d,%d", &atRow, &atColumn) != 2) {
+    return;
+  }
+  free(bot->view);
+  bot->view = NULL;
+  swarm->displays++;
+  see(swarm, bot, atRow, atColumn, false);
+  bot->atRow = atRow;
+  bot->atColumn = atColumn;
+}
+
+/**************** see ****************/
+/* The bot is at (atRow, atColumn) of a view: if it moved since its last
+ * view, the view answers the oldest key that moves it that way.  In a
+ * window (scrolls), which near the edges of the map may take up part of
+ * a move, the bot may move less than the key, along either axis.
+ */
+static void
+see(swarm_t* swarm, bot_t* bot, int atRow, int atColumn, bool scrolls)
+{
+  const int dr = atRow - bot->atRow;
+  const int dc = atColumn - bot->atColumn;
+  if (bot->atRow < 0 || (dr == 0 && dc == 0)) {
+    return;   // the bot did not move: another player's doing
+  }
+  for (int i = 0; i < bot->npending; i++) {
+    char key = bot->pending[(bot->firstPending + i) % MaxPending].key;
+    if (moves(key, dr, dc, scrolls && bot->windowed)) {
+      answer(swarm, bot, i);
+      return;
+    }
+  }
+}
+
+/**************** moves ****************/
+/* Could the key have moved the bot by (dr, dc) in its view?  A step
+ * moves it one spot, a sprint (capital) one or more, along the key's
+ * direction; in a window, the window may take up any part of the move,
+ * along either axis.
+ */
+static bool
+moves(char key, int dr, int dc, bool windowed)
+{
+  const bool sprint = strchr(Sprints, key) != NULL;
+  const char* step = strchr(Steps, sprint ? key - 'A' + 'a' : key);
+  if (step == NULL) {
+    return false;
+  }
+  const int kr = StepRows[step - Steps];
+  const int kc = StepColumns[step - Steps];
+
+  if (!windowed) {
+    // exactly the key's step, or a whole number of them
+    int n = kr != 0 ? dr * kr : dc * kc;
+    return n >= 1 && (sprint || n == 1) && dr == n * kr && dc == n * kc;
+  }
+  // each axis: no move where the key has none, otherwise none or some the key's way, one spot at most for a step
+  return (kr == 0 ? dr == 0 : dr * kr >= 0 && (sprint || dr * kr <= 1))
+      && (kc == 0 ? dc == 0 : dc * kc >= 0 && (sprint || dc * kc <= 1));
+}
+
+/**************** answer ****************/
+/* The bot's pending key 'which' was answered, now: time it, and count
+ * the keys sent before it as having had no effect.
+ */
+static void
+answer(swarm_t* swarm, bot_t* bot, int which)
+{
+  const double t = now();
+  swarm->noEffect += which;
+  bot->firstPending = (bot->firstPending + which) % MaxPending;
+  bot->npending -= which;
+
+  hist_record(swarm->latency, (uint64_t)((t - bot->pending[bot->firstPending].sent) * 1e6));
+  swarm->answered++;
+  bot->firstPending = (bot->firstPending + 1) % MaxPending;
+  bot->npending--;
+}
+
+/**************** kernelDrops ****************/
+/* Return the number of datagrams the kernel dropped, for want of room,
+ * on the bots' sockets, from the 'drops' column of /proc/net/udp;
+ * or -1 if that is not available.
+ */
+static long
+kernelDrops(swarm_t* swarm)
+{
+  FILE* fp = fopen("/proc/net/udp", "r");
+  if (fp == NULL) {
+    return -1;
+  }
+
+  long drops = 0;
+  char line[512];
+  if (fgets(line, sizeof(line), fp) == NULL) {   // skip the heading
+    fclose(fp);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    // sl local_address rem_address st tx:rx tr:when retrnsmt uid timeout
+    // inode ref pointer drops
+    unsigned localPort;
+    long drop;
+    if (sscanf(line, "%*d: %*x:%x %*x:%*x %*x %*x:%*x %*x:%*x %*x %*u %*d "
+               "%*u %*d %*x %ld", &localPort, &drop) != 2) {
+      continue;
+    }
+    for (int i = 0; i < swarm->nbots; i++) {
+      if (message_port(swarm->bots[i].sock) == (int)localPort) {
+        drops += drop;
+        break;
+      }
+    }
+  }
+  fclose(fp);
+  return drops;
+}
+
+/**************** report ****************/
+/* Print what happened during the run. */
+static void
+report(swarm_t* swarm, FILE* fp)
+{
+  double secs = now() - swarm->start;
+  int joined = 0;
+  for (int i = 0; i < swarm->nbots; i++) {
+    joined += swarm->bots[i].joined;
+  }
+
+  fprintf(fp, "bots: %d, %d playing at the end; %ld joins, %ld game overs\n",
+          swarm->nbots, joined, swarm->joins, swarm->gameOvers);
+  fprintf(fp, "elapsed: %.2f s\n", secs);
+  fprintf(fp, "sent: %ld keys (%.0f/s)\n", swarm->keysSent,
+          swarm->keysSent / secs);
+  fprintf(fp, "received: %ld messages (%.0f/s), %ld bytes (%.0f KB/s), "
+          "%ld views\n", swarm->messagesReceived,
+          swarm->messagesReceived / secs, swarm->bytesReceived,
+          swarm->bytesReceived / secs / 1024, swarm->displays);
+  fprintf(fp, "dropped by kernel: %ld datagrams\n", kernelDrops(swarm));
+  fprintf(fp, "keys: %ld answered, %ld of no effect, %ld unanswered\n",
+          swarm->answered, swarm->noEffect, swarm->unanswered);
+  hist_print(swarm->latency, fp, "key->DISPLAY latency", "us");
+}
@@ -0,0 +1,190 @@
+/*
+ * hist - a log-linear histogram of latencies
+ *
+ * See hist.h for the interface.
+ * Values below SubBuckets are counted exactly; above that, a value
+ * whose highest set bit is b falls into one of SubBuckets buckets
+ * spanning [2^b, 2^(b+1)).
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "hist.h"
+
+/**************** file-local constants ****************/
+#define SubBits 4                        // log2 of buckets per power of two
+static const uint64_t SubBuckets = 1 << SubBits;
+#define MaxBits 40                       // larger values count as 2^40-1
+#define NumBuckets ((MaxBits - SubBits + 1) << SubBits)
+
+/**************** file-local types ****************/
+struct hist {
+  uint64_t counts[NumBuckets];   // count of values in each bucket
+  uint64_t count;                // number of values
+  uint64_t max;                  // largest value
+  double sum;                    // sum of values, for the mean
+};
+
+/**************** file-local functions ****************/
+static int bucketOf(uint64_t value);
+static uint64_t bucketTop(int bucket);
+
+/**************** hist_new ****************/
+/* see hist.h for description */
+hist_t*
+hist_new(void)
+{
+  return calloc(1, sizeof(hist_t));
+}
+
+/**************** bucketOf ****************/
+/* Return the bucket in which the value is counted. */
+static int
+bucketOf(uint64_t value)
+{
+  if (value >= ((uint64_t)1 << MaxBits)) {
+    value = ((uint64_t)1 << MaxBits) - 1;
+  }
+  if (value < SubBuckets) {
+    return (int)value;
+  }
+  int bit = 63 - __builtin_clzll(value);           // highest set bit
+  int sub = (int)(value >> (bit - SubBits)) & (SubBuckets - 1);
+  return ((bit - SubBits + 1) << SubBits) + sub;
+}
+
+/**************** bucketTop ****************/
+/* Return the largest value counted in the bucket. */
+static uint64_t
+bucketTop(int bucket)
+{
+  if (bucket < (int)SubBuckets) {
+    return bucket;
+  }
+  int bit = (bucket >> SubBits) + SubBits - 1;
+  uint64_t sub = bucket & (SubBuckets - 1);
+  uint64_t width = (uint64_t)1 << (bit - SubBits);
+  return ((uint64_t)1 << bit) + (sub + 1) * width - 1;
+}
+
+/**************** hist_record ****************/
+/* see hist.h for description */
+void
+hist_record(hist_t* hist, uint64_t value)
+{
+  if (hist != NULL) {
+    hist->counts[bucketOf(value)]++;
+    hist->count++;
+    hist->sum += value;
+    if (value > hist->max) {
+      hist->max = value;
+    }
+  }
+}
+
+/**************** hist_merge ****************/
+/* see hist.h for description */
+void
+hist_merge(hist_t* into, const hist_t* from)
+{
+  if (into != NULL && from != NULL) {
+    for (int i = 0; i < NumBuckets; i++) {
+      into->counts[i] += from->counts[i];
+    }
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->max > into->max) {
+      into->max = from->max;
+    }
+  }
+}
+
+/**************** hist_count ****************/
+/* see hist.h for description */
+uint64_t
+hist_count(const hist_t* hist)
+{
+  return hist == NULL ? 0 : hist->count;
+}
+
+/**************** hist_max ****************/
+/* see hist.h for description */
+uint64_t
+hist_max(const hist_t* hist)
+{
+  return hist == NULL ? 0 : hist->max;
+}
+
+/**************** hist_mean ****************/
+/* see hist.h for description */
+double
+hist_mean(const hist_t* hist)
+{
+  return (hist == NULL || hist->count == 0) ? 0 : hist->sum / hist->count;
+}
+
+/**************** hist_percentile ****************/
+/* see hist.h for description */
+uint64_t
+hist_percentile(const hist_t* hist, const double percentile)
+{
+  if (hist == NULL || hist->count == 0) {
+    return 0;
+  }
+
+  // the rank of the value we want, counting from 1
+  uint64_t rank = (uint64_t)(percentile / 100.0 * hist->count + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  for (int i = 0; i < NumBuckets; i++) {
+    seen += hist->counts[i];
+    if (seen >= rank) {
+      uint64_t top = bucketTop(i);
+      return top < hist->max ? top : hist->max;
+    }
+  }
+  return hist->max;
+}
+
+/**************** hist_print ****************/
+/* see hist.h for description */
+void
+hist_print(const hist_t* hist, FILE* fp, const char* name, const char* units)
+{
+  if (fp == NULL) {
+    return;
+  }
+  fprintf(fp, "%s: count %llu, mean %.1f, p50 %llu, p90 %llu, p99 %llu, "
+          "p99.9 %llu, max %llu %s\n", name,
+          (unsigned long long)hist_count(hist), hist_mean(hist),
+          (unsigned long long)hist_percentile(hist, 50),
+          (unsigned long long)hist_percentile(hist, 90),
+          (unsigned long long)hist_percentile(hist, 99),
+          (unsigned long long)hist_percentile(hist, 99.9),
+          (unsigned long long)hist_max(hist), units);
+}
+
+/**************** hist_reset ****************/
+/* see hist.h for description */
+void
+hist_reset(hist_t* hist)
+{
+  if (hist != NULL) {
+    memset(hist, 0, sizeof(hist_t));
+  }
+}
+
+/**************** hist_delete ****************/
+/* see hist.h for description */
+void
+hist_delete(hist_t* hist)
+{
+  free(hist);
+}
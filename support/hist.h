@@ -0,0 +1,86 @@
+/*
+ * hist - a log-linear histogram of latencies (or any non-negative counts)
+ *
+ * Values are counted in buckets whose width grows with the value, in
+ * the manner of an HDR histogram: every power of two is split into 16
+ * buckets, so any value is recorded within about 6% of itself, and a
+ * histogram of values up to 2^40 takes a few kilobytes.  Recording is
+ * a few arithmetic operations and never allocates.
+ *
+ * Typical use, to measure latency in microseconds:
+ *   hist_t* hist = hist_new();
+ *   hist_record(hist, micros);     // many times
+ *   hist_print(hist, stdout, "key->DISPLAY", "us");
+ *   hist_delete(hist);
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#ifndef _HIST_H_
+#define _HIST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/****************** types *********************/
+typedef struct hist hist_t;  // opaque to users of this module
+
+/****************** functions *********************/
+
+/******************************************/
+/* hist_new: create an empty histogram.
+ * Function returns: the histogram, or NULL if out of memory.
+ * Caller expectations: call hist_delete when done.
+ */
+hist_t* hist_new(void);
+
+/******************************************/
+/* hist_record: count one value.
+ */
+void hist_record(hist_t* hist, uint64_t value);
+
+/******************************************/
+/* hist_merge: add every value counted in 'from' into 'into'.
+ */
+void hist_merge(hist_t* into, const hist_t* from);
+
+/******************************************/
+/* hist_count: return the number of values counted.
+ */
+uint64_t hist_count(const hist_t* hist);
+
+/******************************************/
+/* hist_max: return the largest value counted (exactly), or 0 if none.
+ */
+uint64_t hist_max(const hist_t* hist);
+
+/******************************************/
+/* hist_mean: return the mean of the values counted, or 0 if none.
+ */
+double hist_mean(const hist_t* hist);
+
+/******************************************/
+/* hist_percentile: return (about) the given percentile, 0..100, of the
+ * values counted; that is, the upper end of the bucket in which it falls.
+ * Returns 0 if no values have been counted.
+ */
+uint64_t hist_percentile(const hist_t* hist, const double percentile);
+
+/******************************************/
+/* hist_print: print one line summarizing the histogram:
+ *   name: count N, mean M, p50 ., p90 ., p99 ., p99.9 ., max . units
+ */
+void hist_print(const hist_t* hist, FILE* fp, const char* name,
+                const char* units);
+
+/******************************************/
+/* hist_reset: forget every value counted.
+ */
+void hist_reset(hist_t* hist);
+
+/******************************************/
+/* hist_delete: free the histogram.
+ */
+void hist_delete(hist_t* hist);
+
+#endif // _HIST_H_
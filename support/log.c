@@ -1,14 +1,71 @@
 /* 
  * log module - a simple way to log messages to a file
  * 
+ * The asynchronous backend gives each logging thread its own spsc ring,
+ * so each ring has exactly one producer, and one writer thread consumes
+ * them all.  The writer sleeps on an eventfd while every ring is empty,
+ * and says so; a producer writes the eventfd only then, so while the
+ * writer is busy, producers make no system call to wake it.
+ * 
  * David Kotz, May 2019
  */
 
+#define _GNU_SOURCE     // for eventfd (Linux)
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include "log.h"
+#include "spsc.h"
+
+/**************** global variables ****************/
+log_level_t flogLevel = Log_Info;   // see log.h
+
+/**************** file-local constants ****************/
+enum { MaxRings = 256 };            // most threads that may log asynchronously
+
+/**************** file-local global variables ****************/
+// The asynchronous backend, for one file at a time
+static struct {
+  _Atomic(FILE*) fp;                  // the file logged asynchronously, or NULL
+  size_t ringBytes;                   // capacity of each thread's ring
+  _Atomic(spsc_t*) rings[MaxRings];   // one for each thread that has logged
+  atomic_int nrings;                  // rings claimed
+  atomic_bool stopping;               // the writer should drain the rings once more, then stop
+  atomic_long dropped;                // lines that found their ring full
+  atomic_uint generation;             // counts flog_async calls, to tell a thread its ring is stale
+  int wakeFd;                         // eventfd on which the writer sleeps
+  atomic_bool sleeping;               // the writer is (about to be) asleep
+  pthread_t writer;
+} async;
+
+// Each thread's ring, and the generation it belongs to
+static _Thread_local struct {
+  unsigned int generation;
+  spsc_t* ring;
+} threadRing;
+
+/**************** file-local functions ****************/
+static bool async_log(FILE* fp, const char* format, ...);
+static spsc_t* thread_ring(void);
+static void async_wake(void);
+static bool async_empty(void);
+static void* async_write(void* arg);
+
+/**************** flog_setLevel ****************/
+/* see log.h for description */
+void
+flog_setLevel(const log_level_t level)
+{
+  flogLevel = level;
+}
 
 /**************** flog_init ****************/
 /* Initialize the logging module.
@@ -26,7 +83,7 @@ void flog_init(FILE* fp)
 void
 flog_s(FILE* fp, const char* format, const char* str)
 {
-  if (fp != NULL && format != NULL && str != NULL) {
+  if (fp != NULL && format != NULL && str != NULL && !async_log(fp, format, str)) {
     fprintf(fp, format, str);
     fputc('\n', fp);
     fflush(fp);
@@ -41,7 +98,7 @@ flog_s(FILE* fp, const char* format, const char* str)
 void
 flog_d(FILE* fp, const char* format, const int num)
 {
-  if (fp != NULL && format != NULL) {
+  if (fp != NULL && format != NULL && !async_log(fp, format, num)) {
     fprintf(fp, format, num);
     fputc('\n', fp);
     fflush(fp);
@@ -56,7 +113,7 @@ flog_d(FILE* fp, const char* format, const int num)
 void
 flog_c(FILE* fp, const char* format, const char ch)
 {
-  if (fp != NULL && format != NULL) {
+  if (fp != NULL && format != NULL && !async_log(fp, format, ch)) {
     fprintf(fp, format, ch);
     fputc('\n', fp);
     fflush(fp);
@@ -70,7 +127,7 @@ flog_c(FILE* fp, const char* format, const char ch)
 void
 flog_v(FILE* fp, const char* str)
 {
-  if (fp != NULL && str != NULL) {
+  if (fp != NULL && str != NULL && !async_log(fp, "%s", str)) {
     fputs(str, fp);
     fputc('\n', fp);
     fflush(fp);
@@ -86,7 +143,7 @@ flog_v(FILE* fp, const char* str)
 void
 flog_e(FILE* fp, const char* str)
 {
-  if (fp != NULL && str != NULL) {
+  if (fp != NULL && str != NULL && !async_log(fp, "%s: %s", str, strerror(errno))) {
     fprintf(fp, "%s: %s\n", str, strerror(errno));
     fflush(fp);
   }
@@ -101,3 +158,208 @@ flog_done(FILE* fp)
 {
   flog_v(fp, "END OF LOG");
 }
+
+/**************** flog_async ****************/
+/* see log.h for description */
+void
+flog_async(FILE* fp, const size_t ringBytes)
+{
+  if (fp == NULL || atomic_load(&async.fp) != NULL) {
+    return;
+  }
+  async.wakeFd = eventfd(0, EFD_CLOEXEC);
+  if (async.wakeFd < 0) {
+    return;         // logging stays synchronous
+  }
+  async.ringBytes = ringBytes;
+  atomic_store(&async.sleeping, false);
+  atomic_store(&async.nrings, 0);
+  atomic_store(&async.stopping, false);
+  atomic_store(&async.dropped, 0);
+  atomic_fetch_add(&async.generation, 1);
+  atomic_store(&async.fp, fp);
+
+  // the writer takes no signals, leaving them to the program's own threads
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  if (pthread_create(&async.writer, NULL, async_write, NULL) != 0) {
+    atomic_store(&async.fp, NULL);
+    close(async.wakeFd);
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/**************** flog_sync ****************/
+/* see log.h for description */
+void
+flog_sync(FILE* fp)
+{
+  if (fp == NULL || atomic_load(&async.fp) != fp) {
+    return;
+  }
+
+  // new lines go straight to the file, while the writer drains what is left
+  atomic_store(&async.fp, NULL);
+  atomic_store(&async.stopping, true);
+  async_wake();
+  pthread_join(async.writer, NULL);
+  close(async.wakeFd);
+
+  int nrings = atomic_load(&async.nrings);
+  for (int i = 0; i < nrings && i < MaxRings; i++) {
+    spsc_delete(atomic_exchange(&async.rings[i], NULL));
+  }
+  atomic_fetch_add(&async.generation, 1);
+
+  if (atomic_load(&async.dropped) > 0) {
+    flog_d(fp, "log: %d lines dropped, their rings full", (int)atomic_load(&async.dropped));
+  }
+}
+
+/**************** flog_dropped ****************/
+/* see log.h for description */
+long
+flog_dropped(void)
+{
+  return atomic_load(&async.dropped);
+}
+
+/**************** async_log ****************/
+/* 
+ * If fp is logged asynchronously, format a line into this thread's ring
+ * (or count it dropped, if the ring is full) and return true;
+ * otherwise return false, for the caller to write the line itself.
+ */
+static bool
+async_log(FILE* fp, const char* format, ...)
+{
+  if (fp != atomic_load(&async.fp)) {
+    return false;
+  }
+  spsc_t* ring = thread_ring();
+  if (ring == NULL) {
+    return false;   // no ring to be had: write synchronously
+  }
+
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  if (length < 0) {
+    return true;
+  }
+
+  // the line, then a newline in place of vsnprintf's null
+  char* line = spsc_reserve(ring, length + 1);
+  if (line == NULL) {
+    atomic_fetch_add(&async.dropped, 1);
+    return true;
+  }
+  va_start(args, format);
+  vsnprintf(line, length + 1, format, args);
+  va_end(args);
+  line[length] = '\n';
+  spsc_commit(ring);
+  async_wake();
+  return true;
+}
+
+/**************** async_wake ****************/
+/* 
+ * Wake the writer, if it is asleep.
+ */
+static void
+async_wake(void)
+{
+  if (atomic_exchange(&async.sleeping, false)) {
+    eventfd_write(async.wakeFd, 1);
+  }
+}
+
+/**************** thread_ring ****************/
+/* 
+ * Return this thread's ring, creating it the first time the thread logs
+ * asynchronously; NULL if there is no room for another.
+ */
+static spsc_t*
+thread_ring(void)
+{
+  unsigned int generation = atomic_load(&async.generation);
+  if (threadRing.generation != generation) {
+    threadRing.generation = generation;
+    threadRing.ring = NULL;
+
+    int slot = atomic_fetch_add(&async.nrings, 1);
+    if (slot < MaxRings) {
+      threadRing.ring = spsc_new(async.ringBytes);
+      atomic_store(&async.rings[slot], threadRing.ring);
+    }
+  }
+  return threadRing.ring;
+}
+
+/**************** async_empty ****************/
+/* 
+ * Return true if every ring is empty.
+ */
+static bool
+async_empty(void)
+{
+  int nrings = atomic_load(&async.nrings);
+  for (int i = 0; i < nrings && i < MaxRings; i++) {
+    spsc_t* ring = atomic_load(&async.rings[i]);
+    size_t length;
+    if (ring != NULL && spsc_peek(ring, &length) != NULL) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**************** async_write ****************/
+/* 
+ * The writer thread: drains every ring to the file, flushing after each
+ * sweep that found lines, and sleeping after each that did not, until
+ * asked to stop; then drains them once more.
+ */
+static void*
+async_write(void* arg)
+{
+  FILE* fp = atomic_load(&async.fp);
+  bool stopping;
+
+  do {
+    // read before the sweep, so the last sweep sees every line logged before the stop
+    stopping = atomic_load(&async.stopping);
+
+    size_t written = 0;
+    int nrings = atomic_load(&async.nrings);
+    for (int i = 0; i < nrings && i < MaxRings; i++) {
+      spsc_t* ring = atomic_load(&async.rings[i]);
+      const void* line;
+      size_t length;
+      while (ring != NULL && (line = spsc_peek(ring, &length)) != NULL) {
+        fwrite(line, 1, length, fp);
+        spsc_release(ring);
+        written += length;
+      }
+    }
+
+    if (written > 0) {
+      fflush(fp);
+    } else if (!stopping) {
+      // say we're going to sleep, then make sure nothing slipped in
+      atomic_store(&async.sleeping, true);
+      atomic_thread_fence(memory_order_seq_cst);
+      if (!async_empty() || atomic_load(&async.stopping)) {
+        atomic_store(&async.sleeping, false);
+        continue;
+      }
+      eventfd_t count;
+      eventfd_read(async.wakeFd, &count);
+    }
+  } while (!stopping);
+
+  return NULL;
+}
@@ -16,6 +16,18 @@
  * its own logging fp and thus can independently control whether to log and
  * where to log.
  * 
+ * By default each line is written, and flushed, as it is logged.  A busy
+ * program can instead log to one file asynchronously (flog_async): each
+ * thread formats its lines into a lock-free ring of its own, and a
+ * background thread writes the rings to the file in large batches.
+ * 
+ * Lines may be logged at a level (log_enabled): errors, information, or
+ * debugging detail, such as every datagram sent and received.  Code
+ * above the level LOG_LEVEL, fixed when the program is compiled, is left
+ * out of the program; above the level set when it runs (flog_setLevel,
+ * by default Log_Info), it is skipped, with whatever work it takes to
+ * build its lines.
+ * 
  * David Kotz, May 2019
  */
 
@@ -24,6 +36,23 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+
+/*********** log levels ****************/
+typedef enum log_level {
+  Log_Error,        // something went wrong
+  Log_Info,         // the program's progress: the default
+  Log_Debug         // detail, such as each message sent and received
+} log_level_t;
+
+/* LOG_LEVEL: the highest level compiled in; e.g., -DLOG_LEVEL=Log_Info
+ * leaves out every line logged at Log_Debug, and the work to build it.
+ */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL Log_Debug
+#endif
+
+extern log_level_t flogLevel;   // the highest level logged; see flog_setLevel
 
 /*********** file-local global variable ****************/
 /* Here is an example of a judicious use of a global variable.
@@ -42,6 +71,23 @@ static FILE* logFP = NULL;
  * the logFP to the flog_x functions that are coded in log.c.
  */
 
+void flog_setLevel(const log_level_t level);
+/* flog_setLevel: log lines up to this level, for every file; set it
+ * before other threads start logging.  Lines above LOG_LEVEL are left
+ * out regardless.
+ */
+
+static inline bool log_enabled(const log_level_t level) {
+  return level <= LOG_LEVEL && level <= flogLevel && logFP != NULL;
+}
+/* log_enabled: is a line at this level logged?  Guard the lines above
+ * Log_Info, with the work to build them, thus:
+ *   if (log_enabled(Log_Debug)) {
+ *     log_s("sent to %s", message_stringAddr(to));
+ *   }
+ * Below LOG_LEVEL, the compiler drops the guarded code altogether.
+ */
+
 void flog_init(FILE* fp);
 static inline void log_init(FILE* fp) { logFP = fp; flog_init(logFP); }
 /* log_init: to begin logging, provide an fp open for writing;
@@ -83,6 +129,28 @@ static inline void log_e(const char* str) { flog_e(logFP, str); }
  * This function is best used immediately after a system call.
  */
 
+void flog_async(FILE* fp, const size_t ringBytes);
+/* flog_async: from now on, write the log lines for fp asynchronously.
+ * Each thread logging to fp formats its lines into a ring of ringBytes
+ * bytes of its own (an spsc queue), without a lock or a system call;
+ * a writer thread drains every ring to fp in batches, flushing once per
+ * batch.  A line that finds its ring full is dropped, and counted
+ * (see flog_dropped).  Only one fp at a time is asynchronous; if the writer
+ * cannot be started, logging stays synchronous.
+ * Call flog_sync(fp) once the other threads have stopped logging.
+ */
+
+void flog_sync(FILE* fp);
+/* flog_sync: write out every line still in the rings, note in the log how
+ * many lines were dropped (if any), stop the writer, and return fp to
+ * synchronous logging.
+ */
+
+long flog_dropped(void);
+/* flog_dropped: how many lines have been dropped for want of room in
+ * a ring, since flog_async.
+ */
+
 void flog_done(FILE* fp);
 static inline void log_done(void) { flog_done(logFP); logFP = NULL; }
 /* log_done: call this when finished logging, or when you want to pause
@@ -0,0 +1,410 @@
+/*
+ * mapgen - generate a synthetic Nuggets map of any size
+ *
+ * Prints to stdout a map in the format the server loads: rows of
+ * characters, ' ' solid rock, '-' '|' '+' room walls and corners,
+ * '.' room floor, and '#' passage (including doorways in room walls).
+ *
+ * The map is laid out on a lattice of cells.  Each cell holds either a
+ * room or, if the cell is left empty, a junction of passages; the gaps
+ * between cells hold the passages.  A random spanning tree of the
+ * lattice, plus a few extra links, decides which neighbouring cells are
+ * joined, so every room can be reached from every other.  Passages run
+ * only through rock, and doorways are never at corners, so the map is
+ * valid whatever its size.
+ *
+ * usage: mapgen [-r rows] [-c columns] [-d density] [-p passage] [-o open] [-s seed]
+ *   rows, columns: size of the map (default 25 by 80; thousands are fine)
+ *   density: fraction of cells that hold a room (default 0.8)
+ *   passage: length of the passages between neighbouring cells (default 6)
+ *   open: fraction of the map meant to be room floor (default 0.3); the
+ *         rooms can grow only to fill their cells, so this is an upper bound
+ *   seed: seed for the random layout (default 1)
+ * A summary goes to stderr, including the size of a DISPLAY of the whole
+ * map, and whether it fits in one datagram.
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#define _POSIX_C_SOURCE 200809L // for getopt
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+/**************** file-local constants ****************/
+static const int RoomRows = 12;       // tallest room, walls included
+static const int RoomColumns = 30;    // widest room, walls included
+static const double ExtraLinks = 0.15; // chance of linking cells not in the tree
+static const int MaxDatagram = 65507; // largest UDP payload
+
+/**************** file-local types ****************/
+// One cell of the lattice: a room, or a junction of passages
+typedef struct cell {
+  bool isRoom;
+  int top, left, bottom, right;  // the room's walls; for a junction, all
+                                 // four give the junction's spot
+} cell_t;
+
+typedef struct map {
+  char** grid;
+  int rows, columns;
+  cell_t* cells;
+  int latticeRows, latticeColumns;
+  int cellRows, cellColumns;     // size of a cell, gaps included
+  int boxRows, boxColumns;       // part of a cell where its room may be
+  int passage;                   // width of the gaps between boxes
+  uint32_t random;               // state of the random-number generator
+} map_t;
+
+/**************** file-local functions ****************/
+static uint32_t nextRandom(map_t* map);
+static int randomBetween(map_t* map, int low, int high);
+static cell_t* cellAt(map_t* map, int i, int j);
+static void placeCells(map_t* map, double density, double open);
+static void linkCells(map_t* map);
+static void linkAcross(map_t* map, int i, int j);
+static void linkDown(map_t* map, int i, int j);
+static void carve(map_t* map, int r1, int c1, int r2, int c2);
+static void summarize(map_t* map, FILE* fp);
+
+/***************** main *******************************/
+int
+main(const int argc, char* argv[])
+{
+  map_t map = { .rows = 25, .columns = 80, .passage = 6, .random = 1 };
+  double density = 0.8;
+  double open = 0.3;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "r:c:d:p:o:s:")) != -1) {
+    switch (opt) {
+      case 'r': map.rows = atoi(optarg); break;
+      case 'c': map.columns = atoi(optarg); break;
+      case 'd': density = atof(optarg); break;
+      case 'p': map.passage = atoi(optarg); break;
+      case 'o': open = atof(optarg); break;
+      case 's': map.random = atoi(optarg); break;
+      default: map.rows = -1; break;
+    }
+  }
+
+  // a cell is a room's box and a gap; the map holds at least one cell
+  map.cellRows = RoomRows + map.passage;
+  map.cellColumns = RoomColumns + map.passage;
+  if (map.cellRows > map.rows) {
+    map.cellRows = map.rows;
+  }
+  if (map.cellColumns > map.columns) {
+    map.cellColumns = map.columns;
+  }
+  map.boxRows = map.cellRows - map.passage;
+  map.boxColumns = map.cellColumns - map.passage;
+
+  if (optind != argc || map.passage < 3 || map.boxRows < 3 || map.boxColumns < 3
+      || density <= 0 || density > 1 || open <= 0 || open > 1) {
+    fprintf(stderr, "usage: %s [-r rows] [-c columns] [-d density (0..1]] "
+            "[-p passage (>= 3)] [-o open (0..1]] [-s seed]\n"
+            "  the map must have room for one room (3 by 3) and its passages\n",
+            argv[0]);
+    return 1;
+  }
+  if (map.random == 0) {
+    map.random = 1;  // the generator must never be zero
+  }
+
+  map.latticeRows = map.rows / map.cellRows;
+  map.latticeColumns = map.columns / map.cellColumns;
+  map.cells = calloc(map.latticeRows * map.latticeColumns, sizeof(cell_t));
+  map.grid = calloc(map.rows, sizeof(char*));
+  if (map.cells == NULL || map.grid == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 2;
+  }
+  for (int r = 0; r < map.rows; r++) {
+    map.grid[r] = malloc(map.columns + 1);
+    if (map.grid[r] == NULL) {
+      fprintf(stderr, "out of memory\n");
+      return 2;
+    }
+    memset(map.grid[r], ' ', map.columns);
+    map.grid[r][map.columns] = '\0';
+  }
+
+  placeCells(&map, density, open);
+  linkCells(&map);
+
+  for (int r = 0; r < map.rows; r++) {
+    puts(map.grid[r]);
+  }
+  summarize(&map, stderr);
+
+  for (int r = 0; r < map.rows; r++) {
+    free(map.grid[r]);
+  }
+  free(map.grid);
+  free(map.cells);
+  return 0;
+}
+
+/**************** nextRandom ****************/
+/* A small, fast, seeded generator (xorshift32). */
+static uint32_t
+nextRandom(map_t* map)
+{
+  uint32_t x = map->random;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return map->random = x;
+}
+
+/**************** randomBetween ****************/
+/* Return a random integer from low to high, inclusive. */
+static int
+randomBetween(map_t* map, int low, int high)
+{
+  return low + nextRandom(map) % (high - low + 1);
+}
+
+/**************** cellAt ****************/
+static cell_t*
+cellAt(map_t* map, int i, int j)
+{
+  return &map->cells[i * map->latticeColumns + j];
+}
+
+/**************** placeCells ****************/
+/* Make each cell a room (with the given chance) or a junction, and draw
+ * the rooms.  Rooms are sized so that, on average, the floor fills the
+ * given fraction of the map, as far as the cells allow.
+ */
+static void
+placeCells(map_t* map, double density, double open)
+{
+  const int maxHeight = map->boxRows - 2;     // interior of the largest room
+  const int maxWidth = map->boxColumns - 2;
+  const double area = open * map->cellRows * map->cellColumns / density;
+  double scale = sqrt(area / (maxHeight * maxWidth));
+  if (scale > 1) {
+    scale = 1;
+  }
+
+  bool anyRoom = false;
+  for (int i = 0; i < map->latticeRows; i++) {
+    for (int j = 0; j < map->latticeColumns; j++) {
+      cell_t* cell = cellAt(map, i, j);
+      const int top = i * map->cellRows;
+      const int left = j * map->cellColumns;
+      bool last = (i == map->latticeRows - 1 && j == map->latticeColumns - 1);
+      cell->isRoom = (nextRandom(map) % 1000 < density * 1000)
+        || (last && !anyRoom);   // there must be a room somewhere
+
+      if (!cell->isRoom) {
+        // a junction in the middle of the box
+        cell->top = cell->bottom = top + map->boxRows / 2;
+        cell->left = cell->right = left + map->boxColumns / 2;
+        map->grid[cell->top][cell->left] = '#';
+        continue;
+      }
+      anyRoom = true;
+
+      // size within 30% of the scaled size, then place within the box
+      int height = round(maxHeight * scale * (0.7 + 0.6 * (nextRandom(map) % 1000) / 1000.0));
+      int width = round(maxWidth * scale * (0.7 + 0.6 * (nextRandom(map) % 1000) / 1000.0));
+      height = height < 1 ? 1 : height > maxHeight ? maxHeight : height;
+      width = width < 1 ? 1 : width > maxWidth ? maxWidth : width;
+      cell->top = top + randomBetween(map, 0, maxHeight - height);
+      cell->left = left + randomBetween(map, 0, maxWidth - width);
+      cell->bottom = cell->top + height + 1;
+      cell->right = cell->left + width + 1;
+
+      for (int r = cell->top; r <= cell->bottom; r++) {
+        for (int c = cell->left; c <= cell->right; c++) {
+          bool rowEdge = (r == cell->top || r == cell->bottom);
+          bool columnEdge = (c == cell->left || c == cell->right);
+          map->grid[r][c] = rowEdge && columnEdge ? '+'
+                          : rowEdge ? '-' : columnEdge ? '|' : '.';
+        }
+      }
+    }
+  }
+}
+
+/**************** linkCells ****************/
+/* Join the cells by passages: every link of a random spanning tree of
+ * the lattice (found by a depth-first walk), and a few more.
+ */
+static void
+linkCells(map_t* map)
+{
+  const int ncells = map->latticeRows * map->latticeColumns;
+  bool* visited = calloc(ncells, sizeof(bool));
+  bool* linkedAcross = calloc(ncells, sizeof(bool));  // to the right
+  bool* linkedDown = calloc(ncells, sizeof(bool));    // to the cell below
+  int* stack = malloc(ncells * sizeof(int));
+  if (visited == NULL || linkedAcross == NULL || linkedDown == NULL
+      || stack == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(2);
+  }
+
+  int depth = 0;
+  stack[depth++] = 0;
+  visited[0] = true;
+  while (depth > 0) {
+    const int n = stack[depth - 1];
+    const int i = n / map->latticeColumns;
+    const int j = n % map->latticeColumns;
+
+    // pick an unvisited neighbour at random
+    int next[4];
+    int nnext = 0;
+    if (i > 0 && !visited[n - map->latticeColumns]) {
+      next[nnext++] = n - map->latticeColumns;
+    }
+    if (i < map->latticeRows - 1 && !visited[n + map->latticeColumns]) {
+      next[nnext++] = n + map->latticeColumns;
+    }
+    if (j > 0 && !visited[n - 1]) {
+      next[nnext++] = n - 1;
+    }
+    if (j < map->latticeColumns - 1 && !visited[n + 1]) {
+      next[nnext++] = n + 1;
+    }
+    if (nnext == 0) {
+      depth--;
+      continue;
+    }
+
+    const int m = next[nextRandom(map) % nnext];
+    const int low = n < m ? n : m;
+    if (m == n + 1 || m == n - 1) {
+      linkedAcross[low] = true;
+    } else {
+      linkedDown[low] = true;
+    }
+    visited[m] = true;
+    stack[depth++] = m;
+  }
+
+  for (int i = 0; i < map->latticeRows; i++) {
+    for (int j = 0; j < map->latticeColumns; j++) {
+      const int n = i * map->latticeColumns + j;
+      const bool extraAcross = nextRandom(map) % 1000 < ExtraLinks * 1000;
+      const bool extraDown = nextRandom(map) % 1000 < ExtraLinks * 1000;
+      if (j < map->latticeColumns - 1 && (linkedAcross[n] || extraAcross)) {
+        linkAcross(map, i, j);
+      }
+      if (i < map->latticeRows - 1 && (linkedDown[n] || extraDown)) {
+        linkDown(map, i, j);
+      }
+    }
+  }
+
+  free(visited);
+  free(linkedAcross);
+  free(linkedDown);
+  free(stack);
+}
+
+/**************** linkAcross ****************/
+/* Join cell (i,j) to cell (i,j+1): out of a doorway in the right wall
+ * of the first, along to the middle of the gap between their boxes, up
+ * or down, and along into a doorway in the left wall of the second.
+ */
+static void
+linkAcross(map_t* map, int i, int j)
+{
+  cell_t* from = cellAt(map, i, j);
+  cell_t* to = cellAt(map, i, j + 1);
+  const int gap = j * map->cellColumns + map->boxColumns + map->passage / 2;
+
+  int r1 = from->top, c1 = from->right;
+  if (from->isRoom) {
+    r1 = randomBetween(map, from->top + 1, from->bottom - 1);
+    map->grid[r1][c1++] = '#';
+  }
+  int r2 = to->top, c2 = to->left;
+  if (to->isRoom) {
+    r2 = randomBetween(map, to->top + 1, to->bottom - 1);
+    map->grid[r2][c2--] = '#';
+  }
+
+  carve(map, r1, c1, r1, gap);
+  carve(map, r1, gap, r2, gap);
+  carve(map, r2, gap, r2, c2);
+}
+
+/**************** linkDown ****************/
+/* Join cell (i,j) to cell (i+1,j), as linkAcross does but downward. */
+static void
+linkDown(map_t* map, int i, int j)
+{
+  cell_t* from = cellAt(map, i, j);
+  cell_t* to = cellAt(map, i + 1, j);
+  const int gap = i * map->cellRows + map->boxRows + map->passage / 2;
+
+  int r1 = from->bottom, c1 = from->left;
+  if (from->isRoom) {
+    c1 = randomBetween(map, from->left + 1, from->right - 1);
+    map->grid[r1++][c1] = '#';
+  }
+  int r2 = to->top, c2 = to->left;
+  if (to->isRoom) {
+    c2 = randomBetween(map, to->left + 1, to->right - 1);
+    map->grid[r2--][c2] = '#';
+  }
+
+  carve(map, r1, c1, gap, c1);
+  carve(map, gap, c1, gap, c2);
+  carve(map, gap, c2, r2, c2);
+}
+
+/**************** carve ****************/
+/* Turn the rock along a straight line, ends included, into passage. */
+static void
+carve(map_t* map, int r1, int c1, int r2, int c2)
+{
+  const int dr = (r2 > r1) - (r2 < r1);
+  const int dc = (c2 > c1) - (c2 < c1);
+  for (int r = r1, c = c1; ; r += dr, c += dc) {
+    if (map->grid[r][c] == ' ') {
+      map->grid[r][c] = '#';
+    }
+    if (r == r2 && c == c2) {
+      break;
+    }
+  }
+}
+
+/**************** summarize ****************/
+/* Print what kind of map this is, and how big its messages are. */
+static void
+summarize(map_t* map, FILE* fp)
+{
+  long floor = 0, passage = 0;
+  int rooms = 0;
+  for (int r = 0; r < map->rows; r++) {
+    for (int c = 0; c < map->columns; c++) {
+      floor += (map->grid[r][c] == '.');
+      passage += (map->grid[r][c] == '#');
+    }
+  }
+  for (int n = 0; n < map->latticeRows * map->latticeColumns; n++) {
+    rooms += map->cells[n].isRoom;
+  }
+
+  // "DISPLAY\n" and a row of the map, with a newline, for each row
+  const long display = 8 + (long)map->rows * (map->columns + 1) - 1;
+  fprintf(fp, "%d x %d map: %d rooms in a %d x %d lattice, %ld floor "
+          "(%.1f%% open), %ld passage\n", map->rows, map->columns, rooms,
+          map->latticeRows, map->latticeColumns, floor,
+          100.0 * floor / ((double)map->rows * map->columns), passage);
+  fprintf(fp, "a DISPLAY of the whole map is %ld bytes: %s one datagram "
+          "(%d bytes)\n", display,
+          display <= MaxDatagram ? "fits in" : "does NOT fit in", MaxDatagram);
+}
@@ -13,6 +13,7 @@
  * David Kotz - May 2019
  */
 
+#define _GNU_SOURCE     // for epoll, timerfd, and friends (Linux)
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -23,6 +24,11 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/stat.h>
+#include <linux/filter.h>
+#include <stdint.h>
 #include <math.h>
 #include "message.h"
 #include "log.h"
@@ -35,6 +41,13 @@
 static const int MinPort = 1024;
 static const int MaxPort = 65535;
 
+/* An event loop collects at most this many epoll events per wakeup,
+ * and handles at most LoopDrainBudget messages from one socket before
+ * giving the other sources of the loop a turn.
+ */
+static const int LoopMaxEvents = 64;
+static const int LoopDrainBudget = 64;
+
 /**************** file-local global variables ****************/
 /* This is an example of a judicious use of a global variable.
  * This module provides init() and done() functions that allow it
@@ -48,6 +61,66 @@ static const int MaxPort = 65535;
  */
 static int ourSocket = 0;     // socket on which to receive messages
 
+/* While an event loop runs a message handler, this is the socket on
+ * which the message arrived, so that message_send() replies from it.
+ * Each thread running a loop has its own.
+ */
+static _Thread_local int replySocket = 0;
+
+/* If set, message_send() from this thread calls the hook instead of
+ * sending; see message_setSendHook().
+ */
+static _Thread_local void (*sendHook)(void* arg, const addr_t to,
+                                      const char* message) = NULL;
+static _Thread_local void* sendHookArg = NULL;
+
+/**************** file-local types ****************/
+/* Each socket, input, or timer watched by an event loop is a 'source';
+ * epoll hands us back a pointer to the source when its fd is ready.
+ */
+typedef enum { SourceSocket, SourceInput, SourceTimer } sourceType_t;
+
+typedef struct source {
+  sourceType_t type;      // what kind of source this is
+  int fd;                 // socket, input, or timerfd
+  void* arg;              // passed through to the handler
+  bool (*handleMessage)(void* arg, const addr_t from, const char* message);
+  bool (*handleInput)(void* arg);
+  bool (*handleTimeout)(void* arg);
+  bool ready;             // socket may have messages waiting, or
+                          // input is a regular file (always ready)
+  bool idle;              // timer restarts upon any message or input
+  struct itimerspec spec; // timer interval
+} source_t;
+
+struct message_loop {
+  int epfd;               // the epoll instance
+  source_t** sources;     // array of sources watched by this loop
+  int nsources;           // number of sources in the array
+  int maxsources;         // slots allocated in the array
+  char* buf;              // buffer for reading data from sockets
+
+  // batched receive (see message_loopSetBatch); unused when batch <= 1
+  int batch;              // max messages per recvmmsg() call
+  char* bufs;             // ring of 'batch' buffers of message_MaxBytes
+  struct mmsghdr* msgs;   // one header per buffer
+  struct iovec* iovs;     // one iovec per buffer
+  struct sockaddr_in* senders; // one sender address per buffer
+  int batchNext;          // next message in the ring to be handled
+  int batchCount;         // number of messages received into the ring
+  source_t* batchSrc;     // socket from which they were received
+};
+
+/**************** file-local functions ****************/
+static int openSocket(const int port, const bool shared, const char* caller);
+static source_t* loopAdd(message_loop_t* loop, sourceType_t type,
+                         const int fd, void* arg);
+static int loopDrain(message_loop_t* loop, source_t* src);
+static int loopDrainBatch(message_loop_t* loop, source_t* src);
+static bool loopDispatch(source_t* src, const struct sockaddr_in sender,
+                         const char* buf);
+static void loopFreeBatch(message_loop_t* loop);
+
 /***********************************************************************/
 /**************** message_init ****************/
 /* 
@@ -67,27 +140,14 @@ message_init(FILE* logFP)
     return 0;
   }
 
-  // Create socket on which to listen (file descriptor)
-  ourSocket = socket(AF_INET, SOCK_DGRAM, 0);
-  if (ourSocket < 0) {
-    log_e("message_init: error opening datagram socket");
-    ourSocket = 0;
-    return 0;
-  }
-
-  // Name socket using wildcards
-  struct sockaddr_in self;  // our address
-  self.sin_family = AF_INET;
-  self.sin_addr.s_addr = INADDR_ANY;
-  self.sin_port = 0;
-  if (bind(ourSocket, (struct sockaddr *) &self, sizeof(self))) {
-    log_e("message_init: binding socket name");
-    close(ourSocket);
-    ourSocket = 0;
+  // Create socket on which to listen, bound to any port
+  ourSocket = openSocket(0, false, "message_init");
+  if (ourSocket == 0) {
     return 0;
   }
 
   // get our assigned address
+  struct sockaddr_in self;  // our address
   socklen_t selflen = sizeof(self); // length of our address
   if (getsockname(ourSocket, (struct sockaddr *) &self, &selflen)) {
     log_e("message_init: getting socket name");
@@ -102,6 +162,168 @@ message_init(FILE* logFP)
   return port;
 }
 
+/**************** message_initShared ****************/
+/* 
+ * Initialize the module without opening its own socket.
+ * See message.h for detailed description.
+ */
+void
+message_initShared(FILE* logFP)
+{
+  log_init(logFP);
+}
+
+/**************** openSocket ****************/
+/*
+ * Create a datagram socket bound to the given port (0 for any port),
+ * possibly shared with other sockets.
+ * Return the socket, or zero after logging an error.
+ */
+static int
+openSocket(const int port, const bool shared, const char* caller)
+{
+  // Create socket on which to listen (file descriptor)
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    log_s("%s: error opening datagram socket", caller);
+    return 0;
+  }
+
+  // let other sockets bind the same port
+  const int one = 1;
+  if (shared && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))) {
+    log_s("%s: cannot share port", caller);
+    close(sock);
+    return 0;
+  }
+
+  // Name socket using wildcards
+  struct sockaddr_in self;  // our address
+  self.sin_family = AF_INET;
+  self.sin_addr.s_addr = INADDR_ANY;
+  self.sin_port = htons(port);
+  if (bind(sock, (struct sockaddr *) &self, sizeof(self))) {
+    log_s("%s: binding socket name", caller);
+    close(sock);
+    return 0;
+  }
+
+  return sock;
+}
+
+/**************** message_socket ****************/
+/* See message.h for detailed description.
+ */
+int
+message_socket(void)
+{
+  return ourSocket;
+}
+
+/**************** message_openSocket ****************/
+/* 
+ * Set up another socket on which to receive messages; return the socket.
+ * See message.h for detailed description.
+ */
+int
+message_openSocket(const int port)
+{
+  if (port != 0 && (port < MinPort || port > MaxPort)) {
+    log_d("message_openSocket: illegal port number '%d'", port);
+    return 0;
+  }
+
+  int sock = openSocket(port, false, "message_openSocket");
+  if (sock != 0) {
+    log_d("message_openSocket: ready at port '%d'", message_port(sock));
+  }
+  return sock;
+}
+
+/**************** message_openShared ****************/
+/* 
+ * Set up a socket on a port shared with others; return the socket.
+ * See message.h for detailed description.
+ */
+int
+message_openShared(const int port)
+{
+  if (port != 0 && (port < MinPort || port > MaxPort)) {
+    log_d("message_openShared: illegal port number '%d'", port);
+    return 0;
+  }
+
+  int sock = openSocket(port, true, "message_openShared");
+  if (sock != 0) {
+    log_d("message_openShared: ready at port '%d'", message_port(sock));
+  }
+  return sock;
+}
+
+/**************** message_port ****************/
+/* See message.h for detailed description.
+ */
+int
+message_port(const int sock)
+{
+  struct sockaddr_in self;
+  socklen_t selflen = sizeof(self);
+  if (getsockname(sock, (struct sockaddr *) &self, &selflen) != 0) {
+    return 0;
+  }
+  return ntohs(self.sin_port);
+}
+
+/**************** message_steerBySource ****************/
+/* 
+ * Attach a classic-BPF program to the socket's SO_REUSEPORT group,
+ * choosing a socket by a hash of the sender's address and port.
+ * See message.h for detailed description.
+ */
+bool
+message_steerBySource(const int sock, const int nsocks)
+{
+  if (sock <= 0 || nsocks < 1) {
+    log_v("message_steerBySource: called with bad argument");
+    return false;
+  }
+
+  // The program sees the datagram's payload; SKF_NET_OFF reaches back
+  // to the IP header, whose source address is at offset 12.  The UDP
+  // header, whose first field is the source port, follows the IP header,
+  // which is 20 bytes long only without options: its length is in the
+  // low 4 bits of its first byte (IHL), in 32-bit words.
+  struct sock_filter code[] = {
+    { BPF_LDX | BPF_B | BPF_MSH, 0, 0, (uint32_t)SKF_NET_OFF },        // X = IHL*4
+    { BPF_LD  | BPF_H | BPF_IND, 0, 0, (uint32_t)SKF_NET_OFF },        // A = port
+    { BPF_MISC | BPF_TAX,        0, 0, 0 },                            // X = A
+    { BPF_LD  | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_NET_OFF + 12) }, // A = IP
+    { BPF_ALU | BPF_XOR | BPF_X, 0, 0, 0 },                            // A ^= X
+    { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)nsocks },             // A %= n
+    { BPF_RET | BPF_A,           0, 0, 0 },                            // socket A
+  };
+  struct sock_fprog prog = { .len = sizeof(code) / sizeof(code[0]), 
+                             .filter = code };
+
+  if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, 
+                 &prog, sizeof(prog))) {
+    log_e("message_steerBySource: cannot attach steering program");
+    return false;
+  }
+  return true;
+}
+
+/**************** message_closeSocket ****************/
+/* See message.h for detailed description.
+ */
+void
+message_closeSocket(const int sock)
+{
+  if (sock > 0 && sock != ourSocket) {
+    close(sock);
+  }
+}
+
 /**************** message_noAddr ****************/
 /* 
  * Return an empty/nonexistent address.
@@ -199,7 +421,8 @@ message_stringAddr(const addr_t addr)
 {
   // Maximum string length to hold an IP address and port, plus null.
   // e.g., 255.255.255.255:65507
-  static char addrString[22]; // constant appears in snprintf below
+  // (one per thread, for servers that send from several threads)
+  static _Thread_local char addrString[22]; // constant appears in snprintf below
 
   snprintf(addrString, 22, "%s:%05d",
 	   inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
@@ -245,29 +468,66 @@ numLines(const char* string)
 void
 message_send(const addr_t to, const char* message)
 {
-  if (ourSocket == 0) {
+  if (sendHook != NULL) {
+    (*sendHook)(sendHookArg, to, message);
+    return;
+  }
+
+  // reply from the socket on which the message being handled arrived
+  const int sock = replySocket != 0 ? replySocket : ourSocket;
+
+  if (sock == 0) {
     log_v("message_send: called before message_init");
     return; // error in usage of this function.
   }
+  message_sendOn(sock, to, message);
+}
+
+/**************** message_sendOn ****************/
+/* 
+ * Send a string message to the correspondent address, from the given socket.
+ * See message.h for detailed description.
+ */
+void
+message_sendOn(const int sock, const addr_t to, const char* message)
+{
+  if (sock <= 0) {
+    log_v("message_sendOn: called with no socket");
+    return; // error in usage of this function.
+  }
   if (message == NULL) {
     log_v("message_send: called with null message");
     return; // error in usage of this function.
   }
-  if (sendto(ourSocket, message, strlen(message), 0,
+  if (sendto(sock, message, strlen(message), 0,
              (struct sockaddr *) &to, sizeof(to)) < 0) {
     log_e("message_send: error sending to datagram socket");
-  } else {
+  } else if (log_enabled(Log_Debug)) {
     log_s("message_send: TO %s", message_stringAddr(to));
     log_d("message_send: %d lines:", numLines(message));
     log_s("%s", message);
   }
 }
 
+/**************** message_setSendHook ****************/
+/* See message.h for detailed description.
+ */
+void
+message_setSendHook(void (*hook)(void* arg, const addr_t to,
+                                 const char* message),
+                    void* arg)
+{
+  sendHook = hook;
+  sendHookArg = arg;
+}
+
 /**************** message_loop ****************/
 /* 
  * Loop forever, calling handler functions for stdin or socket,
  * as input is available from either.
  * Returns false on error or true if any of the handlers return true.
+ * This is now a wrapper around an event loop with one socket,
+ * (optionally) stdin, and (optionally) an idle timer.
  * See message.h for detailed description.
  */
 bool
@@ -297,102 +557,505 @@ message_loop(void* arg, const float timeout,
     return false; // error in usage of this function.
   }
 
-  // set up for timeouts, if desired
-  struct timeval* timerp = NULL; // stays null if no timeout desired
-  struct timeval  timer;          // timerp = &timer if timeout desired
-  struct timeval  timeoutval;     // timeval equivalent of parameter 'timeout'
-  if (timeout > 0.0) {
-    timeoutval.tv_sec  = (int)timeout;
-    timeoutval.tv_usec = timeout - (int)timeout;
+  message_loop_t* loop = message_loopNew();
+  if (loop == NULL) {
+    return false;
   }
 
-  // loop until error or some handler indicates time to quit looping
-  while (true) {
-    // for use with select()
-    fd_set rfds;        // set of file descriptors we want to read
-    
-    // Watch stdin (fd 0) and the socket to see when either has input.
-    int nfds = 0;             // number of file descriptors to monitor
-    FD_ZERO(&rfds);           // default to none
-    if (handleInput != NULL) {
-      FD_SET(0, &rfds);       // monitor stdin
-      nfds = 1;
+  // Watch stdin (fd 0) and the socket to see when either has input,
+  // and time out when neither has input for a while.
+  bool ok = (handleInput == NULL 
+             || message_loopAddInput(loop, 0, arg, handleInput))
+    && (handleMessage == NULL 
+        || message_loopAddSocket(loop, ourSocket, arg, handleMessage))
+    && (timeout <= 0.0 
+        || message_loopAddTimer(loop, timeout, true, arg, handleTimeout));
+
+  if (ok) {
+    ok = message_loopRun(loop);
+  }
+  message_loopDelete(loop);
+  return ok;
+}
+
+/**************** message_loopNew ****************/
+/* See message.h for detailed description.
+ */
+message_loop_t*
+message_loopNew(void)
+{
+  message_loop_t* loop = calloc(1, sizeof(message_loop_t));
+  if (loop == NULL) {
+    log_v("message_loopNew: out of memory");
+    return NULL;
+  }
+
+  loop->buf = malloc(message_MaxBytes);
+  loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (loop->buf == NULL || loop->epfd < 0) {
+    log_e("message_loopNew: cannot create epoll instance");
+    if (loop->epfd >= 0) {
+      close(loop->epfd);
     }
-    if (handleMessage != NULL && ourSocket != 0) {
-      FD_SET(ourSocket, &rfds); // monitor the socket
-      nfds = ourSocket+1;       // highest-numbered fd in rfds
+    free(loop->buf);
+    free(loop);
+    return NULL;
+  }
+  return loop;
+}
+
+/**************** loopAdd ****************/
+/*
+ * Allocate a new source and append it to the loop's array of sources.
+ * Return the source, or NULL if out of memory.
+ */
+static source_t*
+loopAdd(message_loop_t* loop, sourceType_t type, const int fd, void* arg)
+{
+  if (loop->nsources == loop->maxsources) {
+    int max = loop->maxsources == 0 ? 4 : loop->maxsources * 2;
+    source_t** sources = realloc(loop->sources, max * sizeof(source_t*));
+    if (sources == NULL) {
+      log_v("message_loop: out of memory");
+      return NULL;
     }
-    if (timeout > 0.0) {      // is timeout desired?
-      timer = timeoutval;     // set the timer to the timeout value
-      timerp = &timer;        // pass that timer to select
+    loop->sources = sources;
+    loop->maxsources = max;
+  }
+
+  source_t* src = calloc(1, sizeof(source_t));
+  if (src == NULL) {
+    log_v("message_loop: out of memory");
+    return NULL;
+  }
+  src->type = type;
+  src->fd = fd;
+  src->arg = arg;
+  loop->sources[loop->nsources++] = src;
+  return src;
+}
+
+/**************** message_loopAddSocket ****************/
+/* See message.h for detailed description.
+ */
+bool
+message_loopAddSocket(message_loop_t* loop, const int sock, void* arg,
+                      bool (*handleMessage)(void* arg,
+                                            const addr_t from,
+                                            const char* message))
+{
+  if (loop == NULL || sock <= 0 || handleMessage == NULL) {
+    log_v("message_loopAddSocket: called with bad argument");
+    return false;
+  }
+
+  source_t* src = loopAdd(loop, SourceSocket, sock, arg);
+  if (src == NULL) {
+    return false;
+  }
+  src->handleMessage = handleMessage;
+  src->ready = true;      // there may be messages waiting already
+
+  // edge-triggered: we are told once when messages arrive, and drain them
+  struct epoll_event ev = { .events = EPOLLIN | EPOLLET, .data.ptr = src };
+  if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, sock, &ev) < 0) {
+    log_e("message_loopAddSocket: cannot watch socket");
+    loop->nsources--;
+    free(src);
+    return false;
+  }
+  return true;
+}
+
+/**************** message_loopAddInput ****************/
+/* See message.h for detailed description.
+ */
+bool
+message_loopAddInput(message_loop_t* loop, const int fd, void* arg,
+                     bool (*handleInput)(void* arg))
+{
+  if (loop == NULL || fd < 0 || handleInput == NULL) {
+    log_v("message_loopAddInput: called with bad argument");
+    return false;
+  }
+
+  source_t* src = loopAdd(loop, SourceInput, fd, arg);
+  if (src == NULL) {
+    return false;
+  }
+  src->handleInput = handleInput;
+
+  // level-triggered: the handler reads only once per call
+  struct epoll_event ev = { .events = EPOLLIN, .data.ptr = src };
+  if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    struct stat st;
+    if (errno == EPERM && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+      // epoll refuses regular files, which select() deems always ready
+      src->ready = true;
     } else {
-      timerp = NULL;          // no timeout is desired
+      log_e("message_loopAddInput: cannot watch input");
+      loop->nsources--;
+      free(src);
+      return false;
     }
+  }
+  return true;
+}
+
+/**************** message_loopAddTimer ****************/
+/* See message.h for detailed description.
+ */
+bool
+message_loopAddTimer(message_loop_t* loop, const float interval,
+                     const bool idle, void* arg,
+                     bool (*handleTimeout)(void* arg))
+{
+  if (loop == NULL || interval <= 0.0 || handleTimeout == NULL) {
+    log_v("message_loopAddTimer: called with bad argument");
+    return false;
+  }
+
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    log_e("message_loopAddTimer: cannot create timer");
+    return false;
+  }
+
+  source_t* src = loopAdd(loop, SourceTimer, fd, arg);
+  if (src == NULL) {
+    close(fd);
+    return false;
+  }
+  src->handleTimeout = handleTimeout;
+  src->idle = idle;
+  src->spec.it_value.tv_sec = (time_t)interval;
+  src->spec.it_value.tv_nsec = (long)((interval - (time_t)interval) * 1e9);
+  if (src->spec.it_value.tv_sec == 0 && src->spec.it_value.tv_nsec == 0) {
+    src->spec.it_value.tv_nsec = 1;  // zero would disarm the timer
+  }
+  src->spec.it_interval = src->spec.it_value;
+
+  struct epoll_event ev = { .events = EPOLLIN, .data.ptr = src };
+  if (timerfd_settime(fd, 0, &src->spec, NULL) < 0
+      || epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    log_e("message_loopAddTimer: cannot start timer");
+    loop->nsources--;
+    free(src);
+    close(fd);
+    return false;
+  }
+  return true;
+}
+
+/**************** message_loopSetBatch ****************/
+/* See message.h for detailed description.
+ */
+bool
+message_loopSetBatch(message_loop_t* loop, const int batch)
+{
+  if (loop == NULL || batch < 1) {
+    log_v("message_loopSetBatch: called with bad argument");
+    return false;
+  }
+  if (loop->batchNext < loop->batchCount) {
+    log_v("message_loopSetBatch: called with messages still in the ring");
+    return false;
+  }
+
+  loopFreeBatch(loop);
+  if (batch == 1) {
+    return true;          // back to one recvfrom() per message
+  }
+
+  loop->bufs = malloc((size_t)batch * message_MaxBytes);
+  loop->msgs = calloc(batch, sizeof(struct mmsghdr));
+  loop->iovs = calloc(batch, sizeof(struct iovec));
+  loop->senders = calloc(batch, sizeof(struct sockaddr_in));
+  if (loop->bufs == NULL || loop->msgs == NULL 
+      || loop->iovs == NULL || loop->senders == NULL) {
+    log_v("message_loopSetBatch: out of memory");
+    loopFreeBatch(loop);
+    return false;
+  }
+
+  // each header points at its own buffer (leaving room for a null)
+  for (int i = 0; i < batch; i++) {
+    loop->iovs[i].iov_base = loop->bufs + (size_t)i * message_MaxBytes;
+    loop->iovs[i].iov_len = message_MaxBytes - 1;
+    loop->msgs[i].msg_hdr.msg_iov = &loop->iovs[i];
+    loop->msgs[i].msg_hdr.msg_iovlen = 1;
+    loop->msgs[i].msg_hdr.msg_name = &loop->senders[i];
+  }
+  loop->batch = batch;
+  return true;
+}
+
+/**************** loopFreeBatch ****************/
+/* Free the loop's ring of batch buffers, if any. */
+static void
+loopFreeBatch(message_loop_t* loop)
+{
+  free(loop->bufs);
+  free(loop->msgs);
+  free(loop->iovs);
+  free(loop->senders);
+  loop->bufs = NULL;
+  loop->msgs = NULL;
+  loop->iovs = NULL;
+  loop->senders = NULL;
+  loop->batch = 0;
+  loop->batchNext = loop->batchCount = 0;
+  loop->batchSrc = NULL;
+}
+
+/**************** loopDispatch ****************/
+/*
+ * Log and handle one message received on the given socket.
+ * Return true if the handler says to exit the loop.
+ */
+static bool
+loopDispatch(source_t* src, const struct sockaddr_in sender, const char* buf)
+{
+  // where was it from?
+  if (sender.sin_family != AF_INET) {
+    // ignore it
+    log_d("message_loop: non-Internet family %d\n", sender.sin_family);
+    return false;
+  }
 
-    // Wait for input on either source
-    int select_response = select(nfds, &rfds, NULL, NULL, timerp);
-    // note: 'rfds' updated
-    
-    if (select_response < 0) {
+  // record it, if every message is logged
+  if (log_enabled(Log_Debug)) {
+    log_s("message_loop: FROM %s", message_stringAddr(sender));
+    log_d("message_loop: %d lines:", numLines(buf));
+    log_s("%s", buf);
+  }
+
+  // handle it, replying from this socket
+  replySocket = src->fd;
+  bool done = (*src->handleMessage)(src->arg, sender, buf);
+  replySocket = 0;
+  return done;
+}
+
+/**************** loopDrain ****************/
+/*
+ * Receive and handle messages waiting on a socket, until there are
+ * no more (and src->ready becomes false) or the budget runs out.
+ * Return the number of messages handled, or -1 if a handler says
+ * to exit the loop.
+ */
+static int
+loopDrain(message_loop_t* loop, source_t* src)
+{
+  if (loop->batch > 1) {
+    return loopDrainBatch(loop, src);
+  }
+
+  int handled = 0;
+  while (handled < LoopDrainBudget) {
+    struct sockaddr_in sender;     // sender of this message
+    struct sockaddr *senderp = (struct sockaddr *) &sender;
+    socklen_t senderlen = sizeof(sender);  // must pass address to length
+    int nbytes = recvfrom(src->fd, loop->buf, message_MaxBytes-1, 
+                          MSG_DONTWAIT, senderp, &senderlen);
+    if (nbytes < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        src->ready = false;      // drained; wait for the next edge
+      } else if (errno != EINTR) {
+        // error, ignore it
+        log_e("message_loop: receiving from socket");
+      }
+      return handled;
+    }
+    handled++;
+
+    loop->buf[nbytes] = '\0';     // null terminate message string
+    if (loopDispatch(src, sender, loop->buf)) {
+      return -1; // handler says to exit loop
+    }
+  }
+  return handled;
+}
+
+/**************** loopDrainBatch ****************/
+/*
+ * Like loopDrain, but receive up to loop->batch messages per system call
+ * into the loop's ring of buffers.  If a handler says to exit the loop,
+ * the rest of the ring is kept, to be handled when the loop runs again.
+ */
+static int
+loopDrainBatch(message_loop_t* loop, source_t* src)
+{
+  int handled = 0;
+  while (handled < LoopDrainBudget) {
+    if (loop->batchNext == loop->batchCount) {
+      // ring is empty; refill it
+      for (int i = 0; i < loop->batch; i++) {
+        loop->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        loop->msgs[i].msg_hdr.msg_flags = 0;
+      }
+      int nmsgs = recvmmsg(src->fd, loop->msgs, loop->batch, 
+                           MSG_DONTWAIT, NULL);
+      if (nmsgs <= 0) {
+        if (nmsgs == 0 || errno == EAGAIN || errno == EWOULDBLOCK) {
+          src->ready = false;    // drained; wait for the next edge
+        } else if (errno != EINTR) {
+          // error, ignore it
+          log_e("message_loop: receiving batch from socket");
+        }
+        return handled;
+      }
+      loop->batchNext = 0;
+      loop->batchCount = nmsgs;
+      loop->batchSrc = src;
+    }
+
+    // hand the messages in the ring to the handler, back to back
+    while (loop->batchNext < loop->batchCount) {
+      const int i = loop->batchNext++;
+      handled++;
+      char* buf = loop->iovs[i].iov_base;
+      buf[loop->msgs[i].msg_len] = '\0';  // null terminate message string
+      if (loop->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        log_d("message_loop: dropped message truncated at %d bytes",
+              loop->msgs[i].msg_len);
+        continue;
+      }
+      if (loopDispatch(src, loop->senders[i], buf)) {
+        return -1; // handler says to exit loop
+      }
+    }
+  }
+  return handled;
+}
+
+/**************** message_loopRun ****************/
+/* 
+ * Loop until a handler says to stop, dispatching epoll events.
+ * See message.h for detailed description.
+ */
+bool
+message_loopRun(message_loop_t* loop)
+{
+  if (loop == NULL || loop->nsources == 0) {
+    log_v("message_loopRun called with no loop or empty loop");
+    return false; // error in usage of this function.
+  }
+
+  // Messages may have arrived before we started, or been left over
+  // from an earlier run; with edge-triggering we must look for them.
+  for (int i = 0; i < loop->nsources; i++) {
+    if (loop->sources[i]->type == SourceSocket) {
+      loop->sources[i]->ready = true;
+    }
+  }
+
+  // Messages left in the batch ring by the last run come first.
+  if (loop->batchNext < loop->batchCount) {
+    if (loopDrainBatch(loop, loop->batchSrc) < 0) {
+      return true; // handler says to exit loop 
+    }
+  }
+
+  struct epoll_event events[LoopMaxEvents];
+
+  // loop until error or some handler indicates time to quit looping
+  while (true) {
+    // don't block if some source still has (or may have) work to do
+    bool anyReady = false;
+    for (int i = 0; i < loop->nsources && !anyReady; i++) {
+      anyReady = loop->sources[i]->ready;
+    }
+
+    int nevents = epoll_wait(loop->epfd, events, LoopMaxEvents,
+                             anyReady ? 0 : -1);
+    if (nevents < 0) {
       if (errno == EINTR) {
-	// select() was interrupted by a signal - most likely SIGWINCH;
-	// just ignore this and loop around to select() again.
-	log_e("message_loop: select() EINTR: interrupted by signal");
+	// interrupted by a signal - most likely SIGWINCH;
+	// just ignore this and loop around to wait again.
+	log_e("message_loop: epoll_wait() EINTR: interrupted by signal");
+        continue;
       } else {
 	// some error occurred; this should not happen
-	log_e("message_loop: select()");
+	log_e("message_loop: epoll_wait()");
 	return false; // error
       }
-    } else if (select_response == 0) {
-      // timeout occurred
-      log_v("message_loop: select() timed out");
-      if (handleTimeout != NULL && (*handleTimeout)(arg)) {
-        break; // handler says to exit loop 
+    }
+
+    bool activity = false;    // did any message or input arrive?
+    for (int e = 0; e < nevents; e++) {
+      source_t* src = events[e].data.ptr;
+      if (src->type == SourceSocket) {
+        src->ready = true;    // drained below, along with the others
+      } else if (src->type == SourceInput) {
+        activity = true;
+        log_v("message_loop: input ready");
+        if ((*src->handleInput)(src->arg)) {
+          return true; // handler says to exit loop 
+        }
+      } else if (src->type == SourceTimer) {
+        uint64_t expirations;
+        if (read(src->fd, &expirations, sizeof(expirations)) > 0) {
+          log_v("message_loop: timer expired");
+          if ((*src->handleTimeout)(src->arg)) {
+            return true; // handler says to exit loop 
+          }
+        }
+      }
+    }
+
+    // regular-file inputs are always ready; sockets may have messages
+    for (int i = 0; i < loop->nsources; i++) {
+      source_t* src = loop->sources[i];
+      if (!src->ready) {
+        continue;
       }
-    } else if (select_response > 0) {
-      // some data is ready on either source, or both
-
-      if (FD_ISSET(0, &rfds)) {
-        // stdin has input ready
-        log_v("message_loop: input ready on stdin");
-        if (handleInput != NULL && (*handleInput)(arg)) {
-          break; // handler says to exit loop 
+      if (src->type == SourceInput) {
+        activity = true;
+        if ((*src->handleInput)(src->arg)) {
+          return true; // handler says to exit loop 
+        }
+      } else if (src->type == SourceSocket) {
+        int handled = loopDrain(loop, src);
+        if (handled < 0) {
+          return true; // handler says to exit loop 
         }
+        activity = activity || handled > 0;
       }
-      if (FD_ISSET(ourSocket, &rfds)) {
-        // socket has input ready
-        log_v("message_loop: message ready on socket");
-        struct sockaddr_in sender;     // sender of this message
-        struct sockaddr *senderp = (struct sockaddr *) &sender;
-        socklen_t senderlen = sizeof(sender);  // must pass address to length
-        char buf[message_MaxBytes]; // buffer for reading data from socket
-        int nbytes = recvfrom(ourSocket, buf, message_MaxBytes-1, 
-                              0, senderp, &senderlen);
-        if (nbytes < 0) {
-          // error, ignore it
-          log_e("message_loop: receiving from socket");
-        } else {
-          buf[nbytes] = '\0';     // null terminate message string
-          // where was it from?
-          if (sender.sin_family != AF_INET) {
-            // ignore it
-            log_d("message_loop: non-Internet family %d\n", sender.sin_family);
-          } else {
-	    // record it
-	    log_s("message_loop: FROM %s", message_stringAddr(sender));
-	    log_d("message_loop: %d lines:", numLines(buf));
-	    log_s("%s", buf);
-
-            // handle it
-            if (handleMessage != NULL && (*handleMessage)(arg, sender, buf)) {
-              break; // handler says to exit loop 
-            }
-          }
+    }
+
+    // idle timers only fire after a period with neither message nor input
+    if (activity) {
+      for (int i = 0; i < loop->nsources; i++) {
+        source_t* src = loop->sources[i];
+        if (src->type == SourceTimer && src->idle) {
+          timerfd_settime(src->fd, 0, &src->spec, NULL);
         }
       }
     }
   }
-  return true;
+}
+
+/**************** message_loopDelete ****************/
+/* See message.h for detailed description.
+ */
+void
+message_loopDelete(message_loop_t* loop)
+{
+  if (loop != NULL) {
+    for (int i = 0; i < loop->nsources; i++) {
+      source_t* src = loop->sources[i];
+      if (src->type == SourceTimer) {
+        close(src->fd);   // we created it, so we close it
+      }
+      free(src);
+    }
+    free(loop->sources);
+    free(loop->buf);
+    loopFreeBatch(loop);
+    close(loop->epfd);
+    free(loop);
+  }
 }
 
 /**************** message_done ****************/
@@ -450,7 +1113,8 @@ main(const int argc, char* argv[])
 {
   addr_t other; // address of the other side of this communication (init below)
 
-  // initialize the logging module
+  // initialize the logging module, with every message sent and received
+  flog_setLevel(Log_Debug);
   log_init(stderr);
 
   // initialize the message module
@@ -20,6 +20,20 @@
  *  handleInput may be NULL if no input expected.
  *  arg may be NULL if not needed by handlers.
  *
+ * A process serving several sockets (e.g., several games or ports) can
+ * instead build an event loop of its own:
+ *   message_init(stderr);
+ *   int sock = message_openSocket(port);
+ *   message_loop_t* loop = message_loopNew();
+ *   message_loopAddSocket(loop, message_socket(), gameA, handleMessage);
+ *   message_loopAddSocket(loop, sock, gameB, handleMessage);
+ *   message_loopAddTimer(loop, 0.1, false, gameA, handleTick);
+ *   message_loopRun(loop);
+ *   message_loopDelete(loop);
+ *   message_closeSocket(sock);
+ *   message_done();
+ * message_loop() is itself a thin wrapper around such a loop.
+ *
  * David Kotz - May 2019
  */
 
@@ -45,6 +59,10 @@
  */
 typedef struct sockaddr_in addr_t;
 
+/* An event loop (see message_loopNew), opaque to users of this module.
+ */
+typedef struct message_loop message_loop_t;
+
 /****************** constants *********************/
 // Maximum payload size for UDP messages, according to
 // https://en.wikipedia.org/wiki/User_Datagram_Protocol
@@ -64,6 +82,18 @@ static const int message_MaxBytes = 65507;
  */
 int message_init(FILE* logFP);
 
+/******************************************/
+/* message_initShared: initialize the module, without a socket of its own.
+ * For a program whose every socket comes from message_openSocket() or
+ * message_openShared(), so the socket message_init() opens would go unused.
+ * Caller provides:
+ *   file pointer(fp), passed through to log_init().  May be NULL.
+ * Caller expectations:
+ *   call message_done() later when all messaging operations complete.
+ * Logs: nothing.
+ */
+void message_initShared(FILE* logFP);
+
 /******************************************/
 /* message_noAddr: return an addr_t representing "no address".
  * Logs: nothing.
@@ -133,6 +163,24 @@ const char* message_stringAddr(const addr_t addr);
  */
 void message_send(const addr_t to, const char* message);
 
+/******************************************/
+/* message_setSendHook: divert this thread's outbound messages.
+ * Caller provides:
+ *   a function to be called by message_send() in place of sending,
+ *     or NULL to resume sending normally,
+ *   a pointer for an arg (may be NULL), passed through to the hook.
+ * Function returns: nothing.
+ * Notes:
+ *   The hook applies only to messages sent by the calling thread;
+ *   this lets one thread hand its messages to another for sending,
+ *   or capture them without any network at all.
+ *   message_sendOn() is never diverted.
+ * Logs: nothing; the hook is responsible for any logging.
+ */
+void message_setSendHook(void (*hook)(void* arg, const addr_t to,
+                                      const char* message),
+                         void* arg);
+
 /******************************************/
 /* message_loop: loop, handling input and incoming messages.
  * Caller provides:
@@ -166,6 +214,180 @@ bool message_loop(void* arg, const float timeout,
                                         const addr_t from, 
                                         const char* message));
 
+/******************************************/
+/* message_socket: return the module's own socket.
+ * Function returns:
+ *   the socket opened by message_init(), or 0 if not initialized.
+ * Logs: nothing.
+ */
+int message_socket(void);
+
+/******************************************/
+/* message_openSocket: open an additional socket for receiving messages.
+ * Caller provides:
+ *   a port number on which to listen, or 0 to let the system choose one.
+ * Function returns:
+ *   the socket (a file descriptor > 0), or zero on error.
+ * Caller expectations:
+ *   call message_closeSocket() when done with the socket.
+ * Logs: information about errors; the port number.
+ */
+int message_openSocket(const int port);
+
+/******************************************/
+/* message_openShared: open a socket that shares its port with others.
+ * Like message_openSocket(), but several sockets (in this process, or
+ * others) may bind the same port, via SO_REUSEPORT; the kernel spreads
+ * inbound messages among them.
+ * Caller provides:
+ *   a port number, or 0 for the first socket of a group (see message_port).
+ * Function returns:
+ *   the socket (a file descriptor > 0), or zero on error.
+ * Logs: information about errors; the port number.
+ */
+int message_openShared(const int port);
+
+/******************************************/
+/* message_port: return the port number to which a socket is bound.
+ * Function returns: the port number, or zero on error.
+ * Logs: nothing.
+ */
+int message_port(const int sock);
+
+/******************************************/
+/* message_steerBySource: steer a port's messages by sender address.
+ * Caller provides:
+ *   any one socket from a group opened by message_openShared(), and
+ *   the number of sockets in the group.
+ * Function returns:
+ *   true if successful; false if the kernel refused the steering program,
+ *   in which case the kernel's own hash of each sender still applies.
+ * Notes:
+ *   Every message from one sender goes to the same socket of the group:
+ *   the i'th socket bound, where i = (sender IP ^ sender port) % nsocks.
+ *   Assumes IPv4 headers without options, as is usual.
+ * Logs: errors.
+ */
+bool message_steerBySource(const int sock, const int nsocks);
+
+/******************************************/
+/* message_closeSocket: close a socket from message_openSocket().
+ * Logs: nothing.
+ */
+void message_closeSocket(const int sock);
+
+/******************************************/
+/* message_sendOn: send a message from the given socket.
+ * Like message_send(), but the caller chooses the socket; useful
+ * when a process serves several sockets.
+ * Note:
+ *   within a message handler called by an event loop, message_send()
+ *   already replies from the socket on which the message arrived.
+ */
+void message_sendOn(const int sock, const addr_t to, const char* message);
+
+/******************************************/
+/* message_loopNew: create an (empty) event loop.
+ * Function returns:
+ *   a new event loop, or NULL on error.
+ * Caller expectations:
+ *   add sockets, inputs, and timers to the loop, then call message_loopRun;
+ *   call message_loopDelete when done with it.
+ * Notes:
+ *   The loop is based on epoll, and thus is Linux-specific.
+ *   Each loop should be run by one thread only, but separate threads
+ *   may each run their own loop.
+ * Logs: errors.
+ */
+message_loop_t* message_loopNew(void);
+
+/******************************************/
+/* message_loopAddSocket: watch a socket for inbound messages.
+ * Caller provides:
+ *   a loop, a socket from message_init or message_openSocket,
+ *   a pointer for an arg (may be NULL), passed to the handler,
+ *   a function for handling an inbound message, as in message_loop.
+ * Function returns:
+ *   true if the socket was added, false on error.
+ * Notes:
+ *   The socket is watched edge-triggered and drained of all waiting
+ *   messages (up to a fairness budget per socket, per wakeup).
+ * Logs: errors.
+ */
+bool message_loopAddSocket(message_loop_t* loop, const int sock, void* arg,
+                           bool (*handleMessage)(void* arg,
+                                                 const addr_t from,
+                                                 const char* message));
+
+/******************************************/
+/* message_loopAddInput: watch a file descriptor (e.g., 0 for stdin).
+ * Caller provides:
+ *   a loop, a file descriptor open for reading,
+ *   a pointer for an arg (may be NULL), passed to the handler,
+ *   a function that reads once from the descriptor and processes it.
+ * Function returns:
+ *   true if the descriptor was added, false on error.
+ * Notes:
+ *   A regular file (e.g., stdin redirected from a file) is always
+ *   considered ready, as it would be by select().
+ * Logs: errors.
+ */
+bool message_loopAddInput(message_loop_t* loop, const int fd, void* arg,
+                          bool (*handleInput)(void* arg));
+
+/******************************************/
+/* message_loopAddTimer: call a handler after an interval of time.
+ * Caller provides:
+ *   a loop, an interval (in seconds, > 0),
+ *   whether the timer is an 'idle' timer: an idle timer is restarted
+ *     whenever a message or input arrives, so it fires only after the
+ *     interval passes without input or message, as in message_loop;
+ *     other timers fire periodically, every interval,
+ *   a pointer for an arg (may be NULL), passed to the handler,
+ *   a function for handling the timeout.
+ * Function returns:
+ *   true if the timer was added, false on error.
+ * Logs: errors.
+ */
+bool message_loopAddTimer(message_loop_t* loop, const float interval,
+                          const bool idle, void* arg,
+                          bool (*handleTimeout)(void* arg));
+
+/******************************************/
+/* message_loopSetBatch: receive messages in batches.
+ * Caller provides:
+ *   a loop, and the largest number of messages to receive per system call;
+ *   1 (the default) receives one message at a time.
+ * Function returns:
+ *   true if successful, false on error (e.g., out of memory).
+ * Notes:
+ *   Batches are received with recvmmsg() into a ring of buffers owned
+ *   by the loop, then handed to the handlers back to back.
+ *   The handler's message string is only valid until it returns.
+ * Logs: errors.
+ */
+bool message_loopSetBatch(message_loop_t* loop, const int batch);
+
+/******************************************/
+/* message_loopRun: loop, handling input, timers, and incoming messages.
+ * Caller provides: a loop with at least one socket, input, or timer.
+ * Function returns:
+ *   true, in the normal case when the loop ends due to handler return true;
+ *   false, when fatal errors indicate we cannot keep looping.
+ * Notes:
+ *   The loop may be run again after it returns; messages still waiting
+ *   on its sockets are handled then.
+ * Logs: as in message_loop.
+ */
+bool message_loopRun(message_loop_t* loop);
+
+/******************************************/
+/* message_loopDelete: free an event loop.
+ * Sockets and input descriptors are not closed; that is up to the caller.
+ * Logs: nothing.
+ */
+void message_loopDelete(message_loop_t* loop);
+
 /******************************************/
 /* message_done: shut down the module.
  * Caller provides: nothing.
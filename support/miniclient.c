@@ -4,6 +4,9 @@
  * Given the address of a server, this simple client sends each line of stdin
  * as a message to the server, and prints to stdout every message received
  * from the server; each printed message is surrounded by 'quotes'.
+ * Given a message as well, it sends only that message, prints the first
+ * reply (or nothing, if none comes within a second), and exits: a query,
+ * such as STATS, for scripts and operators.
  * 
  * David Kotz - May 2021
  */
@@ -18,6 +21,14 @@
 
 static bool handleInput  (void* arg);
 static bool handleMessage(void* arg, const addr_t from, const char* message);
+static bool handleReply  (void* arg, const addr_t from, const char* message);
+static bool handleTimeout(void* arg);
+
+/**************** file-local constants ****************/
+static const float QuerySeconds = 1.0;   // how long a query waits for its reply
+
+/**************** file-local global variables ****************/
+static bool replied = false;             // has the query been answered?
 
 /***************** main *******************************/
 int
@@ -30,8 +41,8 @@ main(const int argc, char* argv[])
 
   // check arguments
   const char* program = argv[0];
-  if (argc != 3) {
-    fprintf(stderr, "usage: %s hostname port\n", program);
+  if (argc != 3 && argc != 4) {
+    fprintf(stderr, "usage: %s hostname port [message]\n", program);
     return 3; // bad commandline
   }
   
@@ -44,9 +55,16 @@ main(const int argc, char* argv[])
     return 4; // bad hostname/port
   }
 
-  // Loop, waiting for input or for messages; provide callback functions.
-  // We use the 'arg' parameter to carry a pointer to 'server'.
-  bool ok = message_loop(&server, 0, NULL, handleInput, handleMessage);
+  bool ok;
+  if (argc == 4) {
+    // a query: send the message, and wait a while for one reply
+    message_send(server, argv[3]);
+    ok = message_loop(&server, QuerySeconds, handleTimeout, NULL, handleReply) && replied;
+  } else {
+    // Loop, waiting for input or for messages; provide callback functions.
+    // We use the 'arg' parameter to carry a pointer to 'server'.
+    ok = message_loop(&server, 0, NULL, handleInput, handleMessage);
+  }
 
   // shut down the message module
   message_done();
@@ -109,3 +127,25 @@ handleMessage(void* arg, const addr_t from, const char* message)
   fflush(stdout);
   return false;
 }
+
+/**************** handleReply ****************/
+/* The reply to a query; print it as it is, and stop looping.
+ */
+static bool
+handleReply(void* arg, const addr_t from, const char* message)
+{
+  printf("%s\n", message);
+  fflush(stdout);
+  replied = true;
+  return true;
+}
+
+/**************** handleTimeout ****************/
+/* No reply to a query came in time; stop looping.
+ */
+static bool
+handleTimeout(void* arg)
+{
+  fprintf(stderr, "no reply\n");
+  return true;
+}
@@ -0,0 +1,243 @@
+/*
+ * spsc - a lock-free single-producer/single-consumer queue
+ *
+ * See spsc.h for the interface.
+ *
+ * The ring is a power-of-two array of bytes.  'head' and 'tail' count
+ * bytes ever written and read; the producer alone advances head, the
+ * consumer alone advances tail, and each publishes its index with
+ * release/acquire ordering so the other sees the bytes behind it.
+ * Each record is an 8-byte header (its length) followed by the record,
+ * padded to a multiple of 8 bytes.  A record never wraps around the end
+ * of the ring; if it would, the producer writes a 'pad' header and
+ * starts the record at the beginning of the ring.
+ *
+ * A consumer with nothing to read sleeps on an eventfd; the producer
+ * writes the eventfd only when the consumer says it is asleep, so a
+ * busy queue costs no system calls at all.
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#define _GNU_SOURCE     // for eventfd (Linux)
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "spsc.h"
+
+/**************** file-local constants ****************/
+static const uint64_t PadRecord = UINT64_MAX; // header of a pad record
+static const size_t HeaderBytes = 8;          // size of a record header
+static const int SpinTries = 128;             // polls before sleeping
+
+/**************** file-local types ****************/
+/* Fields written by the producer and by the consumer are kept on
+ * separate cache lines, so the two threads don't fight over them.
+ */
+struct spsc {
+  char* ring;               // the bytes of the ring
+  size_t mask;              // capacity - 1 (capacity is a power of two)
+  int wakeFd;               // eventfd on which the consumer sleeps
+
+  // producer's cache line
+  _Alignas(64) _Atomic size_t head;  // bytes ever written
+  size_t cachedTail;        // producer's last look at tail
+  size_t reserved;          // bytes in the record being reserved
+  bool padding;             // does the reserved record need a pad first?
+  _Atomic bool closed;      // producer will write no more
+
+  // consumer's cache line
+  _Alignas(64) _Atomic size_t tail;  // bytes ever read
+  size_t cachedHead;        // consumer's last look at head
+  size_t peeked;            // bytes in the record being peeked
+  _Atomic bool sleeping;    // consumer is (about to be) asleep
+};
+
+/**************** file-local functions ****************/
+static size_t roundUp8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+/**************** spsc_new ****************/
+/* see spsc.h for description */
+spsc_t*
+spsc_new(size_t capacity)
+{
+  size_t size = 64;
+  while (size < capacity) {
+    size *= 2;
+  }
+
+  // aligned_alloc wants a size that is a multiple of the alignment
+  spsc_t* queue = aligned_alloc(64, (sizeof(spsc_t) + 63) & ~(size_t)63);
+  if (queue == NULL) {
+    return NULL;
+  }
+  memset(queue, 0, sizeof(spsc_t));
+  queue->ring = malloc(size);
+  queue->wakeFd = eventfd(0, EFD_CLOEXEC);
+  if (queue->ring == NULL || queue->wakeFd < 0) {
+    if (queue->wakeFd >= 0) {
+      close(queue->wakeFd);
+    }
+    free(queue->ring);
+    free(queue);
+    return NULL;
+  }
+  queue->mask = size - 1;
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+  atomic_init(&queue->closed, false);
+  atomic_init(&queue->sleeping, false);
+  return queue;
+}
+
+/**************** spsc_reserve ****************/
+/* see spsc.h for description */
+void*
+spsc_reserve(spsc_t* queue, size_t len)
+{
+  const size_t capacity = queue->mask + 1;
+  const size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  const size_t pos = head & queue->mask;
+  size_t need = HeaderBytes + roundUp8(len);
+
+  // a record that would run past the end of the ring starts over at 0
+  queue->padding = (need > capacity - pos);
+  if (queue->padding) {
+    need += capacity - pos;
+  }
+  if (need > capacity) {
+    return NULL;            // too big for this queue, ever
+  }
+
+  // is there room?  look at the consumer's tail only if we must
+  if (capacity - (head - queue->cachedTail) < need) {
+    queue->cachedTail = atomic_load_explicit(&queue->tail,
+                                             memory_order_acquire);
+    if (capacity - (head - queue->cachedTail) < need) {
+      return NULL;          // full
+    }
+  }
+
+  queue->reserved = need;
+  const size_t start = queue->padding ? 0 : pos;
+  memcpy(queue->ring + start, &(uint64_t){len}, HeaderBytes);
+  return queue->ring + start + HeaderBytes;
+}
+
+/**************** spsc_commit ****************/
+/* see spsc.h for description */
+void
+spsc_commit(spsc_t* queue)
+{
+  const size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  if (queue->padding) {
+    // tell the consumer to skip to the start of the ring
+    memcpy(queue->ring + (head & queue->mask), &PadRecord, HeaderBytes);
+  }
+
+  // publish the record; then wake the consumer if it went to sleep
+  atomic_store(&queue->head, head + queue->reserved);
+  if (atomic_exchange(&queue->sleeping, false)) {
+    eventfd_write(queue->wakeFd, 1);
+  }
+}
+
+/**************** spsc_close ****************/
+/* see spsc.h for description */
+void
+spsc_close(spsc_t* queue)
+{
+  atomic_store(&queue->closed, true);
+  if (atomic_exchange(&queue->sleeping, false)) {
+    eventfd_write(queue->wakeFd, 1);
+  }
+}
+
+/**************** spsc_peek ****************/
+/* see spsc.h for description */
+const void*
+spsc_peek(spsc_t* queue, size_t* len)
+{
+  const size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  if (tail == queue->cachedHead) {
+    queue->cachedHead = atomic_load_explicit(&queue->head,
+                                             memory_order_acquire);
+    if (tail == queue->cachedHead) {
+      return NULL;          // empty
+    }
+  }
+
+  size_t pos = tail & queue->mask;
+  size_t skip = 0;
+  uint64_t header;
+  memcpy(&header, queue->ring + pos, HeaderBytes);
+  if (header == PadRecord) {
+    // the record itself is at the start of the ring
+    skip = queue->mask + 1 - pos;
+    pos = 0;
+    memcpy(&header, queue->ring, HeaderBytes);
+  }
+
+  queue->peeked = skip + HeaderBytes + roundUp8(header);
+  *len = header;
+  return queue->ring + pos + HeaderBytes;
+}
+
+/**************** spsc_release ****************/
+/* see spsc.h for description */
+void
+spsc_release(spsc_t* queue)
+{
+  const size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  atomic_store_explicit(&queue->tail, tail + queue->peeked,
+                        memory_order_release);
+  queue->peeked = 0;
+}
+
+/**************** spsc_wait ****************/
+/* see spsc.h for description */
+bool
+spsc_wait(spsc_t* queue)
+{
+  size_t len;
+  while (true) {
+    // poll for a while; a busy producer will usually show up soon
+    for (int i = 0; i < SpinTries; i++) {
+      if (spsc_peek(queue, &len) != NULL) {
+        return true;
+      }
+      if (atomic_load(&queue->closed)) {
+        // check once more: records committed before closing still count
+        return spsc_peek(queue, &len) != NULL;
+      }
+    }
+
+    // say we're going to sleep, then make sure nothing slipped in
+    atomic_store(&queue->sleeping, true);
+    if (atomic_load(&queue->head) !=
+        atomic_load_explicit(&queue->tail, memory_order_relaxed)
+        || atomic_load(&queue->closed)) {
+      atomic_store(&queue->sleeping, false);
+      continue;
+    }
+
+    eventfd_t count;
+    eventfd_read(queue->wakeFd, &count);
+  }
+}
+
+/**************** spsc_delete ****************/
+/* see spsc.h for description */
+void
+spsc_delete(spsc_t* queue)
+{
+  if (queue != NULL) {
+    close(queue->wakeFd);
+    free(queue->ring);
+    free(queue);
+  }
+}
@@ -0,0 +1,102 @@
+/*
+ * spsc - a lock-free single-producer/single-consumer queue
+ *
+ * The queue is a ring of bytes holding variable-length records, such
+ * as datagrams, written by exactly one thread (the producer) and read
+ * by exactly one other thread (the consumer).  Neither side takes a lock;
+ * records are written and read in place, so there is no copying beyond
+ * what the producer writes into the ring.
+ *
+ * Producer sequence:
+ *   void* rec = spsc_reserve(queue, len);   // NULL if the queue is full
+ *   ... fill in len bytes at rec ...
+ *   spsc_commit(queue);
+ *   ...
+ *   spsc_close(queue);                      // no more records
+ * Consumer sequence:
+ *   while (spsc_wait(queue)) {              // blocks while queue is empty
+ *     size_t len;
+ *     const void* rec = spsc_peek(queue, &len);
+ *     ... use len bytes at rec ...
+ *     spsc_release(queue);
+ *   }
+ *
+ * Team 9: Plankton, May 2023
+ */
+
+#ifndef _SPSC_H_
+#define _SPSC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/****************** types *********************/
+typedef struct spsc spsc_t;  // opaque to users of this module
+
+/****************** functions *********************/
+
+/******************************************/
+/* spsc_new: create an empty queue.
+ * Caller provides:
+ *   the capacity of the queue in bytes, rounded up to a power of two;
+ *   each record takes its length plus up to 15 bytes of overhead.
+ * Function returns:
+ *   a new queue, or NULL on error.
+ * Caller expectations:
+ *   call spsc_delete once neither thread uses the queue.
+ */
+spsc_t* spsc_new(size_t capacity);
+
+/******************************************/
+/* spsc_reserve: (producer) make room for a record of len bytes.
+ * Function returns:
+ *   a pointer to len bytes (8-byte aligned) in which to write the record,
+ *   or NULL if the queue is too full, or the record is too big, to hold it.
+ * Notes:
+ *   The record is not visible to the consumer until spsc_commit.
+ */
+void* spsc_reserve(spsc_t* queue, size_t len);
+
+/******************************************/
+/* spsc_commit: (producer) publish the record last reserved,
+ * waking the consumer if it is waiting.
+ */
+void spsc_commit(spsc_t* queue);
+
+/******************************************/
+/* spsc_close: (producer) there will be no more records.
+ * The consumer may still read records already committed.
+ */
+void spsc_close(spsc_t* queue);
+
+/******************************************/
+/* spsc_peek: (consumer) look at the oldest record, without waiting.
+ * Function returns:
+ *   a pointer to the record, and its length in *len;
+ *   NULL if the queue is empty.
+ * Notes:
+ *   The record remains in the queue, unchanged, until spsc_release.
+ */
+const void* spsc_peek(spsc_t* queue, size_t* len);
+
+/******************************************/
+/* spsc_release: (consumer) remove the record last peeked.
+ */
+void spsc_release(spsc_t* queue);
+
+/******************************************/
+/* spsc_wait: (consumer) wait until the queue is not empty.
+ * Function returns:
+ *   true when a record is ready to peek;
+ *   false when the queue is empty and closed.
+ * Notes:
+ *   Spins briefly, then sleeps until the producer commits or closes.
+ */
+bool spsc_wait(spsc_t* queue);
+
+/******************************************/
+/* spsc_delete: free the queue and any records left in it.
+ */
+void spsc_delete(spsc_t* queue);
+
+#endif // _SPSC_H_